@@ -0,0 +1,77 @@
+#!/bin/sh
+# Reads the files of each directory here, and some generated ones, with the
+# code generated for its sample.toml, through the benchmark driver; with
+# --stream also in windows of a few bytes. A file whose first line is
+# "# error: MESSAGE" must fail with MESSAGE, any other must read.
+#
+# Usage: tests/run.sh [T2C]   (without T2C, builds toml2c.cpp first)
+set -eu
+
+here=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT INT TERM
+
+if [ $# -gt 0 ]; then
+    t2c=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+else
+    ${CXX:-g++} -std=c++17 -O2 "$here/../toml2c.cpp" -o "$work/t2c" -lpthread
+    t2c=$work/t2c
+fi
+
+failed=0
+checked=0
+
+# check NAME DIR CFLAGS T2C-OPTIONS...
+check() {
+    name=$1
+    dir=$2
+    cflags=$3
+    shift 3
+    # The driver times _stream, rather than _read, when asked to
+    mode=
+    case " $* " in
+        *" --stream "*) mode=--stream ;;
+    esac
+    out=$work/$name
+    mkdir -p "$out"
+    (cd "$out" && "$t2c" "$@" --emit-bench "$dir/sample.toml" >/dev/null)
+    # shellcheck disable=SC2086
+    ${CC:-cc} -O1 $cflags "$out/t2c-sample-bench.c" "$out/t2c-sample.c" -o "$out/bench"
+    for file in "$dir"/*.toml; do
+        want=$(sed -n '1s/^# error: //p' "$file")
+        if "$out/bench" ${mode:+"$mode"} -n 1 "$file" >/dev/null 2>"$out/stderr"; then
+            got=""
+        else
+            got=$(cat "$out/stderr")
+            got=${got:-failed}
+        fi
+        checked=$((checked + 1))
+        if [ -z "$want" ] && [ -n "$got" ]; then
+            echo "FAIL $name $(basename "$file"): $got"
+            failed=$((failed + 1))
+        elif [ -n "$want" ] && ! printf '%s' "$got" | grep -qF -- "$want"; then
+            echo "FAIL $name $(basename "$file"): expected \"$want\", got \"${got:-success}\""
+            failed=$((failed + 1))
+        fi
+    done
+}
+
+# An array that starts exactly where the first window of --stream ends
+mkdir "$work/boundary"
+cp "$here/direct/sample.toml" "$work/boundary/"
+{
+    head -c 65526 /dev/zero | tr '\0' '#'
+    echo
+    echo 'scores = [1.5, 2.5]'
+    grep -v '^scores' "$here/direct/sample.toml"
+} >"$work/boundary/scores.toml"
+
+check direct "$here/direct" "" --direct
+check direct-stream "$here/direct" "" --direct --stream
+check direct-stream-16 "$here/direct" -DT2C_STREAM_CHUNK=16 --direct --stream
+check direct-stream-64 "$here/direct" -DT2C_STREAM_CHUNK=64 --direct --stream
+check boundary "$work/boundary" "" --direct
+check boundary-stream "$work/boundary" "" --direct --stream
+
+echo "$checked checked, $failed failed"
+[ "$failed" -eq 0 ]
@@ -3,9 +3,22 @@
 #include <algorithm>
 #include <numeric>
 #include <functional>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
 #include <toml++/toml.h>
+#include <sys/resource.h>
 
 constexpr std::string_view lib_base_name = "t2c";
+// Part of every --incremental stamp: bump it whenever a change to t2c changes
+// the code it generates, so that outputs of older versions get rewritten
+constexpr std::string_view generator_version = "2";
 #define LIB_BASE_NAMEu (lib_base_name.size() ? std::string(lib_base_name) + "_" : "")
 #define LIB_BASE_NAMEh (lib_base_name.size() ? std::string(lib_base_name) + "-" : "")
 
@@ -26,19 +39,105 @@ static const std::string cvar(const std::string& var) {
     return s;
 }
 
-static const std::string tvar(const std::string& var) {
-    std::string s = var;
-    std::replace( s.begin(), s.end(), '_', '-');
+static const std::string cstr(const std::string& var) {
+    std::string s;
+    for (char c: var) {
+        if (c == '"' || c == '\\') {
+            s += '\\';
+        }
+        s += c;
+    }
+    return s;
+}
+
+// C literal of a TOML string, escaping what cannot appear verbatim
+static std::string c_string(const std::string& var) {
+    std::string s = "\"";
+    for (unsigned char c: var) {
+        if (c == '"' || c == '\\' || c == '?') {
+            s += '\\';
+            s += c;
+        } else if (c == '\n') {
+            s += "\\n";
+        } else if (c < 0x20 || c == 0x7f) {
+            char oct[8];
+            snprintf(oct, sizeof(oct), "\\%03o", c);
+            s += oct;
+        } else {
+            s += c;
+        }
+    }
+    return s + "\"";
+}
+
+// A TOML basic string holding s repeated scale times
+static std::string toml_string(const std::string& s, int scale = 1) {
+    std::string text = "\"";
+    for (int k = 0; k < scale; ++k) {
+        for (unsigned char c: s) {
+            if (c == '"' || c == '\\') {
+                text += '\\';
+                text += c;
+            } else if (c < 0x20 || c == 0x7f) {
+                char esc[8];
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                text += esc;
+            } else {
+                text += c;
+            }
+        }
+    }
+    return text + "\"";
+}
+
+// A key as written in TOML, quoted unless it is bare
+static std::string toml_key(const std::string& key) {
+    const bool bare = !key.empty() && std::all_of(key.begin(), key.end(), [] (char c) {
+        return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-';
+    });
+    return bare ? key : toml_string(key);
+}
+
+static const std::string mvar(const std::string& var) {
+    std::string s = cvar(var);
+    std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+    return s;
+}
+
+// Suffix of the C enumerator for the enum name value
+static std::string enum_name(const std::string& value) {
+    std::string s = value;
+    for (char& c: s) {
+        c = std::isalnum(static_cast<unsigned char>(c)) ? std::toupper(static_cast<unsigned char>(c)) : '_';
+    }
+    return s;
+}
+
+// File name without path and extension, which names the outputs
+static const std::string fname(const std::string& file) {
+    std::string s = file;
+    // Remove path
+    size_t pdir = s.find_last_of("\\/");
+    if (pdir != std::string::npos) {
+        s = s.substr(pdir+1);
+    }
+    // Remove extension
+    size_t pext = s.find(".toml");
+    if (pext != std::string::npos) {
+        s = s.substr(0, pext);
+    }
     return s;
 }
 
 struct Field {
     std::string name;
+    std::string key;
     enum class Type {
         t_int,
         t_double,
         t_bool,
         t_string,
+        t_enum,
         t_array,
         t_array_of_int,
         t_array_of_double,
@@ -46,33 +145,465 @@ struct Field {
         t_array_of_string
     } type;
 
+    // Set by the Reader from the options: moved to the cold block, or a
+    // bool packed into bit `bit` of its table's bitset (arrays: all bits)
+    bool cold = false;
+    bool packed = false;
+    int bit = -1;
+    // Longest string or array in the sample. With a capacity the value is
+    // stored inline: cap bytes for a string, cap elements for an array.
+    size_t sample = 0;
+    size_t cap = 0;
+    // The names of an enum, which is a string in the TOML file
+    std::vector<std::string> values;
+
     Field(std::string name, Field::Type type) : 
-        type(type) {
+        key(name), type(type) {
             this->name = cvar(name);
         }
 };
 
+// C type of a value of the given field type
+static std::string c_type(Field::Type type) {
+    switch (type) {
+        case Field::Type::t_int: return "int64_t";
+        case Field::Type::t_double: return "double";
+        case Field::Type::t_bool: return "bool";
+        case Field::Type::t_string: return "char*";
+        case Field::Type::t_enum: return "int";
+        case Field::Type::t_array: return "void**";
+        case Field::Type::t_array_of_int: return "int64_t*";
+        case Field::Type::t_array_of_double: return "double*";
+        case Field::Type::t_array_of_bool: return "bool*";
+        case Field::Type::t_array_of_string: return "char**";
+    }
+    return "";
+}
+
+// The names of the enum f, for messages
+static std::string enum_list(const Field& f) {
+    std::string list;
+    for (const std::string& v: f.values) {
+        list += (list.empty() ? "" : ", ") + v;
+    }
+    return list;
+}
+
 struct Table {
     std::vector<Field> fields;
     std::vector<Table*> children;
     Table* parent;
     uint8_t depth;
     std::string name;
+    // Array of tables: one entry per [[name]], holding only fields
+    bool array = false;
+    // Cached once by the Reader: the toml_table_t variable ("root_cat_family")
+    // and the member prefix ("cat.family.") of the table
+    std::string path;
+    std::string var;
+    // The table, or for arrays of tables the array, in the Reader's document
+    const toml::node* node = nullptr;
+};
+
+struct Options {
+    // Place the struct, its strings and its arrays in a single allocation
+    bool arena = false;
+    // Parse with the generated reader instead of tomlc99
+    bool direct = false;
+    // Also emit binary snapshot save/load functions
+    bool bin = false;
+    // Also emit the hot reload handle
+    bool handle = false;
+    // Also emit _read_many, reading files on a pool of threads
+    bool many = false;
+    // Also emit _open and per-table accessors that load tables on first use
+    bool lazy = false;
+    // Also emit _write_toml and _write_file, writing the values back as TOML
+    bool write = false;
+    // Also emit _hash, _equal and _diff, for change detection
+    bool compare = false;
+    // Also emit the field table with _find_path, _get_path and _set_path
+    bool reflect = false;
+    // Leave outputs whose stamp is current untouched and emit a depfile
+    bool incremental = false;
+    // Lay arrays of tables out as one array per field instead of per entry
+    bool soa = false;
+    // Order struct members by alignment and report sizes and padding
+    bool layout = false;
+    // Pack bools and bool arrays into bitsets behind accessors
+    bool pack = false;
+    // Key paths of fields or tables to move into the cold block
+    std::vector<std::string> cold;
+    // Store strings and arrays inline, with capacities taken from the sample
+    bool fixed = false;
+    // Key paths of strings and arrays to store inline, with their capacity
+    std::vector<std::pair<std::string, size_t>> caps;
+    // Key paths of strings that hold one of a fixed set of names, stored as
+    // a C enum
+    std::vector<std::pair<std::string, std::vector<std::string>>> enums;
+    // Also emit the sample's values as a constant instance
+    bool embed = false;
+    // Emit a field table read by the shared runtime instead of unrolled code
+    bool table = false;
+    // Also emit _stream, handing values to callbacks as the file is read
+    bool stream = false;
+    // Also emit t2c-FILE.hpp, C++17 views of the values in one owned buffer
+    bool cpp = false;
+    // Also emit the t2c-FILE-bench.c driver, and the sample scaled up by
+    // each factor in synth as t2c-FILE-xN.toml
+    bool bench = false;
+    std::vector<int> synth;
+};
+
+// Must match the hash emitted by Writer::c_phash()
+static uint32_t key_hash(uint32_t seed, uint32_t salt, const std::string& key) {
+    uint32_t h = 2166136261u ^ seed * 0x9E3779B9u ^ salt * 0x85EBCA6Bu;
+    for (unsigned char c: key) {
+        h = (h ^ c) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Minimal perfect hash over (salt, key) pairs, built with hash and displace:
+// keys are bucketed by key_hash(0, ...), and each bucket gets the first seed
+// that sends all its keys to free slots.
+struct PerfectHash {
+    std::vector<uint32_t> seeds;
+    std::vector<int> slots;
+
+    PerfectHash(const std::vector<std::pair<uint32_t, std::string>>& keys) {
+        size_t m = 1;
+        while (m < keys.size() + keys.size() / 4 + 1) {
+            m <<= 1;
+        }
+        size_t r = 1;
+        while (r < keys.size() / 4 + 1) {
+            r <<= 1;
+        }
+        std::vector<std::vector<int>> buckets(r);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            buckets[key_hash(0, keys[i].first, keys[i].second) & (r - 1)].push_back(i);
+        }
+        std::vector<int> order(r);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return buckets[a].size() > buckets[b].size();
+        });
+
+        for (;;) {
+            this->seeds.assign(r, 0);
+            this->slots.assign(m, -1);
+            bool placed = true;
+            for (int b: order) {
+                if (buckets[b].empty()) {
+                    break;
+                }
+                std::vector<size_t> taken;
+                uint32_t seed = 1;
+                for (; seed < (1u << 16); ++seed) {
+                    taken.clear();
+                    for (int k: buckets[b]) {
+                        size_t slot = key_hash(seed, keys[k].first, keys[k].second) & (m - 1);
+                        if (this->slots[slot] != -1 || std::find(taken.begin(), taken.end(), slot) != taken.end()) {
+                            break;
+                        }
+                        taken.push_back(slot);
+                    }
+                    if (taken.size() == buckets[b].size()) {
+                        break;
+                    }
+                }
+                if (taken.size() != buckets[b].size()) {
+                    placed = false;
+                    break;
+                }
+                this->seeds[b] = seed;
+                for (size_t i = 0; i < taken.size(); ++i) {
+                    this->slots[taken[i]] = buckets[b][i];
+                }
+            }
+            if (placed) {
+                return;
+            }
+            m <<= 1;
+        }
+    }
+};
+
+// FNV-1a over the shape of the schema: nesting, keys and field types
+static uint64_t schema_hash(const Table& t, uint64_t h = 14695981039346656037ull) {
+    auto mix = [&h] (const std::string& s) {
+        for (unsigned char c: s) {
+            h = (h ^ c) * 1099511628211ull;
+        }
+        h = (h ^ 0xFF) * 1099511628211ull;
+    };
+    mix((t.array ? "[" : "{") + t.name);
+    for (const Field& f: t.fields) {
+        mix(f.key + ":" + std::to_string(static_cast<int>(f.type)) + (f.cap ? "[" + std::to_string(f.cap) + "]" : "") + (f.values.empty() ? "" : "=" + enum_list(f)));
+    }
+    for (const Table* c: t.children) {
+        h = schema_hash(*c, h);
+    }
+    mix("}");
+    return h;
+}
+
+// Options that change the generated struct itself
+static std::string layout_id(const Options& opts) {
+    std::string id;
+    id += opts.soa ? " soa" : "";
+    id += opts.layout ? " layout" : "";
+    id += opts.pack ? " pack" : "";
+    for (const std::string& c: opts.cold) {
+        id += " cold=" + c;
+    }
+    id += opts.fixed ? " inline" : "";
+    for (const auto& c: opts.caps) {
+        id += " cap=" + c.first + "=" + std::to_string(c.second);
+    }
+    for (const auto& e: opts.enums) {
+        id += " enum=" + e.first;
+        for (const std::string& v: e.second) {
+            id += (&v == &e.second[0] ? "=" : ",") + v;
+        }
+    }
+    return id;
+}
+
+// Everything the generated code depends on besides the schema
+static std::string options_id(const Options& opts) {
+    std::string id = std::string(lib_base_name) + " " + std::string(generator_version);
+    id += opts.arena ? " arena" : "";
+    id += opts.direct ? " direct" : "";
+    id += opts.bin ? " bin" : "";
+    id += opts.handle ? " handle" : "";
+    id += opts.many ? " many" : "";
+    id += opts.lazy ? " lazy" : "";
+    id += opts.write ? " write" : "";
+    id += opts.compare ? " compare" : "";
+    id += opts.reflect ? " reflect" : "";
+    id += opts.embed ? " embed" : "";
+    id += opts.table ? " table" : "";
+    id += opts.stream ? " stream" : "";
+    id += opts.cpp ? " cpp" : "";
+    return id + layout_id(opts);
+}
+
+// The reflection types, shared by every generated header and the runtime
+static std::string field_decl() {
+    const std::string u = mvar(LIB_BASE_NAMEu);
+    return "#ifndef " + u + "FIELD_T\n#define " + u + R"(FIELD_T
+/* A member of the struct, found by its dotted key path. The types are
+ * numbered like the compiler's. */
+typedef enum {
+    )" + u + "INT, " + u + "DOUBLE, " + u + "BOOL, " + u + "STRING, " + u + "ENUM, " + u + R"(ARRAY,
+    )" + u + "ARRAY_OF_INT, " + u + "ARRAY_OF_DOUBLE, " + u + "ARRAY_OF_BOOL, " + u + R"(ARRAY_OF_STRING
+} )" + LIB_BASE_NAMEu + R"(type_t;
+
+typedef struct {
+    const char* path;           /* "cat.family.parent" */
+    const char* name;           /* the member, "parent" */
+    )" + LIB_BASE_NAMEu + R"(type_t type;
+    bool cold;                  /* in the block behind )" + LIB_BASE_NAMEu + R"(cold */
+    bool packed;                /* a bit of the byte at offset, or an array of bits */
+    int bit;
+    size_t offset;              /* of the member, in the struct, entry or cold block */
+    size_t len_offset;          /* of an array's _len member, or SIZE_MAX */
+    size_t cap;                 /* inline capacity, 0 behind a pointer */
+    const char* const* names;   /* an enum's names, n_names of them */
+    size_t n_names;
+} )" + LIB_BASE_NAMEu + R"(field_t;
+#endif
+)";
+}
+
+// A member of a generated struct: a field (with its _len), the packed
+// bools, a nested table, or the root's pointer to the cold block
+struct Member {
+    enum class Kind { field, bits, table, cold } kind;
+    const Field* field = nullptr;
+    const Table* table = nullptr;
+    size_t size = 0;
+    size_t align = 1;
+    size_t padding = 0;
 };
 
+// Members of t in the hot struct or the cold block, in emission order, with
+// their LP64 size, alignment and inner padding. Empty tables are left out.
+static std::vector<Member> struct_members(const Table& t, const Options& opts, bool cold) {
+    std::vector<Member> members;
+    const bool column = t.array && opts.soa;
+    const size_t ptr = sizeof(void*);
+
+    if (!t.parent && !cold && !opts.cold.empty()) {
+        Member m{Member::Kind::cold};
+        m.size = m.align = ptr;
+        members.push_back(m);
+    }
+    size_t bits = 0;
+    for (const Field& f: t.fields) {
+        if (f.cold != cold) {
+            continue;
+        }
+        if (f.packed && f.type == Field::Type::t_bool) {
+            ++bits;
+            continue;
+        }
+        Member m{Member::Kind::field, &f};
+        if (f.cap && !column) {
+            // Inline: the bytes, then _len for arrays
+            const size_t data = f.cap * (f.type == Field::Type::t_string || f.type == Field::Type::t_array_of_bool ? 1 : 8);
+            const bool len = f.type != Field::Type::t_string;
+            m.size = len ? (data + 7) / 8 * 8 + 8 : data;
+            m.align = len ? 8 : 1;
+            m.padding = m.size - data - (len ? 8 : 0);
+        } else if (f.type >= Field::Type::t_array) {
+            m.size = 2 * ptr;
+            m.align = ptr;
+        } else if (column || (f.type != Field::Type::t_bool && f.type != Field::Type::t_enum)) {
+            m.size = m.align = 8;
+        } else if (f.type == Field::Type::t_enum) {
+            m.size = m.align = 4;
+        } else {
+            m.size = 1;
+        }
+        members.push_back(m);
+    }
+    if (bits) {
+        Member m{Member::Kind::bits};
+        m.size = (bits + 7) / 8;
+        members.push_back(m);
+    }
+    for (const Table* c: t.children) {
+        std::vector<Member> inner = struct_members(*c, opts, cold);
+        if (inner.empty()) {
+            continue;
+        }
+        Member m{Member::Kind::table, nullptr, c};
+        if (c->array && !opts.soa) {
+            // Pointer to the entries and their count
+            m.size = 2 * ptr;
+            m.align = ptr;
+        } else {
+            size_t offset = 0;
+            for (const Member& i: inner) {
+                const size_t at = (offset + i.align - 1) / i.align * i.align;
+                m.padding += at - offset + i.padding;
+                m.align = std::max(m.align, i.align);
+                offset = at + i.size;
+            }
+            if (c->array) {
+                offset = (offset + ptr - 1) / ptr * ptr + ptr;
+                m.align = ptr;
+            }
+            m.size = (offset + m.align - 1) / m.align * m.align;
+            m.padding += m.size - offset;
+        }
+        members.push_back(m);
+    }
+
+    // Widest first: no holes between members, and only tail padding left
+    if (opts.layout) {
+        std::stable_sort(members.begin(), members.end(), [] (const Member& a, const Member& b) {
+            return a.align > b.align;
+        });
+    }
+    return members;
+}
+
+// Size and padding of the struct holding t's members
+static std::pair<size_t, size_t> struct_size(const Table& t, const Options& opts, bool cold) {
+    size_t offset = 0;
+    size_t align = 1;
+    size_t padding = 0;
+    for (const Member& m: struct_members(t, opts, cold)) {
+        const size_t at = (offset + m.align - 1) / m.align * m.align;
+        padding += at - offset + m.padding;
+        align = std::max(align, m.align);
+        offset = at + m.size;
+    }
+    const size_t size = (offset + align - 1) / align * align;
+    return { size, padding + size - offset };
+}
+
+// Dotted path of key in table t, for messages
+static std::string key_path(const Table& t, const std::string& key) {
+    std::string path = key;
+    for (const Table* p = &t; p->parent; p = p->parent) {
+        path = p->name + "." + path;
+    }
+    return path;
+}
+
+// Member of the --stream callbacks for the field f of t, or with no field for
+// the entries of the array of tables t: its key path with '_' for '.'
+static std::string callback_name(const Table& t, const Field* f) {
+    const std::string table = t.parent ? t.path.substr(5) : "";
+    return f ? (table.empty() ? "" : table + "_") + f->name : table;
+}
+
+// The type of the table t in the --cpp header: root_t, or its path with '_'
+// for '.', e.g. cat_family_t
+static std::string cpp_type(const Table& t) {
+    return (t.parent ? t.path.substr(5) : "root") + "_t";
+}
+
+// Tables in declaration order, root first. Fields are numbered in the same
+// order across all tables.
+static std::vector<const Table*> schema_tables(const Table& root) {
+    std::vector<const Table*> tables;
+    std::function<void(const Table&)> number_r;
+    number_r = [&] (const Table& t)->void {
+        tables.push_back(&t);
+        for (const Table* c: t.children) {
+            number_r(*c);
+        }
+    };
+    number_r(root);
+    return tables;
+}
+
+// Escapes a path for the rule side of a depfile
+static std::string make_escape(const std::string& path) {
+    std::string s;
+    for (char c: path) {
+        if (c == ' ' || c == '#' || c == '\\') {
+            s += '\\';
+        } else if (c == '$') {
+            s += '$';
+        }
+        s += c;
+    }
+    return s;
+}
+
 class Reader {
     public:
+        Reader(const Options& opts) : opts(opts) {}
         int parser(const std::string& file);
         const Table& get_root();
 
     private:
+        Options opts;
+        toml::table doc;
         std::deque<Table> tables;
+        std::set<std::string> dropped;
         void tabler(Table& parent, const toml::table* table);
+        void drop(const Table& parent, const std::string& key, const char* what);
+        Table* find(const std::string& path, Field*& field);
+        int layout(const std::string& file);
         int c_depth;
 };
 
 struct Writer {
     public:
+        Writer(const Options& opts) : opts(opts) {}
         void write(const std::string& name, const Table& root);
 
     private:
@@ -83,21 +614,131 @@ struct Writer {
             }
             return out.size() - is;
         }
+        // Appends each piece to out, without building temporaries
+        template<typename... Ts>
+        void put(const Ts&... s) {
+            (this->out.append(s), ...);
+        }
+        // Indents the lines emitted since pos by one more level
+        void indent_since(size_t pos) {
+            std::string body;
+            body.reserve(2 * (this->out.size() - pos));
+            for (size_t i = pos; i < this->out.size(); ++i) {
+                if ((i == pos || this->out[i-1] == '\n') && this->out[i] != '\n') {
+                    body += "    ";
+                }
+                body += this->out[i];
+            }
+            this->out.resize(pos);
+            this->out += body;
+        }
+        // Expression for f (or its _len with suffix) of t in the struct obj
+        // points to. Cold fields live behind the root's cold pointer; fields
+        // of an array of tables belong to the entry at index, in either layout.
+        std::string member(const std::string& obj, const Table& t, const Field& f, const std::string& index, const char* suffix = "") const {
+            const std::string field = f.name + suffix;
+            if (f.cold) {
+                return obj + "->" + LIB_BASE_NAMEu + "cold->" + t.var + field;
+            }
+            if (!t.array) {
+                return obj + "->" + t.var + field;
+            }
+            const std::string base = obj + "->" + t.var.substr(0, t.var.size()-1);
+            return this->opts.soa ? base + "." + field + "[" + index + "]" : base + "[" + index + "]." + field;
+        }
+        // Expression for the packed scalar bool f of t, as a getter call or,
+        // with value, a setter call
+        std::string bit(const std::string& obj, const Table& t, const Field& f, const std::string& value = "") const {
+            const std::string name = this->base_name + t.path.substr(4) + "_" + f.name;
+            return value.empty() ? name + "(" + obj + ")" : name + "_set(" + obj + ", " + value + ")";
+        }
+        // The C enum type of the enum f of t, and the name of one of its values
+        std::string enum_type(const Table& t, const Field& f) const {
+            return this->base_name + t.path.substr(4) + "_" + f.name + "_t";
+        }
+        std::string enum_value(const Table& t, const Field& f, const std::string& value) const {
+            return mvar(this->base_name + t.path.substr(4) + "_" + f.name) + "_" + enum_name(value);
+        }
+        // Expression for the value of f named by the string s, -1 for none,
+        // and the statement reporting that s is none
+        std::string enum_of(const Field& f, const std::string& s) const {
+            return this->base_name + "_enum(" + std::to_string(this->enum_ids.at(&f)) + ", " + s + ", strlen(" + s + "))";
+        }
+        std::string enum_unknown(const Table& t, const Field& f, const std::string& s) const {
+            return this->base_name + "_error(\"" + this->base_name + ": " + cstr(key_path(t, f.key)) + " = '%s' is not one of " + cstr(enum_list(f)) + "\", " + s + ");";
+        }
+        // Expression for the name of the enum value v of f, "" when out of range
+        std::string enum_string(const Table& t, const Field& f, const std::string& v) const {
+            const std::string names = this->base_name + t.path.substr(4) + "_" + f.name + "_names";
+            return "((unsigned)" + v + " < " + std::to_string(f.values.size()) + " ? " + names + "[" + v + "] : \"\")";
+        }
+        // C statements reporting that the inline field f of t overflowed
+        std::string overflow(const Table& t, const Field& f) const {
+            const std::string what = f.type == Field::Type::t_string
+                ? " is longer than " + std::to_string(f.cap - 1) + " bytes"
+                : " has more than " + std::to_string(f.cap) + " elements";
+            return this->base_name + "_error(\"" + this->base_name + ": " + cstr(key_path(t, f.key)) + what + "\");";
+        }
+        // Expression for the number of entries of an array of tables
+        std::string count(const std::string& obj, const Table& t) const {
+            const std::string base = obj + "->" + t.var.substr(0, t.var.size()-1);
+            return this->opts.soa ? base + ".len" : base + "_len";
+        }
+        Options opts;
+        bool phash_emitted = false;
+        bool dispatch_emitted = false;
+        // Numbers the enums for the lookup emitted by c_enums
+        std::map<const Field*, int> enum_ids;
+        std::string base_name;
         std::string o_name;
         std::string o_var;
+        // The struct parameter of the generated functions. It does not follow
+        // the file name, which could clash with their locals.
+        std::string ptr = "ptr";
+        std::string stamp;
         std::string out;
+
+        bool is_current(const std::string& path);
+        void depfile(const std::string& input);
     
         void h_header();
-        void h_struct(const Table& t);
-        void h_functions(const std::string& name);
+        void h_struct(const Table& t, bool cold);
+        void h_bits(const Table& t);
+        void h_enums(const Table& t);
+        void h_functions(const Table& root);
         void h_finalize();
+        void h_cpp(const Table& root);
 
         void c_src(const Table& root);
+        void c_tables(const Table& root);
+        void c_read(const Table& root);
+        void c_arena(const Table& root);
+        void c_dispatch(const Table& root);
+        void c_tp_store(const Table& t, const Field& f, const std::string& dst, const std::string& len);
+        void c_direct(const Table& root);
+        void c_stream(const Table& root);
+        void c_entry(const Table& root);
+        void c_clear(const Table& root);
+        void c_free(const Table& root);
+        void c_handle(const Table& root);
+        void c_bin(const Table& root);
+        void c_embed(const Table& root);
+        void c_stats(const Table& root);
+        void c_many(const Table& root);
+        void c_print(const Table& root);
+        void c_compare(const Table& root);
+        void c_enums(const Table& root);
+        void c_reflect(const Table& root);
+        void c_rt(const Table& root);
+        void c_phash(const std::string& fn, const std::vector<std::pair<uint32_t, std::string>>& keys, const std::vector<int>& values);
         void c_finalize();
+
+        void c_bench(const Table& root);
+        void synth(const Table& root, int scale);
 };
 
 int Reader::parser(const std::string& file) {
-    toml::table tbl;
+    toml::table& tbl = this->doc;
     try {
         tbl = toml::parse_file(file);
     } catch (const toml::parse_error& err) {
@@ -107,17 +748,7 @@ int Reader::parser(const std::string& file) {
 
     Table t;
     // Filename to struct name
-    std::string s_name = file;
-    // Remove path
-    size_t pdir = file.find_last_of("\\/");
-    if (pdir != std::string::npos) {
-        s_name = s_name.substr(pdir+1);
-    }
-    // Remove extension
-    size_t pext = s_name.find(".toml");
-    if (pext != std::string::npos) {
-        s_name = s_name.substr(0, pext);
-    }
+    std::string s_name = fname(file);
 
     this->c_depth = 0;
     s_name = cvar(s_name);
@@ -126,12 +757,228 @@ int Reader::parser(const std::string& file) {
 
     t.parent = NULL;
     t.name = s_name;
+    t.path = "root";
     t.depth = this->c_depth;
+    t.node = &tbl;
     this->tables.emplace_back( std::move(t) );
 
     this->c_depth = 1;
     this->tabler(this->tables.back(), &tbl); 
 
+    return this->layout(file);
+}
+
+// Applies --cold, capacities and --pack-bools to the schema and, with --layout,
+// reports what each struct costs before and after
+int Reader::layout(const std::string& file) {
+    Table& root = this->tables[0];
+    const Options plain;
+    std::vector<std::pair<size_t, size_t>> before;
+    std::function<void(const Table&)> measure;
+    measure = [&] (const Table& t)->void {
+        if (!t.parent || (t.array && !this->opts.soa)) {
+            before.push_back(struct_size(t, plain, false));
+        }
+        for (const Table* c: t.children) {
+            measure(*c);
+        }
+    };
+    if (this->opts.layout) {
+        measure(root);
+    }
+
+    // A dotted path names one field or every field of a table below it
+    for (const std::string& path: this->opts.cold) {
+        Field* field = nullptr;
+        Table* t = this->find(path, field);
+        bool array = false;
+        for (const Table* p = t; p; p = p->parent) {
+            array = array || p->array;
+        }
+        if (!t || array) {
+            std::cerr << file << ": --cold " << path << (t ? " reaches into an array of tables" : " matches no field or table") << "\n";
+            return 1;
+        }
+        if (field) {
+            field->cold = true;
+            continue;
+        }
+        std::function<int(Table&)> mark;
+        mark = [&] (Table& c)->int {
+            if (c.array) {
+                std::cerr << file << ": --cold " << path << " contains an array of tables\n";
+                return 1;
+            }
+            for (Field& f: c.fields) {
+                f.cold = true;
+            }
+            for (Table* cc: c.children) {
+                if (mark(*cc)) {
+                    return 1;
+                }
+            }
+            return 0;
+        };
+        if (mark(*t)) {
+            return 1;
+        }
+    }
+
+    // Enums: distinct C names, and the sample only holds listed names
+    for (const auto& e: this->opts.enums) {
+        Field* field = nullptr;
+        Table* t = this->find(e.first, field);
+        if (!field || field->type != Field::Type::t_enum) {
+            std::cerr << file << ": --enum " << e.first << " matches no string\n";
+            return 1;
+        }
+        std::set<std::string> names;
+        for (const std::string& v: e.second) {
+            if (!names.insert(enum_name(v)).second) {
+                std::cerr << file << ": --enum " << e.first << " has two names for " << enum_name(v) << "\n";
+                return 1;
+            }
+        }
+        std::vector<const toml::table*> samples;
+        if (t->array) {
+            for (const auto& el: *t->node->as_array()) {
+                samples.push_back(el.as_table());
+            }
+        } else {
+            samples.push_back(t->node->as_table());
+        }
+        for (const toml::table* sample: samples) {
+            const toml::node* n = sample ? sample->get(field->key) : nullptr;
+            const std::string v = n ? n->value<std::string>().value_or("") : e.second[0];
+            if (std::find(e.second.begin(), e.second.end(), v) == e.second.end()) {
+                std::cerr << file << ": " << key_path(*t, field->key) << " = \"" << v << "\" is not one of --enum " << e.first << "\n";
+                return 1;
+            }
+        }
+    }
+
+    // Capacities: given ones first, then the sample rounded up to a power of two
+    for (const auto& c: this->opts.caps) {
+        Field* field = nullptr;
+        this->find(c.first, field);
+        if (!field || field->type == Field::Type::t_int || field->type == Field::Type::t_double || field->type == Field::Type::t_bool
+                || field->type == Field::Type::t_enum || field->type == Field::Type::t_array_of_string) {
+            std::cerr << file << ": --cap " << c.first << " matches no string or array of numbers or bools\n";
+            return 1;
+        }
+        field->cap = c.second;
+        if (this->opts.embed && field->sample + (field->type == Field::Type::t_string) > field->cap) {
+            std::cerr << file << ": --cap " << c.first << " is too small for the embedded value\n";
+            return 1;
+        }
+    }
+    if (this->opts.fixed) {
+        for (Table& t: this->tables) {
+            for (Field& f: t.fields) {
+                const bool string = f.type == Field::Type::t_string;
+                if (f.cap || (!string && (f.type < Field::Type::t_array_of_int || f.type == Field::Type::t_array_of_string))) {
+                    continue;
+                }
+                f.cap = string ? 8 : 1;
+                while (f.cap < f.sample + string) {
+                    f.cap *= 2;
+                }
+            }
+        }
+    }
+
+    // Entries of arrays of tables and the cold block keep plain bools.
+    // Inline bool arrays are not packed.
+    if (this->opts.pack) {
+        for (Table& t: this->tables) {
+            int bit = 0;
+            for (Field& f: t.fields) {
+                if (t.array || f.cold) {
+                    continue;
+                }
+                if (f.type == Field::Type::t_bool) {
+                    f.packed = true;
+                    f.bit = bit++;
+                } else if (f.type == Field::Type::t_array_of_bool && !f.cap) {
+                    f.packed = true;
+                }
+            }
+        }
+    }
+
+    // Lazy accessors are named after their table, next to the other functions
+    static const std::set<std::string> taken = {
+        "_read", "_read_fd", "_read_mem", "_read_arena", "_read_many", "_print", "_free",
+        "_open", "_root", "_close", "_default", "_stats", "_stats_callback", "_handle_new",
+        "_handle_free", "_reload", "_acquire", "_release", "_save_bin", "_load_bin", "_unload_bin",
+        "_clear", "_load", "_text", "_fd", "_error", "_err", "_worker", "_lazy", "_many_t",
+        "_stream", "_callbacks_t"
+    };
+    for (const Table& t: this->tables) {
+        if (this->opts.lazy && t.parent && (taken.count(t.path.substr(4)) || t.path.rfind("root_fill", 0) == 0
+                    || (this->opts.stream && t.path.rfind("root_stream_", 0) == 0))) {
+            std::cerr << file << ": --lazy accessor for [" << key_path(*t.parent, t.name) << "] would clash with a generated function\n";
+            return 1;
+        }
+    }
+
+    // Stream callbacks are named after their key path, with '_' for '.'
+    std::map<std::string, std::string> callbacks;
+    for (const Table& t: this->tables) {
+        std::vector<std::pair<std::string, std::string>> names;
+        if (t.array) {
+            names.emplace_back(callback_name(t, nullptr), key_path(*t.parent, t.name));
+        } else {
+            for (const Field& f: t.fields) {
+                names.emplace_back(callback_name(t, &f), key_path(t, f.key));
+            }
+        }
+        for (const auto& n: names) {
+            auto [it, fresh] = callbacks.emplace(n.first, n.second);
+            if (this->opts.stream && !fresh) {
+                std::cerr << file << ": --stream callback " << n.first << " would serve both " << it->second << " and " << n.second << "\n";
+                return 1;
+            }
+        }
+    }
+
+    // C++ types are named after the table's path, with '_' for '.'
+    std::map<std::string, std::string> types;
+    for (const Table& t: this->tables) {
+        const std::string path = t.parent ? key_path(*t.parent, t.name) : "the root";
+        auto [it, fresh] = types.emplace(cpp_type(t), path);
+        if (this->opts.cpp && !fresh) {
+            std::cerr << file << ": --cpp type " << it->first << " would name both " << it->second << " and " << path << "\n";
+            return 1;
+        }
+    }
+
+    if (!this->opts.layout) {
+        return 0;
+    }
+    std::string report = "Layout of " + file + ":\n";
+    auto line = [&report] (const std::string& name, std::pair<size_t, size_t> from, std::pair<size_t, size_t> to) {
+        char buf[256];
+        snprintf(buf, sizeof(buf), "  %-32s %5zu -> %5zu bytes, padding %4zu -> %4zu\n", name.c_str(), from.first, to.first, from.second, to.second);
+        report += buf;
+    };
+    size_t i = 0;
+    std::function<void(const Table&)> print;
+    print = [&] (const Table& t)->void {
+        if (!t.parent) {
+            line(t.name, before[i++], struct_size(t, this->opts, false));
+            if (!this->opts.cold.empty()) {
+                line(t.name.substr(0, t.name.size()-2) + "_cold_t", { 0, 0 }, struct_size(t, this->opts, true));
+            }
+        } else if (t.array && !this->opts.soa) {
+            line(root.name.substr(0, root.name.size()-2) + t.path.substr(4) + " entry", before[i++], struct_size(t, this->opts, false));
+        }
+        for (const Table* c: t.children) {
+            print(*c);
+        }
+    };
+    print(root);
+    std::cout << report;
     return 0;
 }
 
@@ -139,15 +986,72 @@ const Table& Reader::get_root() {
     return this->tables[0];
 }
 
+// Finds the table a dotted key path names, or the field it names within it
+Table* Reader::find(const std::string& path, Field*& field) {
+    Table* t = &this->tables[0];
+    size_t pos = 0;
+    field = nullptr;
+    while (pos <= path.size()) {
+        const size_t end = std::min(path.find('.', pos), path.size());
+        const std::string key = path.substr(pos, end - pos);
+        pos = end + 1;
+        Table* next = nullptr;
+        for (Table* c: t->children) {
+            next = c->name == key ? c : next;
+        }
+        if (next) {
+            t = next;
+            continue;
+        }
+        for (Field& f: t->fields) {
+            field = f.key == key ? &f : field;
+        }
+        if (!field || pos <= path.size()) {
+            field = nullptr;
+            return nullptr;
+        }
+    }
+    return t;
+}
+
+// Warns once about a value that cannot be part of the struct
+void Reader::drop(const Table& parent, const std::string& key, const char* what) {
+    std::string path = key;
+    for (const Table* p = &parent; p->parent; p = p->parent) {
+        path = p->name + "." + path;
+    }
+    if (this->dropped.insert(path).second) {
+        std::cerr << "Skipping " << path << ": " << what << "\n";
+    }
+}
+
 void Reader::tabler(Table& parent, const toml::table* table) {
     table->for_each([this, &parent](auto& key, auto& value) {
         Table t;
         bool mixed_array = false;
+        const size_t added = parent.fields.size();
+        const size_t sample = value.as_string() ? value.as_string()->get().size() : value.as_array() ? value.as_array()->size() : 0;
+        // Entries of an array of tables share one schema, the union of their keys
+        if (parent.array) {
+            for (Field& f: parent.fields) {
+                if (f.key == key.data()) {
+                    f.sample = std::max(f.sample, sample);
+                    return;
+                }
+            }
+        }
         switch (value.type()) {
             case toml::node_type::table:
+                if (parent.array) {
+                    this->drop(parent, key.data(), "tables inside arrays of tables are not supported");
+                    break;
+                }
                 t.depth = this->c_depth;
                 t.name = key.data();
                 t.parent = &parent;
+                t.path = parent.path + "_" + cvar(t.name);
+                t.var = parent.var + cvar(t.name) + ".";
+                t.node = &value;
                 ++this->c_depth;
                 this->tables.emplace_back(std::move(t));
                 parent.children.emplace_back(&this->tables.back());
@@ -162,6 +1066,12 @@ void Reader::tabler(Table& parent, const toml::table* table) {
 
             case toml::node_type::string:
                 parent.fields.emplace_back(Field(key.data(), Field::Type::t_string));
+                for (const auto& e: this->opts.enums) {
+                    if (e.first == key_path(parent, key.data())) {
+                        parent.fields.back().type = Field::Type::t_enum;
+                        parent.fields.back().values = e.second;
+                    }
+                }
                 break;
 
             case toml::node_type::floating_point:
@@ -173,7 +1083,33 @@ void Reader::tabler(Table& parent, const toml::table* table) {
                 break;
 
             case toml::node_type::array:
-                
+                if (value.as_array()->empty()) {
+                    this->drop(parent, key.data(), "the element type of an empty array is unknown");
+                    break;
+                }
+                if (value.as_array()->is_array_of_tables()) {
+                    if (parent.array) {
+                        this->drop(parent, key.data(), "nested arrays of tables are not supported");
+                        break;
+                    }
+                    t.depth = this->c_depth;
+                    t.name = key.data();
+                    t.parent = &parent;
+                    t.array = true;
+                    t.path = parent.path + "_" + cvar(t.name);
+                    t.var = parent.var + cvar(t.name) + ".";
+                    t.node = &value;
+                    this->tables.emplace_back(std::move(t));
+                    parent.children.emplace_back(&this->tables.back());
+
+                    Table& entries = this->tables.back();
+                    ++this->c_depth;
+                    for (const auto& el : *value.as_array()) {
+                        this->tabler(entries, el.as_table());
+                    }
+                    --this->c_depth;
+                    break;
+                }
                 for (const auto& el : *value.as_array()) {
                     if (el.type() != value.as_array()->at(0).type()) {
                         mixed_array = true;
@@ -202,99 +1138,339 @@ void Reader::tabler(Table& parent, const toml::table* table) {
                             /* parent.fields.emplace_back(Field(key.data(), Field::Type::t_array)); */
                             break;
                     }
+                } else {
+                    this->drop(parent, key.data(), "mixed-type arrays are not supported");
                 }
                 break;
 
             default:
                 break;
         }
+        if (parent.fields.size() > added) {
+            parent.fields.back().sample = sample;
+        }
     });
 }
 
 void Writer::h_header() {
+    this->out += this->stamp;
     this->out += R"(#pragma once
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+)";
+    if (this->opts.arena) {
+        this->out += "#include <stddef.h>\n\n";
+        this->put("#ifndef ", mvar(LIB_BASE_NAMEu), "ARENA_T\n");
+        this->put("#define ", mvar(LIB_BASE_NAMEu), "ARENA_T\n");
+        this->out += "/* Caller-owned memory for *_read_arena(). Reset with used = 0. */\n";
+        this->put("typedef struct {\n    char* base;\n    size_t cap;\n    size_t used;\n} ", LIB_BASE_NAMEu, "arena_t;\n");
+        this->out += "#endif\n";
+    }
+    if (this->opts.many) {
+        this->put("\n#ifndef ", mvar(LIB_BASE_NAMEu), "ERROR_T\n");
+        this->put("#define ", mvar(LIB_BASE_NAMEu), "ERROR_T\n");
+        this->out += "/* Outcome of one file of *_read_many(): what _read returned, and why */\n";
+        this->put("typedef struct {\n    int rc;\n    char msg[256];\n} ", LIB_BASE_NAMEu, "error_t;\n");
+        this->out += "#endif\n";
+    }
+    if (this->opts.reflect || this->opts.table) {
+        this->out += "\n" + field_decl();
+    }
+    const std::string stats = mvar(LIB_BASE_NAMEu) + "STATS";
+    this->put("\n#if defined(", stats, ") && !defined(", stats, "_T)\n");
+    this->put("#define ", stats, "_T\n");
+    this->out += R"(/* Where a read spent its time, in ns. Filled when the generated code is
+ * built with -D)" + stats + R"(. Allocations are the generated code's own. */
+typedef struct {
+    const char* name;
+    uint64_t ns;
+} )" + LIB_BASE_NAMEu + R"(stats_table_t;
 
-typedef )";
+typedef struct {
+    const char* src;        /* path, "fd" or "buffer" */
+    int rc;                 /* what the read returned */
+    uint64_t total_ns;
+    uint64_t io_ns;         /* opening, reading or mapping the file */
+    uint64_t parse_ns;      /* the TOML parser, with --direct filling the struct */
+    uint64_t load_ns;       /* copying parsed values into the struct */
+    uint64_t arrays_ns;     /* building arrays, part of the above */
+    uint64_t allocs;
+    uint64_t alloc_bytes;
+    size_t n_tables;        /* top-level tables, in schema order */
+    const )" + LIB_BASE_NAMEu + R"(stats_table_t* tables;
+} )" + LIB_BASE_NAMEu + R"(stats_t;
+
+typedef void (*)" + LIB_BASE_NAMEu + "stats_fn)(const " + LIB_BASE_NAMEu + R"(stats_t* stats, void* ctx);
+#endif
+)";
+    this->out += "\n";
 }
 
-void Writer::h_struct(const Table& t) {
+void Writer::h_struct(const Table& t, bool cold) {
+    // With --soa every field of an array of tables becomes a column
+    const bool column = t.array && this->opts.soa;
+
     this->mk_indent(t.depth);
-    this->out += s_table;
+    if (!t.parent) {
+        this->out += "typedef ";
+    }
+    if (t.array && !column) {
+        this->put("struct ", this->base_name, t.path.substr(4), " {\n");
+    } else {
+        this->out += s_table;
+    }
 
-    for (const Field& f: t.fields) {
+    for (const Member& m: struct_members(t, this->opts, cold)) {
+        if (m.kind == Member::Kind::table) {
+            this->h_struct(*m.table, cold);
+            continue;
+        }
         this->mk_indent(t.depth + 1);
+        if (m.kind == Member::Kind::cold) {
+            this->put(this->base_name, "_cold_t* ", LIB_BASE_NAMEu, "cold;\n");
+            continue;
+        }
+        if (m.kind == Member::Kind::bits) {
+            this->put("uint8_t ", LIB_BASE_NAMEu, "bits[", std::to_string(m.size), "];\n");
+            continue;
+        }
+        const Field& f = *m.field;
+        std::string type;
+        bool len = true;
         switch (f.type) {
             case Field::Type::t_int:
-                this->out += std::string(s_type_int) + f.name + ";\n";
-                break;
+                type = s_type_int; len = false; break;
             case Field::Type::t_string:
-                this->out += std::string(s_type_string) + f.name + ";\n";
-                break;
-
+                type = s_type_string; len = false; break;
+            case Field::Type::t_enum:
+                type = this->enum_type(t, f) + " "; len = false; break;
             case Field::Type::t_double:
-                this->out += std::string(s_type_double) + f.name + ";\n";
-                break;
-
+                type = s_type_double; len = false; break;
             case Field::Type::t_bool:
-                this->out += std::string(s_type_bool) + f.name + ";\n";
-                break;
-
+                type = s_type_bool; len = false; break;
             case Field::Type::t_array:
-                this->out += std::string(s_type_array) + f.name + ";\n";
-                this->mk_indent(t.depth + 1);
-                this->out += "size_t " + f.name + "_len;\n";
-                break;
-
+                type = s_type_array; break;
             case Field::Type::t_array_of_int:
-                this->out += std::string(s_type_array_of_int) + f.name + ";\n";
-                this->mk_indent(t.depth + 1);
-                this->out += "size_t " + f.name + "_len;\n";
-                break;
-
+                type = s_type_array_of_int; break;
             case Field::Type::t_array_of_double:
-                this->out += std::string(s_type_array_of_double) + f.name + ";\n";
-                this->mk_indent(t.depth + 1);
-                this->out += "size_t " + f.name + "_len;\n";
-                break;
-
+                type = s_type_array_of_double; break;
             case Field::Type::t_array_of_bool:
-                this->out += std::string(s_type_array_of_bool) + f.name + ";\n";
-                this->mk_indent(t.depth + 1);
-                this->out += "size_t " + f.name + "_len;\n";
-                break;
-
+                // Packed: bit i of the array is bit i%8 of byte i/8
+                type = f.packed ? "uint8_t* " : s_type_array_of_bool; break;
             case Field::Type::t_array_of_string:
-                this->out += std::string(s_type_array_of_string) + f.name + ";\n";
-                this->mk_indent(t.depth + 1);
-                this->out += "size_t " + f.name + "_len;\n";
-                break;
-
-            default:
-                break;
+                type = s_type_array_of_string; break;
+        }
+        if (f.cap) {
+            // Inline, with --soa each column entry is an array
+            type.erase(type.find('*'), 1);
+            const std::string cap = "[" + std::to_string(f.cap) + "]";
+            this->put(type, column ? "(*" + f.name + ")" : f.name, cap, ";\n");
+        } else {
+            if (column) {
+                type.insert(type.size()-1, "*");
+            }
+            this->put(type, f.name, ";\n");
+        }
+        if (len) {
+            this->mk_indent(t.depth + 1);
+            this->put(column ? "size_t* " : "size_t ", f.name, "_len;\n");
         }
     }
 
-    for (Table* c: t.children) {
-        this->h_struct(*c);
+    if (column) {
+        this->mk_indent(t.depth + 1);
+        this->out += "size_t len;\n";
     }
-
     mk_indent(t.depth);
-    this->out += "} " + cvar(t.name) + ";\n";
+    if (!t.parent) {
+        this->put("} ", cold ? this->base_name + "_cold_t" : t.name, ";\n");
+    } else if (t.array && !column) {
+        this->put("}* ", cvar(t.name), ";\n");
+        mk_indent(t.depth);
+        this->put("size_t ", cvar(t.name), "_len;\n");
+    } else {
+        this->put("} ", cvar(t.name), ";\n");
+    }
+}
+
+// The C enums of --enum, numbered in the order given
+void Writer::h_enums(const Table& t) {
+    for (const Field& f: t.fields) {
+        if (f.type != Field::Type::t_enum) {
+            continue;
+        }
+        this->put("/* ", cstr(key_path(t, f.key)), " */\ntypedef enum {\n");
+        for (const std::string& v: f.values) {
+            this->put("    ", this->enum_value(t, f, v), &v == &f.values.back() ? "\n" : ",\n");
+        }
+        this->put("} ", this->enum_type(t, f), ";\n\n");
+    }
+    for (const Table* c: t.children) {
+        this->h_enums(*c);
+    }
 }
 
-void Writer::h_functions(const std::string& name) {
+// Getters and setters for the bools --pack-bools folded into bitsets
+void Writer::h_bits(const Table& t) {
+    const std::string name = this->base_name + "_t";
+    for (const Field& f: t.fields) {
+        if (!f.packed) {
+            continue;
+        }
+        const std::string fn = this->base_name + t.path.substr(4) + "_" + f.name;
+        if (f.type == Field::Type::t_bool) {
+            const std::string byte = this->ptr + "->" + t.var + LIB_BASE_NAMEu + "bits[" + std::to_string(f.bit / 8) + "]";
+            const std::string mask = "(uint8_t)(1u << " + std::to_string(f.bit % 8) + ")";
+            this->put("\nstatic inline bool ", fn, "(const ", name, "* ", this->ptr, ") {\n");
+            this->put("    return (", byte, " & ", mask, ") != 0;\n}\n");
+            this->put("static inline void ", fn, "_set(", name, "* ", this->ptr, ", bool v) {\n");
+            this->put("    if (v) ", byte, " |= ", mask, "; else ", byte, " &= (uint8_t)~", mask, ";\n}\n");
+        } else {
+            const std::string byte = this->ptr + "->" + t.var + f.name + "[i >> 3]";
+            this->put("\nstatic inline bool ", fn, "(const ", name, "* ", this->ptr, ", size_t i) {\n");
+            this->put("    return (", byte, " >> (i & 7)) & 1;\n}\n");
+            this->put("static inline void ", fn, "_set(", name, "* ", this->ptr, ", size_t i, bool v) {\n");
+            this->put("    if (v) ", byte, " |= (uint8_t)(1u << (i & 7)); else ", byte, " &= (uint8_t)~(1u << (i & 7));\n}\n");
+        }
+    }
+    for (const Table* c: t.children) {
+        this->h_bits(*c);
+    }
+}
+
+void Writer::h_functions(const Table& root) {
+    const std::string& name = root.name;
     const std::string base_name = name.substr(0, name.size()-2);
     this->out += R"(
 #ifdef __cplusplus
 extern "C" {
 #endif
 int  )";
-    this->out += base_name+"_read(const char* file, " + name + "** "+this->o_var+");\n";
-    this->out += "void "+ base_name+ "_print(const " + name+"* "+this->o_var+");\n";
-    this->out += "void "+ base_name+"_free("+ name+"* "+this->o_var+");";
+    this->put(base_name, "_read(const char* file, ", name, "** ", this->ptr, ");\n");
+    this->put("int  ", base_name, "_read_fd(int fd, ", name, "** ", this->ptr, ");\n");
+    this->put("int  ", base_name, "_read_mem(const char* buf, size_t len, ", name, "** ", this->ptr, ");\n");
+    if (this->opts.many) {
+        this->out += "/* Reads paths[i] into out[i] on up to threads threads (0: one per core).\n";
+        this->out += " * errors[i], if given, receives each file's result instead of stderr.\n";
+        this->out += " * Returns the number of files that failed. */\n";
+        this->put("int  ", base_name, "_read_many(const char** paths, size_t n, ", name, "** ", this->ptr, ", ", LIB_BASE_NAMEu, "error_t* errors, unsigned threads);\n");
+    }
+    if (this->opts.arena) {
+        this->put("int  ", base_name, "_read_arena(const char* file, ", LIB_BASE_NAMEu, "arena_t* arena, ", name, "** ", this->ptr, ");\n");
+    }
+    this->put("void ", base_name, "_print(const ", name, "* ", this->ptr, ");\n");
+    if (this->opts.write) {
+        this->out += "/* Writes the values as TOML into buf, NUL-terminated and cut at cap bytes.\n";
+        this->out += " * Returns the length of the whole text, like snprintf. */\n";
+        this->put("size_t ", base_name, "_write_toml(const ", name, "* ", this->ptr, ", char* buf, size_t cap);\n");
+        this->put("int  ", base_name, "_write_file(const ", name, "* ", this->ptr, ", const char* path);\n");
+    }
+    if (this->opts.compare) {
+        this->out += "/* Change detection. Floats compare bitwise. _diff stores the key paths of\n";
+        this->out += " * the first cap values that differ, or of an array of tables whose length\n";
+        this->out += " * differs, and returns how many there are. */\n";
+        this->put("uint64_t ", base_name, "_hash(const ", name, "* ", this->ptr, ");\n");
+        this->put("int  ", base_name, "_equal(const ", name, "* a, const ", name, "* b);\n");
+        this->put("size_t ", base_name, "_diff(const ", name, "* a, const ", name, "* b, const char** changed, size_t cap);\n");
+    }
+    if (this->opts.reflect) {
+        this->out += "/* Reflection over the fields outside arrays of tables. _find_path finds one\n";
+        this->out += " * by dotted key path, _get_path returns its member, or NULL. _set_path\n";
+        this->out += " * parses value as TOML (a string may be left unquoted) and replaces the\n";
+        this->out += " * field. */\n";
+        this->put("extern const ", LIB_BASE_NAMEu, "field_t ", base_name, "_fields[];\n");
+        this->put("extern const size_t ", base_name, "_n_fields;\n");
+        this->put("const ", LIB_BASE_NAMEu, "field_t* ", base_name, "_find_path(const char* path);\n");
+        this->put("const void* ", base_name, "_get_path(const ", name, "* ", this->ptr, ", const char* path, const ", LIB_BASE_NAMEu, "field_t** field);\n");
+        this->put("int  ", base_name, "_set_path(", name, "* ", this->ptr, ", const char* path, const char* value);\n");
+    }
+    this->put("void ", base_name, "_free(", name, "* ", this->ptr, ");");
+    this->put("\n\n#ifdef ", mvar(LIB_BASE_NAMEu), "STATS\n");
+    this->out += "/* Stats of this thread's last read, and a callback run after every read */\n";
+    this->put("const ", LIB_BASE_NAMEu, "stats_t* ", base_name, "_stats(void);\n");
+    this->put("void ", base_name, "_stats_callback(", LIB_BASE_NAMEu, "stats_fn fn, void* ctx);\n");
+    this->out += "#endif";
+    if (this->opts.stream) {
+        this->out += "\n\n/* Streaming. _stream reads the file in chunks of T2C_STREAM_CHUNK bytes and\n";
+        this->out += " * calls back with each value as soon as it is read: arrays in runs of\n";
+        this->out += " * elements starting at index first, strings one at a time, and each entry\n";
+        this->out += " * of an array of tables once it is complete. The values are only valid\n";
+        this->out += " * during the call. NULL callbacks are skipped. A callback that returns\n";
+        this->out += " * nonzero stops the stream, and _stream returns that value. */\n";
+        this->out += "typedef struct {\n";
+        std::function<void(const Table&)> callbacks_r;
+        callbacks_r = [&] (const Table& t)->void {
+            if (t.array) {
+                this->put("    int (*", callback_name(t, nullptr), ")(void* ctx, size_t i, const struct ", base_name, t.path.substr(4), "* entry);");
+                this->put(" /* [[", cstr(key_path(*t.parent, t.name)), "]] */\n");
+                return;
+            }
+            for (const Field& f: t.fields) {
+                std::string params;
+                switch (f.type) {
+                    case Field::Type::t_int: params = "int64_t v"; break;
+                    case Field::Type::t_double: params = "double v"; break;
+                    case Field::Type::t_bool: params = "bool v"; break;
+                    case Field::Type::t_string: params = "const char* v, size_t len"; break;
+                    case Field::Type::t_enum: params = this->enum_type(t, f) + " v"; break;
+                    case Field::Type::t_array_of_int: params = "size_t first, const int64_t* v, size_t n"; break;
+                    case Field::Type::t_array_of_double: params = "size_t first, const double* v, size_t n"; break;
+                    case Field::Type::t_array_of_bool: params = "size_t first, const bool* v, size_t n"; break;
+                    case Field::Type::t_array_of_string: params = "size_t i, const char* v, size_t len"; break;
+                    default: continue;
+                }
+                this->put("    int (*", callback_name(t, &f), ")(void* ctx, ", params, "); /* ", cstr(key_path(t, f.key)), " */\n");
+            }
+            for (const Table* c: t.children) {
+                callbacks_r(*c);
+            }
+        };
+        callbacks_r(root);
+        this->put("} ", base_name, "_callbacks_t;\n");
+        this->put("int  ", base_name, "_stream(const char* file, const ", base_name, "_callbacks_t* cb, void* ctx);");
+    }
+    if (this->opts.lazy) {
+        // Accessors are named after the table, like the bool getters
+        this->out += "\n\n/* Lazy reading. _open parses the file and loads only the root's own keys.\n";
+        this->out += " * A table is loaded the first time its accessor is called, which then\n";
+        this->out += " * returns the struct, or NULL if the table is missing or invalid. One\n";
+        this->out += " * thread at a time. */\n";
+        this->put("typedef struct ", base_name, "_lazy ", base_name, "_lazy_t;\n");
+        this->put(base_name, "_lazy_t* ", base_name, "_open(const char* file);\n");
+        this->put("const ", name, "* ", base_name, "_root(", base_name, "_lazy_t* lazy);\n");
+        std::function<void(const Table&)> access_r;
+        access_r = [&] (const Table& t)->void {
+            if (t.parent) {
+                this->put("const ", name, "* ", base_name, t.path.substr(4), "(", base_name, "_lazy_t* lazy);");
+                this->put(" /* ", t.array ? "[[" : "[", cstr(key_path(*t.parent, t.name)), t.array ? "]]" : "]", " */\n");
+            }
+            for (const Table* c: t.children) {
+                access_r(*c);
+            }
+        };
+        access_r(root);
+        this->put("void ", base_name, "_close(", base_name, "_lazy_t* lazy);");
+    }
+    if (this->opts.embed) {
+        this->put("\n\n/* Values of the sample file, read-only */\n");
+        this->put("extern const ", name, " ", base_name, "_default;");
+    }
+    if (this->opts.handle) {
+        const std::string handle_t = base_name+"_handle_t";
+        this->put("\n\ntypedef struct ", base_name, "_handle ", handle_t, ";\n");
+        this->put(handle_t, "* ", base_name, "_handle_new(const char* file);\n");
+        this->put("void ", base_name, "_handle_free(", handle_t, "* h);\n");
+        this->put("int  ", base_name, "_reload(", handle_t, "* h, const char* file);\n");
+        this->put("/* A thread holds one of ", mvar(LIB_BASE_NAMEu), "MAX_READERS slots from its first acquire until it exits */\n");
+        this->put("const ", name, "* ", base_name, "_acquire(", handle_t, "* h);\n");
+        this->put("void ", base_name, "_release(", handle_t, "* h);");
+    }
+    if (this->opts.bin) {
+        this->put("\nint  ", base_name, "_save_bin(const ", name, "* ", this->ptr, ", const char* path);\n");
+        this->put("int  ", base_name, "_load_bin(const char* path, ", name, "** ", this->ptr, ");\n");
+        this->put("void ", base_name, "_unload_bin(", name, "* ", this->ptr, ");");
+    }
     this->out += R"(
 #ifdef __cplusplus
 }
@@ -308,319 +1484,7235 @@ void Writer::h_finalize() {
     header.close();
 }
 
-void Writer::c_src(const Table& root) {
-    const std::string& name = root.name;
-    const std::string base_name = name.substr(0, name.size()-2);
-    this->out += "#include \"" + LIB_BASE_NAMEh + this->o_name; 
-    this->out += R"(.h"
-#include <stdlib.h>
-#include <toml.h>
+// Schema independent part of the --cpp header, shared by the headers of all
+// schemas. Emitted verbatim inside the runtime's namespace.
+static const char* cpp_runtime = R"rt(/* span<T>: std::span under C++20, else a read-only stand-in */
+#ifdef __cpp_lib_span
+template <class T>
+using span = std::span<T>;
+#else
+template <class T>
+class span {
+public:
+    using element_type = T;
+    using value_type = std::remove_cv_t<T>;
+    using iterator = T*;
 
-int )";
-    this->out += base_name + "_read(const char* file_path, "+name+"** "+this->o_var+") {";
-    this->out += R"(
-    FILE* fp;
-    toml_table_t* root;
-    char errbuf[200];
+    constexpr span() noexcept = default;
+    constexpr span(T* data, std::size_t size) noexcept : data_(data), size_(size) {}
 
-    if (*)";
-    this->out += this->o_var + " == NULL) {\n";
-    this->out += "        *"+this->o_var+" = calloc(1, sizeof("+name+"));\n";
-    this->out += "    }\n";
-    
-    this->out += R"(
-    /* Open the file. */
-    if (0 == (fp = fopen(file_path, "r"))) {
-        fprintf(stderr, ")";
-    this->out += base_name;
-    this->out += R"(_read() failed: couldn't open %s", file_path);
-        return 1;
+    constexpr T* data() const noexcept { return data_; }
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr T* begin() const noexcept { return data_; }
+    constexpr T* end() const noexcept { return data_ + size_; }
+    constexpr T& operator[](std::size_t i) const noexcept { return data_[i]; }
+    constexpr T& front() const noexcept { return data_[0]; }
+    constexpr T& back() const noexcept { return data_[size_ - 1]; }
+
+private:
+    T* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+#endif
+
+/* One field of the table type T: its key, its dotted key path, the key as
+ * written in TOML (for a table, its header), and its member */
+template <class T, class M>
+struct field {
+    using table_type = T;
+    using value_type = M;
+    std::string_view key;
+    std::string_view path;
+    std::string_view toml;
+    M T::* member;
+};
+
+template <class T, class M>
+constexpr field<T, M> make_field(std::string_view key, std::string_view path, std::string_view toml, M T::* member) {
+    return { key, path, toml, member };
+}
+
+/* Specialized for each table type: fields, a tuple of field in the order of
+ * the struct */
+template <class T>
+struct schema {};
+
+/* Specialized for each enum: names, indexed by value */
+template <class E>
+struct enum_names {};
+
+template <class T, class = void>
+struct is_table : std::false_type {};
+template <class T>
+struct is_table<T, std::void_t<decltype(schema<T>::fields)>> : std::true_type {};
+
+template <class T>
+struct is_span : std::false_type {};
+template <class T>
+struct is_span<span<T>> : std::true_type {};
+
+/* The entries of an array of tables */
+template <class T>
+struct is_entries : std::false_type {};
+template <class T>
+struct is_entries<span<const T>> : is_table<T> {};
+
+/* Calls fn(field, value) for each field of the table v, unrolled at compile
+ * time */
+template <class T, class F>
+constexpr void visit(const T& v, F&& fn) {
+    std::apply([&] (const auto&... f) { (fn(f, v.*(f.member)), ...); }, schema<T>::fields);
+}
+
+/* Whether a and b hold the same values. Floats compare bitwise, and a
+ * missing string differs from an empty one. */
+template <class T>
+bool equal(const T& a, const T& b) {
+    if constexpr (is_table<T>::value) {
+        return std::apply([&] (const auto&... f) { return (equal(a.*(f.member), b.*(f.member)) && ...); }, schema<T>::fields);
+    } else if constexpr (is_span<T>::value) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (std::size_t i = 0; i < a.size(); ++i) {
+            if (!equal(a[i], b[i])) {
+                return false;
+            }
+        }
+        return true;
+    } else if constexpr (std::is_same_v<T, std::string_view>) {
+        return a == b && !a.data() == !b.data();
+    } else if constexpr (std::is_floating_point_v<T>) {
+        return std::memcmp(&a, &b, sizeof(T)) == 0;
+    } else {
+        return a == b;
     }
+}
 
-    /* Run the file through the parser. */
-    root = toml_parse_file(fp, errbuf, sizeof(errbuf));
-    if (0 == root) {
-        fprintf(stderr, ")";
-    this->out += base_name;
-    this->out += R"(_read() failed: error while parsing %s", file_path);
-        return 1;
+namespace detail {
+
+inline std::uint64_t hash_bytes(std::uint64_t h, const void* p, std::size_t n) {
+    const unsigned char* s = static_cast<const unsigned char*>(p);
+    for (std::size_t i = 0; i < n; ++i) {
+        h = (h ^ s[i]) * 1099511628211ull;
     }
-    fclose(fp);
-    // Tables 
-    toml_table_t )";
-
-    // Tables
-    std::function<std::string(const Table& t, std::string path)> get_path;
-    get_path = [&get_path](const Table& t, std::string path)->std::string {
-        if (t.parent) {
-            if (t.parent->depth != 0) {
-                path = t.parent->name + "_" + path;
-            } else {
-                path = "root_" + path;
+    return h;
+}
+
+}
+
+/* A 64-bit hash of every value of v, consistent with equal() */
+template <class T>
+std::uint64_t hash(const T& v, std::uint64_t h = 14695981039346656037ull) {
+    if constexpr (is_table<T>::value) {
+        std::apply([&] (const auto&... f) { ((h = hash(v.*(f.member), h)), ...); }, schema<T>::fields);
+        return h;
+    } else if constexpr (is_span<T>::value) {
+        const std::size_t n = v.size();
+        h = detail::hash_bytes(h, &n, sizeof(n));
+        for (const auto& e: v) {
+            h = hash(e, h);
+        }
+        return h;
+    } else if constexpr (std::is_same_v<T, std::string_view>) {
+        const std::size_t n = v.data() ? v.size() : SIZE_MAX;
+        h = detail::hash_bytes(h, &n, sizeof(n));
+        return detail::hash_bytes(h, v.data(), v.size());
+    } else {
+        return detail::hash_bytes(h, &v, sizeof(T));
+    }
+}
+
+namespace detail {
+
+template <class Out>
+void put(Out& out, std::string_view s) {
+    out.append(s.data(), s.size());
+}
+
+/* A value as written in TOML, as by the C writer */
+template <class Out, class T>
+void toml_value(Out& out, const T& v) {
+    if constexpr (is_span<T>::value) {
+        put(out, "[");
+        for (std::size_t i = 0; i < v.size(); ++i) {
+            put(out, i ? ", " : "");
+            toml_value(out, v[i]);
+        }
+        put(out, "]");
+    } else if constexpr (std::is_same_v<T, bool>) {
+        put(out, v ? "true" : "false");
+    } else if constexpr (std::is_enum_v<T>) {
+        const auto& names = enum_names<T>::names;
+        const std::size_t i = static_cast<std::size_t>(v);
+        toml_value(out, i < std::size(names) ? names[i] : std::string_view(""));
+    } else if constexpr (std::is_integral_v<T>) {
+        char tmp[24];
+        put(out, std::string_view(tmp, std::to_chars(tmp, tmp + sizeof(tmp), v).ptr - tmp));
+    } else if constexpr (std::is_floating_point_v<T>) {
+        /* The shortest text that reads back, as tw_double writes it */
+        char tmp[40];
+        char* end;
+        if (std::isnan(v)) {
+            put(out, "nan");
+            return;
+        }
+        if (std::isinf(v)) {
+            put(out, v < 0 ? "-inf" : "inf");
+            return;
+        }
+        end = std::to_chars(tmp, tmp + sizeof(tmp) - 2, static_cast<double>(v)).ptr;
+        if (!std::memchr(tmp, '.', end - tmp) && !std::memchr(tmp, 'e', end - tmp)) {
+            *end++ = '.';
+            *end++ = '0';
+        }
+        put(out, std::string_view(tmp, end - tmp));
+    } else {
+        /* A TOML basic string */
+        static const char hex[] = "0123456789abcdef";
+        std::size_t run = 0;
+        put(out, "\"");
+        for (std::size_t i = 0; i < v.size(); ++i) {
+            const unsigned char c = static_cast<unsigned char>(v[i]);
+            char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+            std::size_t n = 6;
+            if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7f) {
+                continue;
+            }
+            put(out, v.substr(run, i - run));
+            run = i + 1;
+            switch (c) {
+                case '"': case '\\': esc[1] = static_cast<char>(c); n = 2; break;
+                case '\b': esc[1] = 'b'; n = 2; break;
+                case '\t': esc[1] = 't'; n = 2; break;
+                case '\n': esc[1] = 'n'; n = 2; break;
+                case '\f': esc[1] = 'f'; n = 2; break;
+                case '\r': esc[1] = 'r'; n = 2; break;
+            }
+            put(out, std::string_view(esc, n));
+        }
+        put(out, v.substr(run));
+        put(out, "\"");
+    }
+}
+
+/* The keys of the table v, then a [header] per table below it, and a
+ * [[header]] per entry of an array of tables. Missing strings are left out. */
+template <class Out, class T>
+void toml_table(Out& out, const T& v) {
+    visit(v, [&] (const auto& f, const auto& x) {
+        using M = std::decay_t<decltype(x)>;
+        if constexpr (!is_table<M>::value && !is_entries<M>::value) {
+            if constexpr (std::is_same_v<M, std::string_view>) {
+                if (!x.data()) {
+                    return;
+                }
             }
-            return (get_path(*t.parent, path));
+            put(out, f.toml);
+            put(out, " = ");
+            toml_value(out, x);
+            put(out, "\n");
+        }
+    });
+    visit(v, [&] (const auto& f, const auto& x) {
+        using M = std::decay_t<decltype(x)>;
+        if constexpr (is_table<M>::value) {
+            put(out, "\n[");
+            put(out, f.toml);
+            put(out, "]\n");
+            toml_table(out, x);
+        } else if constexpr (is_entries<M>::value) {
+            for (const auto& e: x) {
+                put(out, "\n[[");
+                put(out, f.toml);
+                put(out, "]]\n");
+                toml_table(out, e);
+            }
+        }
+    });
+}
+
+}
+
+/* Appends the values of v, a root table, as TOML to out, a std::string or
+ * anything with append(const char*, size_t). The text is the one the C
+ * _write_toml() writes. */
+template <class T, class Out>
+void write_toml(const T& v, Out& out) {
+    detail::toml_table(out, v);
+}
+
+namespace detail {
+
+/* Places values one after the other in a buffer. With no buffer it only
+ * adds up the bytes they need. */
+struct bump {
+    std::byte* base;
+    std::size_t used;
+
+    template <class T>
+    T* take(std::size_t n) {
+        used = (used + alignof(T) - 1) / alignof(T) * alignof(T);
+        T* p = base ? reinterpret_cast<T*>(base + used) : nullptr;
+        used += n * sizeof(T);
+        return p;
+    }
+};
+
+template <class T>
+span<const T> view(const T* p, std::size_t n) {
+    return p ? span<const T>(p, n) : span<const T>();
+}
+
+/* A copy of s, NUL-terminated, or a missing string */
+inline std::string_view str(bump& b, const char* s) {
+    if (!s) {
+        return {};
+    }
+    const std::size_t n = std::strlen(s);
+    char* p = b.take<char>(n + 1);
+    if (!p) {
+        return { s, n };
+    }
+    std::memcpy(p, s, n + 1);
+    return { p, n };
+}
+
+template <class T>
+span<const T> copy(bump& b, const T* v, std::size_t n) {
+    T* p = b.take<T>(n);
+    if (p && n) {
+        std::memcpy(p, v, n * sizeof(T));
+    }
+    return view<T>(p, n);
+}
+
+inline span<const std::string_view> strs(bump& b, char* const* v, std::size_t n) {
+    std::string_view* p = b.take<std::string_view>(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        const std::string_view s = str(b, v[i]);
+        if (p) {
+            ::new (static_cast<void*>(p + i)) std::string_view(s);
+        }
+    }
+    return view<std::string_view>(p, n);
+}
+
+}
+)rt";
+
+// t2c-FILE.hpp: the values as C++17 types, strings as std::string_view and
+// arrays as spans into one buffer owned by a config object, which reads
+// through the C library. Each table type has a constexpr schema<T> listing its
+// fields, over which the runtime's equal(), hash() and write_toml() unroll.
+void Writer::h_cpp(const Table& root) {
+    const std::string& name = root.name;
+    const std::string ns = lib_base_name.size() ? std::string(lib_base_name) : "t2c";
+    const std::string space = ns + "::" + this->o_var;
+    const std::string guard = mvar(LIB_BASE_NAMEu) + "HPP_RUNTIME";
+    const std::vector<const Table*> tables = schema_tables(root);
+
+    this->out += this->stamp;
+    this->out += "#pragma once\n";
+    this->put("/* C++17 view of ", LIB_BASE_NAMEh, this->o_name, ".h. Link with ", LIB_BASE_NAMEh, this->o_name, ".c, which reads the files. */\n");
+    this->put("#include \"", LIB_BASE_NAMEh, this->o_name, ".h\"\n");
+    this->out += R"(#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+)";
+    this->put("#ifndef ", guard, "\n#define ", guard, "\nnamespace ", ns, " {\n\n");
+    this->out += cpp_runtime;
+    this->put("\n}\n#endif\n\n");
+
+    // Members of t: its fields, then its tables and arrays of tables
+    auto value_type = [&] (const Table& t, const Field& f) -> std::string {
+        switch (f.type) {
+            case Field::Type::t_int: return "std::int64_t";
+            case Field::Type::t_double: return "double";
+            case Field::Type::t_bool: return "bool";
+            case Field::Type::t_string: return "std::string_view";
+            case Field::Type::t_enum: return "::" + this->enum_type(t, f);
+            case Field::Type::t_array_of_int: return "span<const std::int64_t>";
+            case Field::Type::t_array_of_double: return "span<const double>";
+            case Field::Type::t_array_of_bool: return "span<const bool>";
+            case Field::Type::t_array_of_string: return "span<const std::string_view>";
+            default: return "";
         }
-        return cvar(path);
     };
-    std::function<std::string(const Table& t, std::string path)> get_parent_path;
-    get_parent_path = [&get_parent_path](const Table& t, std::string path)->std::string {
-        if (t.parent) {
-            if (t.parent->depth != 0) {
-                path = t.parent->name + (path.size()? "_" + path : "");
-            } else {
-                path = "root" + (path.size()? "_" + path : "");
+    this->put("namespace ", space, " {\n");
+    // Children first, so each type is complete where it is a member
+    std::function<void(const Table&)> types_r;
+    types_r = [&] (const Table& t)->void {
+        for (const Table* c: t.children) {
+            types_r(*c);
+        }
+        this->put("\n/* ", t.parent ? (t.array ? "[[" : "[") + cstr(key_path(*t.parent, t.name)) + (t.array ? "]]" : "]") : this->o_name + ".toml", " */\n");
+        this->put("struct ", cpp_type(t), " {\n");
+        for (const Field& f: t.fields) {
+            const std::string type = value_type(t, f);
+            if (!type.empty()) {
+                this->put("    ", type, " ", f.name, ";\n");
             }
-            return (get_parent_path(*t.parent, path));
         }
-        return cvar(path);
+        for (const Table* c: t.children) {
+            this->put("    ", c->array ? "span<const " + cpp_type(*c) + ">" : cpp_type(*c), " ", cvar(c->name), ";\n");
+        }
+        this->out += "};\n";
     };
+    types_r(root);
+    this->out += "\n}\n\n";
+
+    this->put("namespace ", ns, " {\n");
+    for (const Table* tp: tables) {
+        const Table& t = *tp;
+        const std::string type = this->o_var + "::" + cpp_type(t);
+        this->put("\ntemplate <>\nstruct schema<", type, "> {\n");
+        this->out += "    static constexpr auto fields = std::make_tuple(";
+        const char* sep = "\n";
+        for (const Field& f: t.fields) {
+            if (value_type(t, f).empty()) {
+                continue;
+            }
+            this->put(sep, "        make_field(", c_string(f.key), ", ", c_string(key_path(t, f.key)), ", ");
+            this->put(c_string(toml_key(f.key)), ", &", type, "::", f.name, ")");
+            sep = ",\n";
+        }
+        for (const Table* c: t.children) {
+            std::string header;
+            for (const Table* p = c; p->parent; p = p->parent) {
+                header = toml_key(p->name) + (header.empty() ? "" : ".") + header;
+            }
+            this->put(sep, "        make_field(", c_string(c->name), ", ", c_string(key_path(t, c->name)), ", ");
+            this->put(c_string(header), ", &", type, "::", cvar(c->name), ")");
+            sep = ",\n";
+        }
+        this->out += ");\n};\n";
+        for (const Field& f: t.fields) {
+            if (f.type != Field::Type::t_enum) {
+                continue;
+            }
+            this->put("\ntemplate <>\nstruct enum_names<::", this->enum_type(t, f), "> {\n");
+            this->out += "    static constexpr std::string_view names[] = {";
+            for (const std::string& v: f.values) {
+                this->put(&v == &f.values[0] ? " " : ", ", c_string(v));
+            }
+            this->out += " };\n};\n";
+        }
+    }
+    this->out += "\n}\n\n";
+
+    this->put("namespace ", space, " {\n");
+    for (const Table* tp: tables) {
+        const std::string type = cpp_type(*tp);
+        this->put("\ninline bool operator==(const ", type, "& a, const ", type, "& b) { return ", ns, "::equal(a, b); }\n");
+        this->put("inline bool operator!=(const ", type, "& a, const ", type, "& b) { return !", ns, "::equal(a, b); }\n");
+    }
+
+    this->out += R"(
+/* The values of one )" + this->o_name + R"(.toml file. Its strings, arrays and entries live in a
+ * single buffer from the memory resource of the allocator, which the views
+ * in root_t point into. Moving keeps them valid; copying is not possible. */
+class config {
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+    config() noexcept = default;
+    explicit config(const allocator_type& alloc) noexcept : mr_(alloc.resource()) {}
+    config(config&& o) noexcept
+        : mr_(o.mr_), buf_(std::exchange(o.buf_, nullptr)), size_(std::exchange(o.size_, 0)), root_(std::exchange(o.root_, root_t{})) {}
+    config& operator=(config&& o) noexcept {
+        if (this != &o) {
+            release();
+            mr_ = o.mr_;
+            buf_ = std::exchange(o.buf_, nullptr);
+            size_ = std::exchange(o.size_, 0);
+            root_ = std::exchange(o.root_, root_t{});
+        }
+        return *this;
+    }
+    config(const config&) = delete;
+    config& operator=(const config&) = delete;
+    ~config() { release(); }
+
+    /* Read with the C library and copy the values into the buffer. Return
+     * what )" + this->base_name + R"(_read() returns; on failure the values are kept. */
+    int read(const char* file) {
+        )" + name + R"(* c = nullptr;
+        const int rc = )" + this->base_name + R"(_read(file, &c);
+        return adopt(rc, c);
+    }
+    int read_fd(int fd) {
+        )" + name + R"(* c = nullptr;
+        const int rc = )" + this->base_name + R"(_read_fd(fd, &c);
+        return adopt(rc, c);
+    }
+    int read_mem(const char* buf, std::size_t len) {
+        )" + name + R"(* c = nullptr;
+        const int rc = )" + this->base_name + R"(_read_mem(buf, len, &c);
+        return adopt(rc, c);
+    }
+    /* Copies the values of a C struct into the buffer */
+    void assign(const )" + name + R"(& c) {
+        detail::bump size = { nullptr, 0 };
+        root_t root{};
+        load(size, root, &c);
+        std::byte* buf = size.used ? static_cast<std::byte*>(mr_->allocate(size.used, alignof(std::max_align_t))) : nullptr;
+        detail::bump fill = { buf, 0 };
+        load(fill, root, &c);
+        release();
+        buf_ = buf;
+        size_ = size.used;
+        root_ = root;
+    }
+
+    const root_t& get() const noexcept { return root_; }
+    const root_t& operator*() const noexcept { return root_; }
+    const root_t* operator->() const noexcept { return &root_; }
+    /* Bytes of the buffer */
+    std::size_t size() const noexcept { return size_; }
+    allocator_type get_allocator() const noexcept { return mr_; }
 
-    std::function<std::string(const Table& t, std::string path)> get_path_var;
-    get_path_var = [&get_path_var](const Table& t, std::string path)->std::string {
-        if (t.parent) {
-            path = t.name + "." + path;
-            return (get_path_var(*t.parent, path));
+private:
+    int adopt(int rc, )" + name + R"(* c) {
+        struct guard {
+            )" + name + R"(* c;
+            ~guard() { )" + this->base_name + R"(_free(c); }
+        } g = { c };
+        if (rc == 0) {
+            assign(*c);
+        }
+        return rc;
+    }
+    void release() noexcept {
+        if (buf_) {
+            mr_->deallocate(buf_, size_, alignof(std::max_align_t));
+        }
+        buf_ = nullptr;
+        size_ = 0;
+        root_ = root_t{};
+    }
+    static void load(detail::bump& b, root_t& o, const )" + name + R"(* c);
+
+    std::pmr::memory_resource* mr_ = std::pmr::get_default_resource();
+    std::byte* buf_ = nullptr;
+    std::size_t size_ = 0;
+    root_t root_{};
+};
+
+/* Sizes the buffer when b has none, fills it otherwise */
+inline void config::load(detail::bump& b, root_t& o, const )" + name + R"(* c) {
+)";
+    // dst = the value of f of t in the C struct c, entry i
+    auto store = [&] (const Table& t, const Field& f, const std::string& dst) {
+        const std::string src = this->member("c", t, f, "i");
+        const std::string len = this->member("c", t, f, "i", "_len");
+        switch (f.type) {
+            case Field::Type::t_int:
+            case Field::Type::t_double:
+            case Field::Type::t_enum:
+                this->put("    ", dst, " = ", src, ";\n");
+                break;
+            case Field::Type::t_bool:
+                this->put("    ", dst, " = ", f.packed ? this->bit("c", t, f) : src, ";\n");
+                break;
+            case Field::Type::t_string:
+                this->put("    ", dst, " = detail::str(b, ", src, ");\n");
+                break;
+            case Field::Type::t_array_of_int:
+            case Field::Type::t_array_of_double:
+                this->put("    ", dst, " = detail::copy(b, ", src, ", ", len, ");\n");
+                break;
+            case Field::Type::t_array_of_bool:
+                if (!f.packed) {
+                    this->put("    ", dst, " = detail::copy(b, ", src, ", ", len, ");\n");
+                    break;
+                }
+                this->put("    {\n        bool* p = b.take<bool>(", len, ");\n");
+                this->put("        for (std::size_t j = 0; p && j < ", len, "; ++j) {\n");
+                this->put("            p[j] = ", this->base_name, t.path.substr(4), "_", f.name, "(c, j);\n");
+                this->put("        }\n        ", dst, " = detail::view(p, ", len, ");\n    }\n");
+                break;
+            case Field::Type::t_array_of_string:
+                this->put("    ", dst, " = detail::strs(b, ", src, ", ", len, ");\n");
+                break;
+            default:
+                break;
+        }
+    };
+    std::function<void(const Table&)> load_r;
+    load_r = [&] (const Table& t)->void {
+        if (t.array) {
+            const std::string type = cpp_type(t);
+            this->put("    {\n        const std::size_t n = ", this->count("c", t), ";\n");
+            this->put("        ", type, "* e = b.take<", type, ">(n);\n");
+            this->out += "        for (std::size_t i = 0; i < n; ++i) {\n";
+            this->put("            ", type, " d{};\n");
+            const size_t body = this->out.size();
+            for (const Field& f: t.fields) {
+                store(t, f, "d." + f.name);
+            }
+            this->indent_since(body);
+            this->indent_since(body);
+            this->out += "            if (e) {\n";
+            this->put("                ::new (static_cast<void*>(e + i)) ", type, "(d);\n");
+            this->out += "            }\n        }\n";
+            this->put("        o.", t.var.substr(0, t.var.size()-1), " = detail::view(e, n);\n    }\n");
+            return;
+        }
+        for (const Field& f: t.fields) {
+            store(t, f, "o." + t.var + f.name);
+        }
+        for (const Table* c: t.children) {
+            load_r(*c);
         }
-        return cvar(path);
     };
+    load_r(root);
+    this->out += "}\n\n}\n";
+
+    std::ofstream(LIB_BASE_NAMEh + this->o_name + ".hpp") << this->out;
+}
+
+// Declares and locates every table below root. Arrays of tables may be
+// missing; each gets root_x_arr and its entry count root_x_n.
+void Writer::c_tables(const Table& root) {
+    const std::string base_name = root.name.substr(0, root.name.size()-2);
 
     std::function<void(const Table&)> decl_r;
     decl_r = [&] (const Table& t)->void {
-        this->out += "*" + get_path(t, t.name) + ", ";
+        this->put("*", t.path, ", ");
         for (const Table* c: t.children) {
             decl_r(*c);
         }
     };
-    for (const Table* c: root.children) {
-        decl_r(*c);
-    }
-    *(this->out.end()-2) = ';';
-    
-    this->out += "\n";
 
     std::function<void(const Table&)> check_r;
     check_r = [&] (const Table& t)->void {
-        this->out += "    if (!("+get_path(t,t.name)+" = toml_table_in("+get_parent_path(t,"")+", \""+tvar(t.name)+"\"))) {\n\
-        fprintf(stderr, \""+ base_name+"_read() failed: failed locating ["+t.name+"] table\");\n\
+        if (t.array) {
+            this->put("    toml_array_t* ", t.path, "_arr = toml_array_in(", t.parent->path, ", \"", cstr(t.name), "\");\n");
+            this->put("    const int ", t.path, "_n = ", t.path, "_arr ? toml_array_nelem(", t.path, "_arr) : 0;\n");
+            return;
+        }
+        this->out += "    if (!("+t.path+" = toml_table_in("+t.parent->path+", \""+cstr(t.name)+"\"))) {\n\
+        "+ base_name+"_error(\""+ base_name+"_read() failed: failed locating ["+cstr(t.name)+"] table\");\n\
         return 1;\n    }\n";
         for (const Table* c: t.children) {
             check_r(*c);
         }
     };
+
+    this->out += "    // Tables \n";
+    if (root.children.empty()) {
+        return;
+    }
+    this->out += "    toml_table_t ";
+    for (const Table* c: root.children) {
+        decl_r(*c);
+    }
+    *(this->out.end()-2) = ';';
+
+    this->out += "\n";
     for (const Table* c: root.children) {
         check_r(*c);
     }
+}
+
+void Writer::c_read(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+    const std::string obj = "(*" + this->ptr + ")";
+
+    this->put("static int ", base_name, "_load(toml_table_t* root, ", name, "** ", this->ptr, ") {\n");
+    this->put("    if (*", this->ptr, " == NULL) {\n");
+    this->put("        *", this->ptr, " = calloc(1, sizeof(", name, "));\n");
+    this->out += "    } else {\n";
+    this->put("        ", base_name, "_clear(*", this->ptr, ");\n");
+    this->out += "    }\n";
+    if (!this->opts.cold.empty()) {
+        this->put("    if (0 == (", obj, "->", LIB_BASE_NAMEu, "cold = calloc(1, sizeof(", base_name, "_cold_t)))) {\n");
+        this->put("        ", base_name, "_error(\"", base_name, ": out of memory\");\n");
+        this->out += "        return 1;\n    }\n";
+    }
+    this->out += "\n";
+    this->c_tables(root);
 
     // Fields
-    this->out += "\n    toml_datum_t datum;\n    toml_array_t* arr;\n";
-    std::function<void(const Table&)> read_r;
-    read_r = [&] (const Table& t)->void {
+    this->out += "\n    toml_datum_t datum;\n    toml_array_t* arr;\n    int n;\n";
+    // The fields of t, or every entry of an array of tables
+    auto fill = [&] (const Table& t) {
+        const std::string index = t.path + "_i";
+        size_t body = 0;
+        if (t.array) {
+            // Entries are zeroed, so keys an entry lacks read as 0
+            const std::string n = t.path + "_n";
+            if (this->opts.soa) {
+                for (const Field& f: t.fields) {
+                    const std::string col = obj + "->" + t.var + f.name;
+                    this->put("    ", col, " = calloc(", n, ", sizeof(*", col, "));\n");
+                    if (f.type >= Field::Type::t_array) {
+                        this->put("    ", col, "_len = calloc(", n, ", sizeof(*", col, "_len));\n");
+                    }
+                }
+            } else {
+                const std::string block = obj + "->" + t.var.substr(0, t.var.size()-1);
+                this->put("    ", block, " = calloc(", n, ", sizeof(*", block, "));\n");
+            }
+            this->put("    ", this->count(obj, t), " = ", n, ";\n");
+            this->put("    for (int ", index, " = 0; ", index, " < ", n, "; ++", index, ") {\n");
+            body = this->out.size();
+            this->put("    ", t.path, " = toml_table_at(", t.path, "_arr, ", index, ");\n");
+        }
         for (const Field& f: t.fields) {
+            const std::string dst = this->member(obj, t, f, index);
+            std::string at;
+            std::string el;
+            std::string mem;
             switch (f.type) {
                 case Field::Type::t_int:
-                    this->out += "    datum = toml_int_in("+get_path(t,t.name)+", \""+tvar(f.name)+"\");\n";
-                    this->out += "    (*"+this->o_var+")->"+get_path_var(t, f.name)+" = datum.u.i;\n";
+                    this->put("    datum = toml_int_in(", t.path, ", \"", cstr(f.key), "\");\n");
+                    this->put("    ", dst, " = datum.u.i;\n");
                     break;
                 case Field::Type::t_double:
-                    this->out += "    datum = toml_double_in("+get_path(t,t.name)+", \""+tvar(f.name)+"\");\n";
-                    this->out += "    (*"+this->o_var+")->"+get_path_var(t, f.name)+" = datum.u.d;\n";
+                    this->put("    datum = toml_double_in(", t.path, ", \"", cstr(f.key), "\");\n");
+                    this->put("    ", dst, " = datum.u.d;\n");
                     break;
                 case Field::Type::t_bool:
-                    this->out += "    datum = toml_bool_in("+get_path(t,t.name)+", \""+tvar(f.name)+"\");\n";
-                    this->out += "    (*"+this->o_var+")->"+get_path_var(t, f.name)+" = datum.u.b;\n";
+                    this->put("    datum = toml_bool_in(", t.path, ", \"", cstr(f.key), "\");\n");
+                    if (f.packed) {
+                        this->put("    ", this->bit(obj, t, f, "datum.u.b"), ";\n");
+                    } else {
+                        this->put("    ", dst, " = datum.u.b;\n");
+                    }
                     break;
                 case Field::Type::t_string:
-                    this->out += "    datum = toml_string_in("+get_path(t,t.name)+", \""+tvar(f.name)+"\");\n";
-                    this->out += "    (*"+this->o_var+")->"+get_path_var(t, f.name)+" = datum.u.s;\n";
+                    this->put("    datum = toml_string_in(", t.path, ", \"", cstr(f.key), "\");\n");
+                    if (!f.cap) {
+                        this->put("    ", dst, " = datum.u.s;\n");
+                        break;
+                    }
+                    this->out += "    if (datum.ok) {\n";
+                    this->out += "        n = strlen(datum.u.s) + 1;\n";
+                    this->put("        if (n > ", std::to_string(f.cap), ") {\n");
+                    this->put("            free(datum.u.s);\n            ", this->overflow(t, f), "\n");
+                    this->out += "            return 1;\n        }\n";
+                    this->put("        memcpy(", dst, ", datum.u.s, n);\n");
+                    this->out += "        free(datum.u.s);\n    }\n";
                     break;
-
-                case Field::Type::t_array_of_int:
-                    this->out += "    arr = toml_array_in("+get_path(t,t.name)+", \""+tvar(f.name)+"\");\n";
-                    this->out += "    (*"+this->o_var+")->"+get_path_var(t, f.name)+" = malloc(toml_array_nelem(arr) * sizeof(int64_t));\n";
-                    this->out += "    for (int i = 0; i < toml_array_nelem(arr); ++i) {\n        datum = toml_int_at(arr, i);\n";
-                    this->out += "        (*"+this->o_var+")->"+get_path_var(t, f.name)+"[i] = datum.u.i;\n";
-                    this->out += "    }\n";
-                    this->out += "    (*"+this->o_var+")->"+get_path_var(t, f.name)+"_len = toml_array_nelem(arr);\n";
+                case Field::Type::t_enum:
+                    this->put("    datum = toml_string_in(", t.path, ", \"", cstr(f.key), "\");\n");
+                    this->out += "    if (datum.ok) {\n";
+                    this->put("        const int e = ", this->enum_of(f, "datum.u.s"), ";\n");
+                    this->out += "        if (e < 0) {\n";
+                    this->put("            ", this->enum_unknown(t, f, "datum.u.s"), "\n");
+                    this->out += "            free(datum.u.s);\n            return 1;\n        }\n";
+                    this->put("        ", dst, " = e;\n");
+                    this->out += "        free(datum.u.s);\n    }\n";
                     break;
 
+                case Field::Type::t_array_of_int:
+                    at = "toml_int_at"; el = "int64_t"; mem = "i"; break;
                 case Field::Type::t_array_of_double:
-                    this->out += "    arr = toml_array_in("+get_path(t,t.name)+", \""+tvar(f.name)+"\");\n";
-                    this->out += "    (*"+this->o_var+")->"+get_path_var(t, f.name)+" = malloc(toml_array_nelem(arr) * sizeof(double));\n";
-                    this->out += "    for (int i = 0; i < toml_array_nelem(arr); ++i) {\n        datum = toml_double_at(arr, i);\n";
-                    this->out += "        (*"+this->o_var+")->"+get_path_var(t, f.name)+"[i] = datum.u.d;\n";
-                    this->out += "    }\n";
-                    this->out += "    (*"+this->o_var+")->"+get_path_var(t, f.name)+"_len = toml_array_nelem(arr);\n";
-                    break;
-
+                    at = "toml_double_at"; el = "double"; mem = "d"; break;
                 case Field::Type::t_array_of_bool:
-                    this->out += "    arr = toml_array_in("+get_path(t,t.name)+", \""+tvar(f.name)+"\");\n";
-                    this->out += "    (*"+this->o_var+")->"+get_path_var(t, f.name)+" = malloc(toml_array_nelem(arr) * sizeof(double));\n";
-                    this->out += "    for (int i = 0; i < toml_array_nelem(arr); ++i) {\n        datum = toml_bool_at(arr, i);\n";
-                    this->out += "        (*"+this->o_var+")->"+get_path_var(t, f.name)+"[i] = datum.u.b;\n";
-                    this->out += "    }\n";
-                    this->out +=      "(*"+this->o_var+")->"+get_path_var(t, f.name)+"_len = toml_array_nelem(arr);\n";
-                    break;
-
+                    at = "toml_bool_at"; el = "bool"; mem = "b"; break;
                 case Field::Type::t_array_of_string:
-                    this->out += "    arr = toml_array_in("+get_path(t,t.name)+", \""+tvar(f.name)+"\");\n";
-                    this->out += "    (*"+this->o_var+")->"+get_path_var(t, f.name)+" = malloc(toml_array_nelem(arr) * sizeof(char*));\n";
-                    this->out += "    for (int i = 0; i < toml_array_nelem(arr); ++i) {\n        datum = toml_string_at(arr, i);\n";
-                    this->out += "        (*"+this->o_var+")->"+get_path_var(t, f.name)+"[i] = datum.u.s;\n";
-                    this->out += "    }\n";
-                    this->out += "    (*"+this->o_var+")->"+get_path_var(t, f.name)+"_len = toml_array_nelem(arr);\n";
-                    break;
+                    at = "toml_string_at"; el = "char*"; mem = "s"; break;
 
                 default:
                     break;
             }
+            if (!at.empty()) {
+                this->out += "    STATS_START();\n";
+                this->put("    arr = toml_array_in(", t.path, ", \"", cstr(f.key), "\");\n");
+                this->out += "    n = arr ? toml_array_nelem(arr) : 0;\n";
+                if (f.cap) {
+                    this->put("    if (n > ", std::to_string(f.cap), ") {\n        ", this->overflow(t, f), "\n");
+                    this->out += "        return 1;\n    }\n";
+                } else if (f.packed) {
+                    this->put("    ", dst, " = calloc((n + 7) / 8, 1);\n");
+                } else {
+                    this->put("    ", dst, " = malloc(n * sizeof(", el, "));\n");
+                }
+                this->out += "    for (int i = 0; i < n; ++i) {\n";
+                this->put("        datum = ", at, "(arr, i);\n");
+                if (f.packed) {
+                    this->put("        ", dst, "[i >> 3] |= (uint8_t)(datum.u.b << (i & 7));\n");
+                } else {
+                    this->put("        ", dst, "[i] = datum.u.", mem, ";\n");
+                }
+                this->out += "    }\n";
+                this->put("    ", this->member(obj, t, f, index, "_len"), " = n;\n");
+                this->out += "    STATS_STOP(arrays_ns);\n";
+            }
         }
-        for (const Table* c: t.children) {
-            read_r(*c);
+        if (t.array) {
+            this->indent_since(body);
+            this->out += "    }\n";
+        }
+    };
+    std::function<void(const Table&)> read_r;
+    read_r = [&] (const Table& t)->void {
+        fill(t);
+        for (size_t i = 0; i < t.children.size(); ++i) {
+            if (!t.parent) {
+                this->put("    STATS_TABLE(", std::to_string(i), ");\n");
+            }
+            read_r(*t.children[i]);
         }
     };
     read_r(root);
+    if (!root.children.empty()) {
+        this->out += "    STATS_TABLE(-1);\n";
+    }
+    this->out += "\n    return 0;\n}\n\n";
+
+    this->put("int ", base_name, "_read(const char* file_path, ", name, "** ", this->ptr, ") {");
+    this->out += R"(
+    FILE* fp;
+    toml_table_t* root;
+    char errbuf[200];
+    int rc;
+
+    STATS_BEGIN(file_path);
+
+    /* Open the file. */
+    STATS_START();
+    fp = fopen(file_path, "r");
+    STATS_STOP(io_ns);
+    if (0 == fp) {
+        )" + base_name + R"(_error(")";
+    this->out += base_name;
+    this->out += R"(_read() failed: couldn't open %s", file_path);
+        return STATS_END(1);
+    }
+
+    /* Run the file through the parser. */
+    STATS_START();
+    root = toml_parse_file(fp, errbuf, sizeof(errbuf));
+    STATS_STOP(parse_ns);
+    fclose(fp);
+    if (0 == root) {
+        )" + base_name + R"(_error(")";
+    this->out += base_name;
+    this->out += R"(_read() failed: error while parsing %s", file_path);
+        return STATS_END(1);
+    }
+
+    STATS_START();
+    rc = )" + base_name + "_load(root, " + this->ptr + R"();
+    STATS_STOP(load_ns);
+    toml_free(root);
+    return STATS_END(rc);
+}
+
+)";
+
+    // Text already in memory, tomlc99 needs it NUL-terminated
+    this->put("static int ", base_name, "_text(const char* buf, size_t len, int terminated, ", name, "** ", this->ptr, ", const char* fn, const char* src) {");
+    this->out += R"(
+    char* text = (char*)buf;
+    toml_table_t* root;
+    char errbuf[200];
+    int rc;
+
+    if (!terminated) {
+        if (0 == (text = malloc(len + 1))) {
+            )" + base_name + R"(_error("%s() failed: out of memory", fn);
+            return 1;
+        }
+        memcpy(text, buf, len);
+        text[len] = '\0';
+    }
+    STATS_START();
+    root = toml_parse(text, errbuf, sizeof(errbuf));
+    STATS_STOP(parse_ns);
+    if (text != buf) {
+        free(text);
+    }
+    if (0 == root) {
+        )" + base_name + R"(_error("%s() failed: error while parsing %s: %s", fn, src, errbuf);
+        return 1;
+    }
+
+    STATS_START();
+    rc = )" + base_name + "_load(root, " + this->ptr + R"();
+    STATS_STOP(load_ns);
+    toml_free(root);
+    return rc;
+}
+
+)";
+    if (!this->opts.lazy) {
+        return;
+    }
+
+    // Lazy reading: one loader per table, run by the table's accessor
+    std::vector<const Table*> tables;
+    std::function<void(const Table&)> number_r;
+    number_r = [&] (const Table& t)->void {
+        tables.push_back(&t);
+        for (const Table* c: t.children) {
+            number_r(*c);
+        }
+    };
+    number_r(root);
+    const std::string lazy_t = base_name + "_lazy_t";
+
+    this->put("struct ", base_name, "_lazy {\n");
+    this->put("    ", name, " ", this->ptr, ";\n");
+    this->out += "    toml_table_t* doc;\n";
+    this->out += "    /* Per table: 0 not loaded yet, 1 loaded, -1 failed */\n";
+    this->put("    signed char loaded[", std::to_string(tables.size()), "];\n};\n\n");
+
+    for (size_t id = 0; id < tables.size(); ++id) {
+        const Table& t = *tables[id];
+        auto any = [&] (auto pred) { return std::any_of(t.fields.begin(), t.fields.end(), pred); };
+        const bool arrays = any([] (const Field& f) { return f.type >= Field::Type::t_array; });
+        const bool fixed = any([] (const Field& f) { return f.cap && f.type == Field::Type::t_string; });
+
+        // An array of tables is found through its parent
+        const std::string in = t.array ? t.parent->path : t.path;
+        this->put("static int ", base_name, "_fill", std::to_string(id), "(toml_table_t* ", in, ", ", name, "** ", this->ptr, ") {\n");
+        if (t.array) {
+            this->put("    toml_table_t* ", t.path, ";\n");
+            this->put("    toml_array_t* ", t.path, "_arr = toml_array_in(", in, ", \"", cstr(t.name), "\");\n");
+            this->put("    const int ", t.path, "_n = ", t.path, "_arr ? toml_array_nelem(", t.path, "_arr) : 0;\n");
+        }
+        this->out += t.fields.empty() ? "" : "    toml_datum_t datum;\n";
+        this->out += arrays ? "    toml_array_t* arr;\n" : "";
+        this->out += arrays || fixed ? "    int n;\n" : "";
+        // A table with only subtables has nothing to fill
+        if (t.fields.empty()) {
+            this->put("    (void)", in, ";\n    (void)", this->ptr, ";\n");
+        }
+        this->out += "\n";
+        fill(t);
+        this->out += "    return 0;\n}\n\n";
+    }
+
+    this->put(lazy_t, "* ", base_name, "_open(const char* file_path) {");
+    this->out += R"(
+    FILE* fp;
+    char errbuf[200];
+    )" + lazy_t + R"(* lazy;
+    )" + name + "* " + this->ptr + R"(;
+
+    /* Open the file. */
+    if (0 == (fp = fopen(file_path, "r"))) {
+        )" + base_name + "_error(\"" + base_name + R"(_open() failed: couldn't open %s", file_path);
+        return NULL;
+    }
+    if (0 == (lazy = calloc(1, sizeof(*lazy)))) {
+        fclose(fp);
+        return NULL;
+    }
+
+    /* Run the file through the parser, keep the document. */
+    lazy->doc = toml_parse_file(fp, errbuf, sizeof(errbuf));
+    fclose(fp);
+    if (0 == lazy->doc) {
+        )" + base_name + "_error(\"" + base_name + R"(_open() failed: error while parsing %s", file_path);
+        free(lazy);
+        return NULL;
+    }
+    )" + this->ptr + R"( = &lazy->)" + this->ptr + R"(;
+)";
+    if (!this->opts.cold.empty()) {
+        this->put("    if (0 == (", this->ptr, "->", LIB_BASE_NAMEu, "cold = calloc(1, sizeof(", base_name, "_cold_t)))) {\n");
+        this->put("        ", base_name, "_error(\"", base_name, "_open() failed: out of memory\");\n");
+        this->put("        ", base_name, "_close(lazy);\n");
+        this->out += "        return NULL;\n    }\n";
+    }
+    this->out += "\n    /* The root's own keys are loaded now, the tables on demand */\n";
+    this->put("    if (", base_name, "_fill0(lazy->doc, &", this->ptr, ")) {\n");
+    this->put("        ", base_name, "_close(lazy);\n");
+    this->out += "        return NULL;\n    }\n";
+    this->out += "    lazy->loaded[0] = 1;\n    return lazy;\n}\n\n";
+
+    this->put("const ", name, "* ", base_name, "_root(", lazy_t, "* lazy) {\n");
+    this->put("    return &lazy->", this->ptr, ";\n}\n\n");
 
-    this->out += "\n    toml_free(root);\n    return 0;\n}\n\n";
-    this->out += "void "+ base_name+"_print(const "+name+"* "+this->o_var+") {\n";
-    this->out += "    printf(\"Read "+this->o_name+".toml values:\\n\");\n\n";
+    for (size_t id = 1; id < tables.size(); ++id) {
+        const Table& t = *tables[id];
+        const std::string fn = base_name + t.path.substr(4);
+        const std::string in = t.array ? t.parent->path : t.path;
+        std::vector<const Table*> chain;
+        for (const Table* p = t.array ? t.parent : &t; p->parent; p = p->parent) {
+            chain.insert(chain.begin(), p);
+        }
+
+        this->put("const ", name, "* ", fn, "(", lazy_t, "* lazy) {\n");
+        this->put("    ", name, "* ", this->ptr, " = &lazy->", this->ptr, ";\n");
+        this->out += "    toml_table_t* root = lazy->doc;\n";
+        for (const Table* c: chain) {
+            this->put("    toml_table_t* ", c->path, ";\n");
+        }
+        const std::string loaded = "lazy->loaded[" + std::to_string(id) + "]";
+        this->put("\n    if (", loaded, ") {\n");
+        this->put("        return ", loaded, " > 0 ? ", this->ptr, " : NULL;\n    }\n");
+        this->put("    ", loaded, " = -1;\n");
+        if (!chain.empty()) {
+            this->out += "    if (";
+            for (const Table* c: chain) {
+                this->put(c == chain.front() ? "" : "\n        || ", "!(", c->path, " = toml_table_in(", c->parent->path, ", \"", cstr(c->name), "\"))");
+            }
+            this->out += ") {\n";
+            this->put("        ", base_name, "_error(\"", fn, "() failed: failed locating [", cstr(key_path(*chain.back()->parent, chain.back()->name)), "] table\");\n");
+            this->out += "        return NULL;\n    }\n";
+        }
+        this->put("    if (", base_name, "_fill", std::to_string(id), "(", in, ", &", this->ptr, ")) {\n");
+        this->out += "        return NULL;\n    }\n";
+        this->put("    ", loaded, " = 1;\n");
+        this->put("    return ", this->ptr, ";\n}\n\n");
+    }
+
+    this->put("void ", base_name, "_close(", lazy_t, "* lazy) {\n");
+    this->out += "    if (lazy) {\n";
+    this->put("        ", base_name, "_clear(&lazy->", this->ptr, ");\n");
+    this->out += "        toml_free(lazy->doc);\n        free(lazy);\n    }\n}\n\n";
+}
 
-    std::function<void(const Table&)> print_r;
-    print_r = [&] (const Table& t)->void {
+void Writer::c_arena(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+    const std::string arena_t = LIB_BASE_NAMEu + "arena_t";
+
+    this->out += "#define ARENA_ALIGN(n) (((n) + 7) & ~(size_t)7)\n\n";
+
+    // Layout: sizes every value, and copies it behind the struct when given one
+    this->put("/* Lays the values of root out behind the struct at ", this->ptr, ", which must be\n");
+    this->put(" * zeroed. With ", this->ptr, " == NULL only the total size is computed. */\n");
+    this->put("static int ", base_name, "_layout(toml_table_t* root, ", name, "* ", this->ptr, ", size_t* size) {\n");
+    this->put("    char* base = (char*)", this->ptr, ";\n");
+    this->put("    size_t used = ARENA_ALIGN(sizeof(", name, "));\n");
+    this->out += "    size_t n;\n";
+    if (!this->opts.cold.empty()) {
+        // The cold block sits right behind the struct
+        this->put("    if (", this->ptr, ") ", this->ptr, "->", LIB_BASE_NAMEu, "cold = (void*)(base + used);\n");
+        this->put("    used += ARENA_ALIGN(sizeof(", base_name, "_cold_t));\n");
+    }
+    this->out += "    toml_datum_t datum;\n    toml_array_t* arr;\n";
+    this->c_tables(root);
+    this->out += "\n";
+
+    std::function<void(const Table&)> layout_r;
+    layout_r = [&] (const Table& t)->void {
+        const std::string index = t.path + "_i";
+        const std::string tbl = t.path;
+        size_t body = 0;
+        if (t.array) {
+            // The entries, or with --soa the columns, come first
+            const std::string n = t.path + "_n";
+            auto block = [&] (const std::string& dst) {
+                this->put("    if (", this->ptr, ") ", dst, " = (void*)(base + used);\n");
+                this->put("    used += ARENA_ALIGN(", n, " * sizeof(*", dst, "));\n");
+            };
+            if (this->opts.soa) {
+                for (const Field& f: t.fields) {
+                    block(this->ptr + "->" + t.var + f.name);
+                    if (f.type >= Field::Type::t_array) {
+                        block(this->ptr + "->" + t.var + f.name + "_len");
+                    }
+                }
+            } else {
+                block(this->ptr + "->" + t.var.substr(0, t.var.size()-1));
+            }
+            this->put("    if (", this->ptr, ") ", this->count(this->ptr, t), " = ", n, ";\n");
+            this->put("    for (int ", index, " = 0; ", index, " < ", n, "; ++", index, ") {\n");
+            body = this->out.size();
+            this->put("    ", tbl, " = toml_table_at(", tbl, "_arr, ", index, ");\n");
+        }
         for (const Field& f: t.fields) {
+            const std::string dst = this->member(this->ptr, t, f, index);
+            const std::string len = this->member(this->ptr, t, f, index, "_len");
+            std::string at;
+            std::string el;
+            std::string mem;
             switch (f.type) {
                 case Field::Type::t_int:
-                    this->out += "    printf(\""+this->o_var+"."+get_path_var(t,f.name)+" = %ld\\n\", "+this->o_var+"->"+get_path_var(t,f.name)+");\n";
+                    this->put("    datum = toml_int_in(", tbl, ", \"", cstr(f.key), "\");\n");
+                    this->put("    if (", this->ptr, ") ", dst, " = datum.u.i;\n");
                     break;
-
                 case Field::Type::t_double:
-                    this->out += "    printf(\""+this->o_var+"."+get_path_var(t,f.name)+" = %lf\\n\", "+this->o_var+"->"+get_path_var(t,f.name)+");\n";
+                    this->put("    datum = toml_double_in(", tbl, ", \"", cstr(f.key), "\");\n");
+                    this->put("    if (", this->ptr, ") ", dst, " = datum.u.d;\n");
                     break;
-
                 case Field::Type::t_bool:
-                    this->out += "    printf(\""+this->o_var+"."+get_path_var(t,f.name)+" = %s\\n\", "+this->o_var+"->"+get_path_var(t,f.name)+"? \"true\":\"false\");\n";
+                    this->put("    datum = toml_bool_in(", tbl, ", \"", cstr(f.key), "\");\n");
+                    if (f.packed) {
+                        this->put("    if (", this->ptr, ") ", this->bit(this->ptr, t, f, "datum.u.b"), ";\n");
+                    } else {
+                        this->put("    if (", this->ptr, ") ", dst, " = datum.u.b;\n");
+                    }
                     break;
-
                 case Field::Type::t_string:
-                    this->out += "    printf(\""+this->o_var+"."+get_path_var(t,f.name)+" = %s\\n\", "+this->o_var+"->"+get_path_var(t,f.name)+");\n";
+                    this->put("    datum = toml_string_in(", tbl, ", \"", cstr(f.key), "\");\n");
+                    this->out += "    if (datum.ok) {\n";
+                    this->out += "        n = strlen(datum.u.s) + 1;\n";
+                    if (f.cap) {
+                        this->put("        if (n > ", std::to_string(f.cap), ") {\n");
+                        this->put("            free(datum.u.s);\n            ", this->overflow(t, f), "\n");
+                        this->out += "            return 1;\n        }\n";
+                        this->put("        if (", this->ptr, ") memcpy(", dst, ", datum.u.s, n);\n");
+                        this->out += "        free(datum.u.s);\n";
+                        this->out += "    }\n";
+                        break;
+                    }
+                    this->put("        if (", this->ptr, ") ", dst, " = memcpy(base + used, datum.u.s, n);\n");
+                    this->out += "        used += ARENA_ALIGN(n);\n";
+                    this->out += "        free(datum.u.s);\n";
+                    this->out += "    }\n";
                     break;
-
-                case Field::Type::t_array_of_int:
-                    this->out += "    for (int i = 0; i < "+this->o_var+"->"+get_path_var(t, f.name)+"_len; ++i) {\n";
-                    this->out += "        printf(\""+this->o_var+"."+get_path_var(t,f.name)+"[%d] = %ld\\n\", i, "+this->o_var+"->"+get_path_var(t,f.name)+"[i]);\n";
-                    this->out += "    };\n";
+                case Field::Type::t_enum:
+                    this->put("    datum = toml_string_in(", tbl, ", \"", cstr(f.key), "\");\n");
+                    this->out += "    if (datum.ok) {\n";
+                    this->put("        const int e = ", this->enum_of(f, "datum.u.s"), ";\n");
+                    this->out += "        if (e < 0) {\n";
+                    this->put("            ", this->enum_unknown(t, f, "datum.u.s"), "\n");
+                    this->out += "            free(datum.u.s);\n            return 1;\n        }\n";
+                    this->put("        if (", this->ptr, ") ", dst, " = e;\n");
+                    this->out += "        free(datum.u.s);\n    }\n";
                     break;
 
+                case Field::Type::t_array_of_int:
+                    at = "toml_int_at"; el = "int64_t"; mem = "i"; break;
                 case Field::Type::t_array_of_double:
-                    this->out += "    for (int i = 0; i < "+this->o_var+"->"+get_path_var(t, f.name)+"_len; ++i) {\n";
-                    this->out += "        printf(\""+this->o_var+"."+get_path_var(t,f.name)+"[%d] = %lf\\n\", i, "+this->o_var+"->"+get_path_var(t,f.name)+"[i]);\n";
-                    this->out += "    };\n";
-                    break;
-
+                    at = "toml_double_at"; el = "double"; mem = "d"; break;
                 case Field::Type::t_array_of_bool:
-                    this->out += "    for (int i = 0; i < "+this->o_var+"->"+get_path_var(t, f.name)+"_len; ++i) {\n";
-                    this->out += "        printf(\""+this->o_var+"."+get_path_var(t,f.name)+"[%d] = %s\\n\", i, "+this->o_var+"->"+get_path_var(t,f.name)+"[i]?\"true\":\"false\");\n";
-                    this->out += "    };\n";
+                    if (!f.packed) {
+                        at = "toml_bool_at"; el = "bool"; mem = "b"; break;
+                    }
+                    // The arena is zeroed, so only set bits are written
+                    this->out += "    STATS_START();\n";
+                    this->put("    arr = toml_array_in(", tbl, ", \"", cstr(f.key), "\");\n");
+                    this->out += "    n = arr ? toml_array_nelem(arr) : 0;\n";
+                    this->put("    if (", this->ptr, ") {\n");
+                    this->put("        ", dst, " = (uint8_t*)(base + used);\n");
+                    this->put("        ", len, " = n;\n");
+                    this->out += "        for (size_t i = 0; i < n; ++i) {\n";
+                    this->out += "            datum = toml_bool_at(arr, i);\n";
+                    this->put("            ", dst, "[i >> 3] |= (uint8_t)(datum.u.b << (i & 7));\n");
+                    this->out += "        }\n";
+                    this->out += "    }\n";
+                    this->out += "    used += ARENA_ALIGN((n + 7) / 8);\n";
+                    this->out += "    STATS_STOP(arrays_ns);\n";
                     break;
 
                 case Field::Type::t_array_of_string:
-                    this->out += "    for (int i = 0; i < "+this->o_var+"->"+get_path_var(t, f.name)+"_len; ++i) {\n";
-                    this->out += "        printf(\""+this->o_var+"."+get_path_var(t,f.name)+"[%d] = %s\\n\", i, "+this->o_var+"->"+get_path_var(t,f.name)+"[i]);\n";
-                    this->out += "    };\n";
+                    this->out += "    STATS_START();\n";
+                    this->put("    arr = toml_array_in(", tbl, ", \"", cstr(f.key), "\");\n");
+                    this->out += "    n = arr ? toml_array_nelem(arr) : 0;\n";
+                    this->put("    if (", this->ptr, ") {\n");
+                    this->put("        ", dst, " = (char**)(base + used);\n");
+                    this->put("        ", len, " = n;\n");
+                    this->out += "    }\n";
+                    this->out += "    used += ARENA_ALIGN(n * sizeof(char*));\n";
+                    this->out += "    for (size_t i = 0; i < n; ++i) {\n";
+                    this->out += "        datum = toml_string_at(arr, i);\n";
+                    this->out += "        if (datum.ok) {\n";
+                    this->out += "            size_t sn = strlen(datum.u.s) + 1;\n";
+                    this->put("            if (", this->ptr, ") ", dst, "[i] = memcpy(base + used, datum.u.s, sn);\n");
+                    this->out += "            used += ARENA_ALIGN(sn);\n";
+                    this->out += "            free(datum.u.s);\n";
+                    this->out += "        }\n";
+                    this->out += "    }\n";
+                    this->out += "    STATS_STOP(arrays_ns);\n";
                     break;
 
                 default:
                     break;
             }
+            if (!at.empty()) {
+                this->out += "    STATS_START();\n";
+                this->put("    arr = toml_array_in(", tbl, ", \"", cstr(f.key), "\");\n");
+                this->out += "    n = arr ? toml_array_nelem(arr) : 0;\n";
+                if (f.cap) {
+                    this->put("    if (n > ", std::to_string(f.cap), ") {\n        ", this->overflow(t, f), "\n");
+                    this->out += "        return 1;\n    }\n";
+                }
+                this->put("    if (", this->ptr, ") {\n");
+                if (!f.cap) {
+                    this->put("        ", dst, " = (", el, "*)(base + used);\n");
+                }
+                this->put("        ", len, " = n;\n");
+                this->out += "        for (size_t i = 0; i < n; ++i) {\n";
+                this->put("            datum = ", at, "(arr, i);\n");
+                this->put("            ", dst, "[i] = datum.u.", mem, ";\n");
+                this->out += "        }\n";
+                this->out += "    }\n";
+                if (!f.cap) {
+                    this->put("    used += ARENA_ALIGN(n * sizeof(", el, "));\n");
+                }
+                this->out += "    STATS_STOP(arrays_ns);\n";
+            }
         }
-        for (const Table* c: t.children) {
-            print_r(*c);
+        if (t.array) {
+            this->indent_since(body);
+            this->out += "    }\n";
+        }
+        for (size_t i = 0; i < t.children.size(); ++i) {
+            if (!t.parent) {
+                this->put("    STATS_TABLE(", std::to_string(i), ");\n");
+            }
+            layout_r(*t.children[i]);
         }
     };
-    print_r(root);
+    layout_r(root);
+    if (!root.children.empty()) {
+        this->out += "    STATS_TABLE(-1);\n";
+    }
+    this->out += "\n    *size = used;\n    return 0;\n}\n\n";
 
-    this->out += "\n    fflush(stdout);\n}\n\n";
-    this->out += "void "+base_name+"_free("+name+"* "+this->o_var+") {\n";
-    this->out += "    if (!" + this->o_var +") {\n";
-    this->out += "        return;\n";
-    this->out += "    }\n";
+    // Parse
+    this->put("static toml_table_t* ", base_name, "_parse(const char* file_path, const char* fn) {");
+    this->out += R"(
+    FILE* fp;
+    toml_table_t* root;
+    char errbuf[200];
 
-    std::function<void(const Table&)> free_r;
-    free_r = [&] (const Table& t)->void {
-        for (const Field& f: t.fields) {
-            switch (f.type) {
-                case Field::Type::t_string:
-                case Field::Type::t_array_of_int:
-                case Field::Type::t_array_of_bool:
-                case Field::Type::t_array_of_double:
-                    this->out += "    free("+this->o_var+"->"+get_path_var(t, f.name)+");\n";
-                    break;
+    /* Open the file. */
+    STATS_START();
+    fp = fopen(file_path, "r");
+    STATS_STOP(io_ns);
+    if (0 == fp) {
+        )" + base_name + R"(_error("%s() failed: couldn't open %s", fn, file_path);
+        return NULL;
+    }
 
-                case Field::Type::t_array_of_string:
-                    this->out += "    for (int i = 0; i < "+this->o_var+"->"+get_path_var(t, f.name)+"_len; ++i) {\n";
-                    this->out += "        free("+this->o_var+"->"+get_path_var(t, f.name)+"[i]);\n";
-                    this->out += "    }\n";
-                    this->out += "    free("+this->o_var+"->"+get_path_var(t, f.name)+");\n";
-                    break;
+    /* Run the file through the parser. */
+    STATS_START();
+    root = toml_parse_file(fp, errbuf, sizeof(errbuf));
+    STATS_STOP(parse_ns);
+    fclose(fp);
+    if (0 == root) {
+        )" + base_name + R"(_error("%s() failed: error while parsing %s", fn, file_path);
+    }
+    return root;
+}
 
-                default:
-                    break;
-            }
+)";
+
+    // Read, one allocation
+    this->put("static int ", base_name, "_alloc(toml_table_t* root, ", name, "** ", this->ptr, ", const char* fn) {\n");
+    this->out += "    size_t size;\n\n";
+    this->put("    if (*", this->ptr, " != NULL) {\n");
+    this->put("        ", base_name, "_error(\"%s() failed: the struct is allocated by the read\", fn);\n");
+    this->out += "        return 1;\n    }\n";
+    this->put("    if (", base_name, "_layout(root, NULL, &size) || 0 == (*", this->ptr, " = calloc(1, size))) {\n");
+    this->out += "        return 1;\n    }\n";
+    this->put("    ", base_name, "_layout(root, *", this->ptr, ", &size);\n");
+    this->out += "    return 0;\n}\n\n";
+
+    this->put("int ", base_name, "_read(const char* file_path, ", name, "** ", this->ptr, ") {\n");
+    this->out += "    toml_table_t* root;\n    int rc;\n\n";
+    this->out += "    STATS_BEGIN(file_path);\n";
+    this->put("    if (0 == (root = ", base_name, "_parse(file_path, \"", base_name, "_read\"))) {\n");
+    this->out += "        return STATS_END(1);\n    }\n";
+    this->out += "    STATS_START();\n";
+    this->put("    rc = ", base_name, "_alloc(root, ", this->ptr, ", \"", base_name, "_read\");\n");
+    this->out += "    STATS_STOP(load_ns);\n";
+    this->out += "    toml_free(root);\n    return STATS_END(rc);\n}\n\n";
+
+    // Text already in memory, tomlc99 needs it NUL-terminated
+    this->put("static int ", base_name, "_text(const char* buf, size_t len, int terminated, ", name, "** ", this->ptr, ", const char* fn, const char* src) {");
+    this->out += R"(
+    char* text = (char*)buf;
+    toml_table_t* root;
+    char errbuf[200];
+    int rc;
+
+    if (!terminated) {
+        if (0 == (text = malloc(len + 1))) {
+            )" + base_name + R"(_error("%s() failed: out of memory", fn);
+            return 1;
         }
-        for (const Table* c: t.children) {
-            free_r(*c);
+        memcpy(text, buf, len);
+        text[len] = '\0';
+    }
+    STATS_START();
+    root = toml_parse(text, errbuf, sizeof(errbuf));
+    STATS_STOP(parse_ns);
+    if (text != buf) {
+        free(text);
+    }
+    if (0 == root) {
+        )" + base_name + R"(_error("%s() failed: error while parsing %s: %s", fn, src, errbuf);
+        return 1;
+    }
+
+    STATS_START();
+    rc = )" + base_name + "_alloc(root, " + this->ptr + R"(, fn);
+    STATS_STOP(load_ns);
+    toml_free(root);
+    return rc;
+}
+
+)";
+
+    // Read, caller's arena
+    this->put("int ", base_name, "_read_arena(const char* file_path, ", arena_t, "* arena, ", name, "** ", this->ptr, ") {\n");
+    this->out += "    toml_table_t* root;\n    size_t size;\n    size_t start = ARENA_ALIGN(arena->used);\n\n";
+    this->out += "    STATS_BEGIN(file_path);\n";
+    this->put("    if (0 == (root = ", base_name, "_parse(file_path, \"", base_name, "_read_arena\"))) {\n");
+    this->out += "        return STATS_END(1);\n    }\n";
+    this->out += "    STATS_START();\n";
+    this->put("    if (", base_name, "_layout(root, NULL, &size)) {\n");
+    this->out += "        toml_free(root);\n        return STATS_END(1);\n    }\n";
+    this->out += "    if (start > arena->cap || arena->cap - start < size) {\n";
+    this->put("        ", base_name, "_error(\"", base_name, "_read_arena() failed: %zu bytes needed\", size);\n");
+    this->out += "        toml_free(root);\n        return STATS_END(1);\n    }\n";
+    this->put("    *", this->ptr, " = memset(arena->base + start, 0, size);\n");
+    this->put("    ", base_name, "_layout(root, *", this->ptr, ", &size);\n");
+    this->out += "    arena->used = start + size;\n";
+    this->out += "    STATS_STOP(load_ns);\n";
+    this->out += "\n    toml_free(root);\n    return STATS_END(0);\n}\n\n";
+}
+
+// Schema independent part of the --direct reader, emitted verbatim
+static const char* direct_runtime = R"rt(/* Single-pass TOML reader. */
+#define TP_KEY_MAX 256
+
+typedef struct {
+    const char* start;
+    const char* p;
+    const char* end;
+    char* err;
+    size_t errsz;
+    int line;   /* lines before start */
+} tp_t;
+
+static int tp_fail(tp_t* tp, const char* msg) {
+    if (tp->err[0] == '\0') {
+        int line = 1 + tp->line;
+        for (const char* c = tp->start; c < tp->p && c < tp->end; ++c) {
+            line += *c == '\n';
         }
-    };
-    free_r(root);
+        snprintf(tp->err, tp->errsz, "line %d: %s", line, msg);
+    }
+    return -1;
+}
 
-    this->out += "\n    free("+this->o_var+");\n}\n";
+static void tp_ws(tp_t* tp) {
+    while (tp->p < tp->end && (*tp->p == ' ' || *tp->p == '\t')) {
+        ++tp->p;
+    }
 }
 
-void Writer::c_finalize() {
-    std::ofstream src;
-    src.open(LIB_BASE_NAMEh+this->o_name+".c");
-    src << out;
-    src.close();
+/* Skips blanks, newlines and comments. */
+static void tp_wsnl(tp_t* tp) {
+    while (tp->p < tp->end) {
+        if (*tp->p == ' ' || *tp->p == '\t' || *tp->p == '\n' || *tp->p == '\r') {
+            ++tp->p;
+        } else if (*tp->p == '#') {
+            while (tp->p < tp->end && *tp->p != '\n') {
+                ++tp->p;
+            }
+        } else {
+            break;
+        }
+    }
 }
 
-void Writer::write(const std::string& name, const Table& root) {
-    this->o_name = name;
-    // Remove path
-    size_t pdir = this->o_name.find_last_of("\\/");
-    if (pdir != std::string::npos) {
-        this->o_name = this->o_name.substr(pdir+1);
+static int tp_eol(tp_t* tp) {
+    tp_ws(tp);
+    if (tp->p < tp->end && *tp->p == '#') {
+        while (tp->p < tp->end && *tp->p != '\n') {
+            ++tp->p;
+        }
     }
-    // Remove extension
-    size_t pext = this->o_name.find(".toml");
-    if (pext != std::string::npos) {
-        this->o_name = this->o_name.substr(0, pext);
+    if (tp->p < tp->end && *tp->p == '\r') {
+        ++tp->p;
     }
-    this->o_var = cvar(this->o_name);
+    if (tp->p < tp->end) {
+        if (*tp->p != '\n') {
+            return tp_fail(tp, "expected a newline");
+        }
+        ++tp->p;
+    }
+    return 0;
+}
 
-    this->h_header();
-    this->h_struct(root);
-    this->h_functions(root.name);
-    this->h_finalize();
-    this->out.clear();
+static int tp_is_bare(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
 
-    this->c_src(root);
-    this->c_finalize();
-    this->out.clear();
+enum { TP_BASIC, TP_LITERAL, TP_ML_BASIC, TP_ML_LITERAL };
+
+/* Finds the body [*s, *e) of the string at tp->p and moves past it. */
+static int tp_str_span(tp_t* tp, const char** s, const char** e, int* kind) {
+    const char q = *tp->p;
+    const int ml = tp->end - tp->p >= 3 && tp->p[1] == q && tp->p[2] == q;
+
+    *kind = (q == '"' ? TP_BASIC : TP_LITERAL) + (ml ? 2 : 0);
+    tp->p += ml ? 3 : 1;
+    if (ml && tp->p < tp->end && *tp->p == '\n') {
+        ++tp->p;
+    } else if (ml && tp->end - tp->p >= 2 && tp->p[0] == '\r' && tp->p[1] == '\n') {
+        tp->p += 2;
+    }
+    *s = tp->p;
+    for (; tp->p < tp->end; ++tp->p) {
+        if (*tp->p == '\\' && q == '"') {
+            ++tp->p;
+        } else if (*tp->p == '\n' && !ml) {
+            break;
+        } else if (*tp->p == q && (!ml || (tp->end - tp->p >= 3 && tp->p[1] == q && tp->p[2] == q))) {
+            if (ml) {
+                /* Up to two quotes may end the body */
+                for (int i = 0; i < 2 && tp->end - tp->p > 3 && tp->p[3] == q; ++i) {
+                    ++tp->p;
+                }
+            }
+            *e = tp->p;
+            tp->p += ml ? 3 : 1;
+            return 0;
+        }
+    }
+    return tp_fail(tp, "unterminated string");
 }
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        printf("Usage: %s TFILE.toml", argv[0]);
-        exit(1);
+static size_t tp_utf8(char* o, uint32_t cp) {
+    if (cp < 0x80) {
+        o[0] = (char)cp;
+        return 1;
+    } else if (cp < 0x800) {
+        o[0] = (char)(0xC0 | cp >> 6);
+        o[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    } else if (cp < 0x10000) {
+        o[0] = (char)(0xE0 | cp >> 12);
+        o[1] = (char)(0x80 | (cp >> 6 & 0x3F));
+        o[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
     }
+    o[0] = (char)(0xF0 | cp >> 18);
+    o[1] = (char)(0x80 | (cp >> 12 & 0x3F));
+    o[2] = (char)(0x80 | (cp >> 6 & 0x3F));
+    o[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
 
-    Writer writer;
-    Reader reader;
+/* Decodes the body [s, e) into o, which holds at least e - s + 1 bytes. */
+static int tp_str_decode(tp_t* tp, const char* s, const char* e, int kind, char* o, size_t* len) {
+    size_t n = 0;
 
-    if (reader.parser(argv[1])) {
-        exit(1);
+    if (kind == TP_LITERAL || kind == TP_ML_LITERAL) {
+        memcpy(o, s, e - s);
+        o[e - s] = '\0';
+        *len = e - s;
+        return 0;
+    }
+    while (s < e) {
+        if (*s != '\\') {
+            o[n++] = *s++;
+            continue;
+        }
+        ++s;
+        switch (*s++) {
+            case 'b': o[n++] = '\b'; break;
+            case 't': o[n++] = '\t'; break;
+            case 'n': o[n++] = '\n'; break;
+            case 'f': o[n++] = '\f'; break;
+            case 'r': o[n++] = '\r'; break;
+            case 'e': o[n++] = '\033'; break;
+            case '"': o[n++] = '"'; break;
+            case '\\': o[n++] = '\\'; break;
+            case 'u':
+            case 'U': {
+                const int digits = s[-1] == 'u' ? 4 : 8;
+                uint32_t cp = 0;
+                if (e - s < digits) {
+                    return tp_fail(tp, "invalid unicode escape");
+                }
+                for (int i = 0; i < digits; ++i, ++s) {
+                    const char c = *s;
+                    cp = cp << 4 | (uint32_t)(c >= '0' && c <= '9' ? c - '0' : (c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : 0xFF);
+                    if (cp > 0x10FFFF) {
+                        return tp_fail(tp, "invalid unicode escape");
+                    }
+                }
+                n += tp_utf8(o + n, cp);
+                break;
+            }
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+                if (kind == TP_ML_BASIC) {
+                    /* Line ending backslash */
+                    while (s < e && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')) {
+                        ++s;
+                    }
+                    break;
+                }
+                /* fallthrough */
+            default:
+                return tp_fail(tp, "invalid escape");
+        }
+    }
+    o[n] = '\0';
+    *len = n;
+    return 0;
+}
+
+static int tp_string(tp_t* tp, char** v) {
+    const char* s;
+    const char* e;
+    int kind;
+    size_t len;
+
+    if (tp->p >= tp->end || (*tp->p != '"' && *tp->p != '\'')) {
+        return tp_fail(tp, "expected a string");
+    }
+    if (tp_str_span(tp, &s, &e, &kind)) {
+        return -1;
     }
+    if (0 == (*v = malloc(e - s + 1))) {
+        return tp_fail(tp, "out of memory");
+    }
+    if (tp_str_decode(tp, s, e, kind, *v, &len)) {
+        free(*v);
+        *v = NULL;
+        return -1;
+    }
+    return 0;
+}
 
-    writer.write(argv[1], reader.get_root());
+static int tp_int(tp_t* tp, int64_t* v) {
+    const char* p = tp->p;
+    const char* digits;
+    uint64_t acc = 0;
+    unsigned base = 10;
+    int neg = 0;
 
+    if (p < tp->end && (*p == '+' || *p == '-')) {
+        neg = *p++ == '-';
+    }
+    if (tp->end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'o' || p[1] == 'b')) {
+        base = p[1] == 'x' ? 16 : p[1] == 'o' ? 8 : 2;
+        p += 2;
+    } else if (tp->end - p >= 2 && p[0] == '0' && ((p[1] >= '0' && p[1] <= '9') || p[1] == '_')) {
+        return tp_fail(tp, "leading zeros are not allowed");
+    }
+    for (digits = p; p < tp->end; ++p) {
+        unsigned d;
+        if (*p == '_') {
+            continue;
+        } else if (*p >= '0' && *p <= '9') {
+            d = *p - '0';
+        } else if (base == 16 && (*p | 0x20) >= 'a' && (*p | 0x20) <= 'f') {
+            d = (*p | 0x20) - 'a' + 10;
+        } else {
+            break;
+        }
+        if (d >= base) {
+            return tp_fail(tp, "invalid digit");
+        }
+        if (acc > (UINT64_MAX - d) / base) {
+            return tp_fail(tp, "integer out of range");
+        }
+        acc = acc * base + d;
+    }
+    if (p == digits) {
+        return tp_fail(tp, "expected an integer");
+    }
+    if (p < tp->end && (*p == '.' || *p == 'e' || *p == 'E')) {
+        return tp_fail(tp, "expected an integer, found a float");
+    }
+    if (acc > (uint64_t)INT64_MAX + neg) {
+        return tp_fail(tp, "integer out of range");
+    }
+    *v = neg ? (int64_t)(0 - acc) : (int64_t)acc;
+    tp->p = p;
     return 0;
 }
+
+static int tp_double(tp_t* tp, double* v) {
+    char buf[64];
+    size_t n = 0;
+    const char* p = tp->p;
+    const char* b = buf;
+    char* e;
+
+    for (; p < tp->end && n < sizeof(buf) - 1; ++p) {
+        if (*p == '_') {
+            continue;
+        }
+        if (!tp_is_bare(*p) && *p != '+' && *p != '.') {
+            break;
+        }
+        buf[n++] = *p;
+    }
+    buf[n] = '\0';
+    if (*b == '+' || *b == '-') {
+        ++b;
+    }
+    if (0 == strcmp(b, "inf")) {
+        *v = buf[0] == '-' ? -HUGE_VAL : HUGE_VAL;
+    } else if (0 == strcmp(b, "nan")) {
+        *v = NAN;
+    } else {
+        /* Only the TOML forms: strtod also takes hex, and leading zeros */
+        const char* c = b;
+        const char* d = c;
+        int point = 0;
+        int ok;
+
+        while (*c >= '0' && *c <= '9') {
+            ++c;
+        }
+        ok = c > d && (d[0] != '0' || c - d == 1);
+        if (ok && *c == '.') {
+            for (d = ++c; *c >= '0' && *c <= '9'; ++c) {
+            }
+            ok = c > d;
+            point = 1;
+        }
+        if (ok && (*c == 'e' || *c == 'E')) {
+            c += c[1] == '+' || c[1] == '-' ? 2 : 1;
+            for (d = c; *c >= '0' && *c <= '9'; ++c) {
+            }
+            ok = c > d;
+            point = 1;
+        }
+        if (!ok || *c != '\0') {
+            return tp_fail(tp, "expected a float");
+        }
+        if (!point) {
+            return tp_fail(tp, "expected a float, found an integer");
+        }
+        *v = strtod(buf, &e);
+    }
+    tp->p = p;
+    return 0;
+}
+
+static int tp_bool(tp_t* tp, bool* v) {
+    if (tp->end - tp->p >= 4 && 0 == memcmp(tp->p, "true", 4)) {
+        *v = true;
+        tp->p += 4;
+    } else if (tp->end - tp->p >= 5 && 0 == memcmp(tp->p, "false", 5)) {
+        *v = false;
+        tp->p += 5;
+    } else {
+        return tp_fail(tp, "expected a boolean");
+    }
+    return 0;
+}
+
+static inline int tp_bool_el(tp_t* tp, void* v) { return tp_bool(tp, v); }
+static inline int tp_string_el(tp_t* tp, void* v) { return tp_string(tp, v); }
+
+/* Reads an array of elements of the given size into a new buffer. */
+static inline int tp_array(tp_t* tp, void** v, size_t* len, size_t size, int (*el)(tp_t*, void*)) {
+    char* buf = NULL;
+    size_t n = 0;
+    size_t cap = 0;
+
+    if (tp->p >= tp->end || *tp->p != '[') {
+        return tp_fail(tp, "expected an array");
+    }
+    ++tp->p;
+    for (;;) {
+        tp_wsnl(tp);
+        if (tp->p < tp->end && *tp->p == ']') {
+            break;
+        }
+        if (n == cap) {
+            char* grown = realloc(buf, (cap = cap ? 2 * cap : 8) * size);
+            if (!grown) {
+                tp_fail(tp, "out of memory");
+                goto fail;
+            }
+            buf = grown;
+        }
+        if (el(tp, buf + n * size)) {
+            goto fail;
+        }
+        ++n;
+        tp_wsnl(tp);
+        if (tp->p < tp->end && *tp->p == ',') {
+            ++tp->p;
+        } else if (tp->p >= tp->end || *tp->p != ']') {
+            tp_fail(tp, "expected ',' or ']'");
+            goto fail;
+        }
+    }
+    ++tp->p;
+    *v = buf;
+    *len = n;
+    return 0;
+
+fail:
+    if (el == tp_string_el) {
+        for (size_t i = 0; i < n; ++i) {
+            free(((char**)buf)[i]);
+        }
+    }
+    free(buf);
+    return -1;
+}
+
+/* Numeric arrays. A pass over the text sizes the buffer, 16 bytes at a time
+ * with SSE2, and plain decimals convert without strtod, eight digits at a
+ * time on little-endian targets. Anything else goes to tp_int and
+ * tp_double. */
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define TP_SSE2 1
+#endif
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define TP_SWAR 1
+#endif
+
+/* The commas before the first ']' or '#', plus one. Only a hint: a
+ * comment may hide commas, or brackets. */
+static inline size_t tp_count_hint(const char* p, const char* end) {
+    size_t n = 1;
+#ifdef TP_SSE2
+    for (; end - p >= 16; p += 16) {
+        const __m128i c = _mm_loadu_si128((const __m128i*)p);
+        const unsigned stop = (unsigned)_mm_movemask_epi8(_mm_or_si128(
+                    _mm_cmpeq_epi8(c, _mm_set1_epi8(']')), _mm_cmpeq_epi8(c, _mm_set1_epi8('#'))));
+        const unsigned commas = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(',')));
+        if (stop) {
+            return n + __builtin_popcount(commas & ((stop & -stop) - 1));
+        }
+        n += __builtin_popcount(commas);
+    }
+#endif
+    for (; p < end && *p != ']' && *p != '#'; ++p) {
+        n += *p == ',';
+    }
+    return n;
+}
+
+/* Appends up to max decimal digits at *p to *acc; returns how many. */
+static inline int tp_digits(const char** p, const char* end, uint64_t* acc, int max) {
+    const char* s = *p;
+    uint64_t v = *acc;
+#ifdef TP_SWAR
+    uint64_t x;
+    while (end - s >= 8 && s - *p + 8 <= max) {
+        memcpy(&x, s, 8);
+        if (((x & 0xF0F0F0F0F0F0F0F0u) | (((x + 0x0606060606060606u) & 0xF0F0F0F0F0F0F0F0u) >> 4)) != 0x3333333333333333u) {
+            break;
+        }
+        x -= 0x3030303030303030u;
+        x = x * 10 + (x >> 8);
+        x = ((x & 0x000000FF000000FFu) * (100 + (1000000ull << 32))
+                + ((x >> 16) & 0x000000FF000000FFu) * (1 + (10000ull << 32))) >> 32;
+        v = v * 100000000u + x;
+        s += 8;
+    }
+#endif
+    while (s < end && *s >= '0' && *s <= '9' && s - *p < max) {
+        v = v * 10 + (uint64_t)(*s++ - '0');
+    }
+    *acc = v;
+    max = (int)(s - *p);
+    *p = s;
+    return max;
+}
+
+/* True for what may follow an array element */
+static inline int tp_is_delim(const tp_t* tp, const char* p) {
+    return p == tp->end || *p == ',' || *p == ']' || *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '#';
+}
+
+static inline int tp_int_fast(tp_t* tp, int64_t* v) {
+    const char* p = tp->p;
+    uint64_t acc = 0;
+    const int neg = p < tp->end && *p == '-';
+
+    p += p < tp->end && (*p == '-' || *p == '+');
+    const char* digits = p;
+    const int n = tp_digits(&p, tp->end, &acc, 18);
+    if (n == 0 || (n > 1 && *digits == '0') || !tp_is_delim(tp, p)) {
+        return tp_int(tp, v);
+    }
+    *v = neg ? -(int64_t)acc : (int64_t)acc;
+    tp->p = p;
+    return 0;
+}
+
+/* Exact when the digits fit in 53 bits and the power of ten is exact. */
+static inline int tp_double_fast(tp_t* tp, double* v) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    const char* p = tp->p;
+    uint64_t acc = 0;
+    uint64_t e = 0;
+    int scale = 0;
+    int exp_neg = 0;
+    const int neg = p < tp->end && *p == '-';
+
+    p += p < tp->end && (*p == '-' || *p == '+');
+    const char* digits = p;
+    const int n = tp_digits(&p, tp->end, &acc, 19);
+    if (n == 0 || (n > 1 && *digits == '0')) {
+        return tp_double(tp, v);
+    }
+    if (p < tp->end && *p == '.') {
+        ++p;
+        scale = tp_digits(&p, tp->end, &acc, 19 - n);
+        if (scale == 0) {
+            return tp_double(tp, v);
+        }
+    }
+    if (p < tp->end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        exp_neg = p < tp->end && *p == '-';
+        p += p < tp->end && (*p == '-' || *p == '+');
+        if (tp_digits(&p, tp->end, &e, 3) == 0) {
+            return tp_double(tp, v);
+        }
+    }
+    const int64_t exp10 = (exp_neg ? -(int64_t)e : (int64_t)e) - scale;
+    /* An integer goes to tp_double too, which rejects it */
+    if (p == digits + n || !tp_is_delim(tp, p) || acc > (1ull << 53) || exp10 < -22 || exp10 > 22) {
+        return tp_double(tp, v);
+    }
+    *v = exp10 < 0 ? (double)acc / pow10[-exp10] : (double)acc * pow10[exp10];
+    *v = neg ? -*v : *v;
+    tp->p = p;
+    return 0;
+}
+
+/* tp_array for int64_t or double elements, into a buffer sized up front */
+static inline int tp_numbers(tp_t* tp, void** v, size_t* len, int is_double) {
+    size_t n = 0;
+    size_t cap;
+    char* buf;
+
+    if (tp->p >= tp->end || *tp->p != '[') {
+        return tp_fail(tp, "expected an array");
+    }
+    ++tp->p;
+    cap = tp_count_hint(tp->p, tp->end);
+    if (!(buf = malloc(cap * 8))) {
+        return tp_fail(tp, "out of memory");
+    }
+    for (;;) {
+        tp_wsnl(tp);
+        if (tp->p < tp->end && *tp->p == ']') {
+            break;
+        }
+        if (n == cap) {
+            char* grown = realloc(buf, (cap *= 2) * 8);
+            if (!grown) {
+                free(buf);
+                return tp_fail(tp, "out of memory");
+            }
+            buf = grown;
+        }
+        if (is_double ? tp_double_fast(tp, (double*)buf + n) : tp_int_fast(tp, (int64_t*)buf + n)) {
+            free(buf);
+            return -1;
+        }
+        ++n;
+        tp_wsnl(tp);
+        if (tp->p < tp->end && *tp->p == ',') {
+            ++tp->p;
+        } else if (tp->p >= tp->end || *tp->p != ']') {
+            free(buf);
+            return tp_fail(tp, "expected ',' or ']'");
+        }
+    }
+    ++tp->p;
+    if (n == 0) {
+        free(buf);
+        buf = NULL;
+    }
+    *v = buf;
+    *len = n;
+    return 0;
+}
+
+/* Reads one key of a dotted key, pointing into the text when possible. */
+static int tp_key(tp_t* tp, char* scratch, const char** key, size_t* len) {
+    tp_ws(tp);
+    if (tp->p < tp->end && (*tp->p == '"' || *tp->p == '\'')) {
+        const char* s;
+        const char* e;
+        int kind;
+        if (tp_str_span(tp, &s, &e, &kind)) {
+            return -1;
+        }
+        if (kind >= TP_ML_BASIC || e - s >= TP_KEY_MAX) {
+            return tp_fail(tp, "invalid key");
+        }
+        if (tp_str_decode(tp, s, e, kind, scratch, len)) {
+            return -1;
+        }
+        *key = scratch;
+    } else {
+        *key = tp->p;
+        while (tp->p < tp->end && tp_is_bare(*tp->p)) {
+            ++tp->p;
+        }
+        if (tp->p == *key) {
+            return tp_fail(tp, "expected a key");
+        }
+        *len = tp->p - *key;
+    }
+    tp_ws(tp);
+    return 0;
+}
+
+/* Moves past a value that is not part of the schema. */
+static int tp_skip(tp_t* tp) {
+    char scratch[TP_KEY_MAX];
+    const char* s;
+    const char* e;
+    int kind;
+    size_t len;
+
+    if (tp->p >= tp->end) {
+        return tp_fail(tp, "expected a value");
+    }
+    switch (*tp->p) {
+        case '"':
+        case '\'':
+            return tp_str_span(tp, &s, &e, &kind);
+
+        case '[':
+            ++tp->p;
+            for (;;) {
+                tp_wsnl(tp);
+                if (tp->p < tp->end && *tp->p == ']') {
+                    break;
+                }
+                if (tp_skip(tp)) {
+                    return -1;
+                }
+                tp_wsnl(tp);
+                if (tp->p < tp->end && *tp->p == ',') {
+                    ++tp->p;
+                } else if (tp->p >= tp->end || *tp->p != ']') {
+                    return tp_fail(tp, "expected ',' or ']'");
+                }
+            }
+            ++tp->p;
+            return 0;
+
+        case '{':
+            ++tp->p;
+            tp_ws(tp);
+            if (tp->p < tp->end && *tp->p == '}') {
+                ++tp->p;
+                return 0;
+            }
+            for (;;) {
+                do {
+                    if (tp_key(tp, scratch, &s, &len)) {
+                        return -1;
+                    }
+                } while (tp->p < tp->end && *tp->p == '.' && ++tp->p);
+                if (tp->p >= tp->end || *tp->p != '=') {
+                    return tp_fail(tp, "expected '='");
+                }
+                ++tp->p;
+                tp_ws(tp);
+                if (tp_skip(tp)) {
+                    return -1;
+                }
+                tp_ws(tp);
+                if (tp->p < tp->end && *tp->p == ',') {
+                    ++tp->p;
+                } else if (tp->p < tp->end && *tp->p == '}') {
+                    ++tp->p;
+                    return 0;
+                } else {
+                    return tp_fail(tp, "expected ',' or '}'");
+                }
+            }
+
+        default:
+            /* Numbers, booleans and date-times */
+            s = tp->p;
+            while (tp->p < tp->end && (tp_is_bare(*tp->p) || *tp->p == '+' || *tp->p == '.' || *tp->p == ':'
+                        || (*tp->p == ' ' && tp->end - tp->p > 1 && tp->p[1] >= '0' && tp->p[1] <= '9'))) {
+                ++tp->p;
+            }
+            if (tp->p == s) {
+                return tp_fail(tp, "expected a value");
+            }
+            return 0;
+    }
+}
+
+)rt";
+
+// Emits fn(salt, key, len), returning the value of a key in O(1) or -1
+void Writer::c_phash(const std::string& fn, const std::vector<std::pair<uint32_t, std::string>>& keys, const std::vector<int>& values) {
+    const PerfectHash ph(keys);
+    const std::string r = std::to_string(ph.seeds.size());
+    const std::string m = std::to_string(ph.slots.size());
+
+    if (!this->phash_emitted) {
+        this->phash_emitted = true;
+        this->out += R"(static uint32_t phash(uint32_t seed, uint32_t salt, const char* key, size_t len) {
+    uint32_t h = 2166136261u ^ seed * 0x9E3779B9u ^ salt * 0x85EBCA6Bu;
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ (unsigned char)key[i]) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+)";
+    }
+
+    this->put("static const uint32_t ", fn, "_seeds[", r, "] = {");
+    for (size_t i = 0; i < ph.seeds.size(); ++i) {
+        this->put((i % 16 ? " " : "\n    "), std::to_string(ph.seeds[i]), ",");
+    }
+    this->out += "\n};\n\n";
+    this->put("static const struct {\n    const char* key;\n    uint32_t len;\n    uint32_t salt;\n    int value;\n} ", fn, "_slots[", m, "] = {\n");
+    for (size_t i = 0; i < ph.slots.size(); ++i) {
+        if (ph.slots[i] < 0) {
+            continue;
+        }
+        const auto& k = keys[ph.slots[i]];
+        this->out += "    [" + std::to_string(i) + "] = { \"" + cstr(k.second) + "\", " + std::to_string(k.second.size()) + ", "
+            + std::to_string(k.first) + ", " + std::to_string(values[ph.slots[i]]) + " },\n";
+    }
+    this->out += "};\n\n";
+
+    this->put("static int ", fn, "(uint32_t salt, const char* key, size_t len) {\n");
+    this->put("    const uint32_t seed = ", fn, "_seeds[phash(0, salt, key, len) & ", std::to_string(ph.seeds.size() - 1), "];\n");
+    this->put("    const uint32_t slot = phash(seed, salt, key, len) & ", std::to_string(ph.slots.size() - 1), ";\n\n");
+    this->put("    if (", fn, "_slots[slot].key && ", fn, "_slots[slot].len == len && ", fn, "_slots[slot].salt == salt\n");
+    this->put("            && 0 == memcmp(", fn, "_slots[slot].key, key, len)) {\n");
+    this->put("        return ", fn, "_slots[slot].value;\n");
+    this->out += "    }\n    return -1;\n}\n\n";
+}
+
+// The tp_* runtime and the key dispatch shared by --direct and --stream:
+// table names, which tables are arrays, and _key, _child, _array and _field
+void Writer::c_dispatch(const Table& root) {
+    const std::string base_name = root.name.substr(0, root.name.size()-2);
+    const std::vector<const Table*> tables = schema_tables(root);
+    auto table_id = [&] (const Table* t)->int {
+        return std::find(tables.begin(), tables.end(), t) - tables.begin();
+    };
+    const bool arrays = std::any_of(tables.begin(), tables.end(), [] (const Table* t) { return t->array; });
+
+    if (this->dispatch_emitted) {
+        return;
+    }
+    this->dispatch_emitted = true;
+    this->out += direct_runtime;
+
+    // Table names, for reporting missing ones
+    this->put("static const char* ", base_name, "_table_names[] = {\n");
+    for (const Table* t: tables) {
+        this->put("    \"", cstr(t->parent ? key_path(*t->parent, t->name) : ""), "\",\n");
+    }
+    this->out += "};\n\n";
+    if (arrays) {
+        this->out += "/* Which tables are arrays of tables, opened by [[name]] */\n";
+        this->put("static const char ", base_name, "_arrays[] = {");
+        for (const Table* t: tables) {
+            this->put(t == tables.front() ? "" : ", ", t->array ? "1" : "0");
+        }
+        this->out += "};\n\n";
+    }
+
+    // Key dispatch: fields map to their id, child tables to -2 - their id
+    std::vector<std::pair<uint32_t, std::string>> keys;
+    std::vector<int> values;
+    int n_fields = 0;
+    for (const Table* t: tables) {
+        for (const Field& f: t->fields) {
+            keys.emplace_back(table_id(t), f.key);
+            values.push_back(n_fields++);
+        }
+        for (const Table* c: t->children) {
+            keys.emplace_back(table_id(t), c->name);
+            values.push_back(-2 - table_id(c));
+        }
+    }
+    this->c_phash(base_name + "_key", keys, values);
+
+    this->put("static int ", base_name, "_child(int table, const char* key, size_t len) {\n");
+    this->put("    int v = ", base_name, "_key(table, key, len);\n");
+    if (arrays) {
+        this->put("    return v <= -2 && !", base_name, "_arrays[-2 - v] ? -2 - v : -1;\n}\n\n");
+        this->put("static int ", base_name, "_array(int table, const char* key, size_t len) {\n");
+        this->put("    int v = ", base_name, "_key(table, key, len);\n");
+        this->put("    return v <= -2 && ", base_name, "_arrays[-2 - v] ? -2 - v : -1;\n}\n\n");
+    } else {
+        this->out += "    return v <= -2 ? -2 - v : -1;\n}\n\n";
+    }
+    this->put("static int ", base_name, "_field(int table, const char* key, size_t len) {\n");
+    this->put("    int v = ", base_name, "_key(table, key, len);\n");
+    this->out += "    return v >= 0 ? v : -1;\n}\n\n";
+
+    // The parsers mark the fields they set in seen, after the tables. An
+    // entry of an array of tables starts over with its own fields.
+    if (arrays) {
+        const std::string n_tables = std::to_string(tables.size());
+        this->out += "/* The first field of each table, fields are numbered table by table */\n";
+        this->put("static const int ", base_name, "_first_field[] = {");
+        int first = 0;
+        for (const Table* t: tables) {
+            this->put(t == tables.front() ? "" : ", ", std::to_string(first));
+            first += t->fields.size();
+        }
+        this->put(", ", std::to_string(first), "};\n\n");
+        this->put("static void ", base_name, "_fresh(char* seen, int table) {\n");
+        this->put("    memset(seen + ", n_tables, " + ", base_name, "_first_field[table], 0, ");
+        this->put(base_name, "_first_field[table + 1] - ", base_name, "_first_field[table]);\n}\n\n");
+    }
+}
+
+// The body of a case storing the value at tp->p into the field f of t, at
+// dst and its length at len
+void Writer::c_tp_store(const Table& t, const Field& f, const std::string& dst, const std::string& len) {
+    std::string parse;
+    std::string size;
+    switch (f.type) {
+        case Field::Type::t_int:
+            this->put("            return tp_int(tp, &", dst, ");\n");
+            break;
+        case Field::Type::t_double:
+            this->put("            return tp_double(tp, &", dst, ");\n");
+            break;
+        case Field::Type::t_bool:
+            if (f.packed) {
+                this->out += "            rc = tp_bool(tp, &b);\n";
+                this->put("            ", this->bit(this->ptr, t, f, "b"), ";\n");
+                this->out += "            return rc;\n";
+            } else {
+                this->put("            return tp_bool(tp, &", dst, ");\n");
+            }
+            break;
+        case Field::Type::t_string:
+            if (f.cap) {
+                // Parsed on the heap, then copied in when it fits
+                this->out += "            if ((rc = tp_string(tp, &s)) == 0) {\n";
+                this->put("                if (strlen(s) >= ", std::to_string(f.cap), ") {\n");
+                this->put("                    rc = tp_fail(tp, \"", cstr(key_path(t, f.key)), " is longer than ", std::to_string(f.cap - 1), " bytes\");\n");
+                this->out += "                } else {\n";
+                this->put("                    strcpy(", dst, ", s);\n");
+                this->out += "                }\n            }\n";
+                this->out += "            free(s);\n            return rc;\n";
+                break;
+            }
+            this->put("            free(", dst, ");\n");
+            this->put("            ", dst, " = NULL;\n");
+            this->put("            return tp_string(tp, &", dst, ");\n");
+            break;
+        case Field::Type::t_enum:
+            this->out += "            if ((rc = tp_string(tp, &s)) == 0) {\n";
+            this->put("                const int e = ", this->enum_of(f, "s"), ";\n");
+            this->out += "                if (e < 0) {\n";
+            this->put("                    rc = tp_fail(tp, \"", cstr(key_path(t, f.key)), " is not one of ", cstr(enum_list(f)), "\");\n");
+            this->out += "                } else {\n";
+            this->put("                    ", dst, " = e;\n");
+            this->out += "                }\n            }\n";
+            this->out += "            free(s);\n            return rc;\n";
+            break;
+
+        case Field::Type::t_array_of_int:
+            parse = "tp_numbers(tp, &arr, &n, 0)"; size = "int64_t"; break;
+        case Field::Type::t_array_of_double:
+            parse = "tp_numbers(tp, &arr, &n, 1)"; size = "double"; break;
+        case Field::Type::t_array_of_bool:
+            parse = "tp_array(tp, &arr, &n, sizeof(bool), tp_bool_el)"; size = "bool"; break;
+        case Field::Type::t_array_of_string:
+            this->put("            for (size_t i = 0; i < ", len, "; ++i) {\n");
+            this->put("                free(", dst, "[i]);\n");
+            this->out += "            }\n";
+            parse = "tp_array(tp, &arr, &n, sizeof(char*), tp_string_el)"; size = "char*"; break;
+
+        default:
+            this->out += "            return tp_skip(tp);\n";
+            break;
+    }
+    if (!parse.empty() && f.cap) {
+        this->out += "            STATS_START();\n";
+        this->put("            if ((rc = ", parse, ") == 0) {\n");
+        this->put("                if (n > ", std::to_string(f.cap), ") {\n");
+        this->put("                    rc = tp_fail(tp, \"", cstr(key_path(t, f.key)), " has more than ", std::to_string(f.cap), " elements\");\n");
+        this->out += "                } else {\n";
+        this->put("                    if (n) memcpy(", dst, ", arr, n * sizeof(", size, "));\n");
+        this->put("                    ", len, " = n;\n");
+        this->out += "                }\n            }\n";
+        this->out += "            free(arr);\n            STATS_STOP(arrays_ns);\n            return rc;\n";
+    } else if (!parse.empty() && f.packed) {
+        // Parsed as bools, then folded into bits
+        this->put("            free(", dst, ");\n");
+        this->out += "            STATS_START();\n";
+        this->put("            rc = ", parse, ";\n");
+        this->put("            ", dst, " = calloc((n + 7) / 8, 1);\n");
+        this->put("            for (size_t i = 0; ", dst, " && i < n; ++i) {\n");
+        this->put("                ", dst, "[i >> 3] |= (uint8_t)(((bool*)arr)[i] << (i & 7));\n");
+        this->out += "            }\n";
+        this->out += "            free(arr);\n";
+        this->put("            ", len, " = ", dst, " ? n : 0;\n");
+        this->out += "            STATS_STOP(arrays_ns);\n";
+        this->out += "            return rc;\n";
+    } else if (!parse.empty()) {
+        this->put("            free(", dst, ");\n");
+        this->out += "            STATS_START();\n";
+        this->put("            rc = ", parse, ";\n");
+        this->put("            ", dst, " = arr;\n");
+        this->put("            ", len, " = n;\n");
+        this->out += "            STATS_STOP(arrays_ns);\n";
+        this->out += "            return rc;\n";
+    }
+}
+
+void Writer::c_direct(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+
+    const std::vector<const Table*> tables = schema_tables(root);
+    auto table_id = [&] (const Table* t)->int {
+        return std::find(tables.begin(), tables.end(), t) - tables.begin();
+    };
+
+    const bool arrays = std::any_of(tables.begin(), tables.end(), [] (const Table* t) { return t->array; });
+
+    this->c_dispatch(root);
+
+    this->put("#ifdef ", mvar(LIB_BASE_NAMEu), "STATS\n");
+    this->out += "/* The top-level table each table belongs to, for the stats */\n";
+    this->put("static const int ", base_name, "_stats_top[] = {");
+    for (const Table* t: tables) {
+        const Table* top = t;
+        while (top->parent && top->parent->parent) {
+            top = top->parent;
+        }
+        const auto& c = root.children;
+        const int i = top->parent ? std::find(c.begin(), c.end(), top) - c.begin() : -1;
+        this->put(t == tables.front() ? "" : ", ", std::to_string(i));
+    }
+    this->out += "};\n#endif\n\n";
+
+    // New entries of arrays of tables, zeroed. Storage grows at powers of two.
+    if (arrays) {
+        this->put("static int ", base_name, "_append(", name, "* ", this->ptr, ", int table) {\n");
+        this->out += "    void* grown;\n    size_t n;\n\n";
+        this->out += "    switch (table) {\n";
+        for (const Table* t: tables) {
+            if (!t->array) {
+                continue;
+            }
+            std::vector<std::string> blocks;
+            if (this->opts.soa) {
+                for (const Field& f: t->fields) {
+                    blocks.push_back(this->ptr + "->" + t->var + f.name);
+                    if (f.type >= Field::Type::t_array) {
+                        blocks.push_back(this->ptr + "->" + t->var + f.name + "_len");
+                    }
+                }
+            } else {
+                blocks.push_back(this->ptr + "->" + t->var.substr(0, t->var.size()-1));
+            }
+            this->put("        case ", std::to_string(table_id(t)), ": /* ", cstr(key_path(*t->parent, t->name)), " */\n");
+            this->put("            n = ", this->count(this->ptr, *t), ";\n");
+            this->out += "            if ((n & (n - 1)) == 0) {\n";
+            for (const std::string& b: blocks) {
+                this->put("                if (!(grown = realloc(", b, ", (n ? 2 * n : 1) * sizeof(*", b, ")))) {\n");
+                this->out += "                    return -1;\n                }\n";
+                this->put("                ", b, " = grown;\n");
+            }
+            this->out += "            }\n";
+            for (const std::string& b: blocks) {
+                this->put("            memset(&", b, "[n], 0, sizeof(*", b, "));\n");
+            }
+            this->put("            ", this->count(this->ptr, *t), " = n + 1;\n");
+            this->out += "            return 0;\n";
+        }
+        this->out += "    }\n    return -1;\n}\n\n";
+    }
+
+    // Typed stores into the struct, into the last entry for arrays of tables
+    this->put("static int ", base_name, "_value(tp_t* tp, ", name, "* ", this->ptr, ", int field) {\n");
+    const bool array_fields = std::any_of(tables.begin(), tables.end(), [] (const Table* t) {
+        return std::any_of(t->fields.begin(), t->fields.end(), [] (const Field& f) { return f.type > Field::Type::t_array; });
+    });
+    const bool packed = std::any_of(tables.begin(), tables.end(), [] (const Table* t) {
+        return std::any_of(t->fields.begin(), t->fields.end(), [] (const Field& f) { return f.packed && f.type == Field::Type::t_bool; });
+    });
+    const bool fixed = std::any_of(tables.begin(), tables.end(), [] (const Table* t) {
+        return std::any_of(t->fields.begin(), t->fields.end(), [] (const Field& f) {
+            return (f.cap && f.type == Field::Type::t_string) || f.type == Field::Type::t_enum;
+        });
+    });
+    this->out += array_fields ? "    void* arr = NULL;\n    size_t n = 0;\n" : "";
+    this->out += array_fields || packed || fixed ? "    int rc;\n" : "";
+    this->out += packed ? "    bool b = false;\n" : "";
+    this->out += fixed ? "    char* s = NULL;\n" : "";
+    this->out += array_fields || packed || fixed ? "\n    switch (field) {\n" : "    switch (field) {\n";
+    int n_fields = 0;
+    for (const Table* t: tables) {
+        for (const Field& f: t->fields) {
+            const std::string last = t->array ? this->count(this->ptr, *t) + " - 1" : "";
+            const std::string dst = this->member(this->ptr, *t, f, last);
+            const std::string len = this->member(this->ptr, *t, f, last, "_len");
+            this->put("        case ", std::to_string(n_fields++), ": /* ", cstr(key_path(*t, f.key)), " */\n");
+            this->c_tp_store(*t, f, dst, len);
+        }
+    }
+    this->out += "    }\n    return tp_skip(tp);\n}\n\n";
+
+    // Statements
+    // seen holds a mark per table, then one per field
+    const std::string n_tables = std::to_string(tables.size());
+    const std::string ctx = "tp_t* tp, " + name + "* " + this->ptr + ", int table, char* seen";
+    this->put("static int ", base_name, "_inline(", ctx, ");\n");
+    if (arrays) {
+        this->put("static int ", base_name, "_entries(", ctx, ");\n");
+    }
+    this->out += "\n";
+    this->out += "/* Parses key = value, with the key relative to table. */\n";
+    this->put("static int ", base_name, "_keyval(", ctx, ") {");
+    this->out += R"(
+    char scratch[TP_KEY_MAX];
+    const char* key;
+    size_t len;
+    int field;
+
+    if (tp_key(tp, scratch, &key, &len)) {
+        return -1;
+    }
+    while (tp->p < tp->end && *tp->p == '.') {
+        ++tp->p;
+        if (table >= 0 && (table = )" + base_name + R"(_child(table, key, len)) >= 0) {
+            seen[table] = 1;
+        }
+        if (tp_key(tp, scratch, &key, &len)) {
+            return -1;
+        }
+    }
+    if (tp->p >= tp->end || *tp->p != '=') {
+        return tp_fail(tp, "expected '='");
+    }
+    ++tp->p;
+    tp_ws(tp);
+    if (table >= 0 && (field = )" + base_name + R"(_field(table, key, len)) >= 0) {
+        if (seen[)" + n_tables + R"( + field]) {
+            return tp_fail(tp, "key exists");
+        }
+        seen[)" + n_tables + R"( + field] = 1;
+        return )" + base_name + "_value(tp, " + this->ptr + R"(, field);
+    }
+    if (table >= 0 && tp->p < tp->end && *tp->p == '{' && (table = )" + base_name + R"(_child(table, key, len)) >= 0) {
+        seen[table] = 1;
+        return )" + base_name + "_inline(tp, " + this->ptr + R"(, table, seen);
+    }
+)" + (arrays ? R"(    if (table >= 0 && tp->p < tp->end && *tp->p == '[' && (table = )" + base_name + R"(_array(table, key, len)) >= 0) {
+        return )" + base_name + "_entries(tp, " + this->ptr + R"(, table, seen);
+    }
+)" : "") + R"(    return tp_skip(tp);
+}
+
+)";
+    this->put("static int ", base_name, "_inline(", ctx, ") {");
+    this->out += R"(
+    ++tp->p;
+    tp_ws(tp);
+    if (tp->p < tp->end && *tp->p == '}') {
+        ++tp->p;
+        return 0;
+    }
+    for (;;) {
+        if ()" + base_name + "_keyval(tp, " + this->ptr + R"(, table, seen)) {
+            return -1;
+        }
+        tp_ws(tp);
+        if (tp->p < tp->end && *tp->p == ',') {
+            ++tp->p;
+        } else if (tp->p < tp->end && *tp->p == '}') {
+            ++tp->p;
+            return 0;
+        } else {
+            return tp_fail(tp, "expected ',' or '}'");
+        }
+    }
+}
+
+)";
+    if (arrays) {
+        this->out += "/* Parses an inline array of tables, one entry per {...}. */\n";
+        this->put("static int ", base_name, "_entries(", ctx, ") {");
+        this->out += R"(
+    ++tp->p;
+    for (;;) {
+        tp_wsnl(tp);
+        if (tp->p < tp->end && *tp->p == ']') {
+            ++tp->p;
+            return 0;
+        }
+        if (tp->p >= tp->end || *tp->p != '{') {
+            return tp_fail(tp, "expected '{'");
+        }
+        if ()" + base_name + "_append(" + this->ptr + R"(, table)) {
+            return tp_fail(tp, "out of memory");
+        }
+        )" + base_name + R"(_fresh(seen, table);
+        if ()" + base_name + "_inline(tp, " + this->ptr + R"(, table, seen)) {
+            return -1;
+        }
+        tp_wsnl(tp);
+        if (tp->p < tp->end && *tp->p == ',') {
+            ++tp->p;
+        } else if (tp->p < tp->end && *tp->p == ']') {
+            ++tp->p;
+            return 0;
+        } else {
+            return tp_fail(tp, "expected ',' or ']'");
+        }
+    }
+}
+
+)";
+    }
+
+    // Document
+    // Arrays of tables may be missing, as if they had no entries
+    std::string seen;
+    for (const Table* t: tables) {
+        seen += std::string(seen.empty() ? "" : ", ") + (t->array || t == tables.front() ? "1" : "0");
+    }
+    this->put("static int ", base_name, "_parse(tp_t* tp, ", name, "* ", this->ptr, ") {");
+    this->out += R"(
+    char seen[)" + n_tables + " + " + std::to_string(n_fields) + "] = {" + seen + R"(};
+    char scratch[TP_KEY_MAX];
+    const char* key;
+    size_t len;
+    int table = 0;
+    int last;
+
+    if (tp->end - tp->p >= 3 && 0 == memcmp(tp->p, "\xEF\xBB\xBF", 3)) {
+        tp->p += 3;
+    }
+    for (;;) {
+        tp_wsnl(tp);
+        if (tp->p >= tp->end) {
+            break;
+        }
+        if (*tp->p == '[') {
+            const int array = tp->end - tp->p >= 2 && tp->p[1] == '[';
+            tp->p += array ? 2 : 1;
+            table = 0;
+            for (;;) {
+                if (tp_key(tp, scratch, &key, &len)) {
+                    return -1;
+                }
+                last = tp->p >= tp->end || *tp->p != '.';
+                if (table >= 0) {
+                    table = )" + (arrays ? "last && array ? " + base_name + "_array(table, key, len) : " : "") + base_name + R"(_child(table, key, len);
+                }
+                if (last) {
+                    break;
+                }
+                ++tp->p;
+            }
+            if (tp->end - tp->p < 1 + array || tp->p[0] != ']' || (array && tp->p[1] != ']')) {
+                return tp_fail(tp, "expected ']'");
+            }
+            tp->p += 1 + array;
+)" + (arrays ? R"(            if (table >= 0 && array) {
+                if ()" + base_name + "_append(" + this->ptr + R"(, table)) {
+                    return tp_fail(tp, "out of memory");
+                }
+                )" + base_name + R"(_fresh(seen, table);
+            }
+)" : R"(            /* Arrays of tables are not part of the schema */
+            if (array) {
+                table = -1;
+            }
+)") + R"(            STATS_TABLE(table >= 0 ? )" + base_name + R"(_stats_top[table] : -1);
+            if (table >= 0) {
+                seen[table] = 1;
+            }
+        } else if ()" + base_name + "_keyval(tp, " + this->ptr + R"(, table, seen)) {
+            return -1;
+        }
+        if (tp_eol(tp)) {
+            return -1;
+        }
+    }
+    STATS_TABLE(-1);
+    for (int i = 0; i < )" + n_tables + R"(; ++i) {
+        if (!seen[i]) {
+            snprintf(tp->err, tp->errsz, "failed locating [%s] table", )" + base_name + R"(_table_names[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+)";
+
+    // Text
+    this->put("static int ", base_name, "_text(const char* buf, size_t len, int terminated, ", name, "** ", this->ptr, ", const char* fn, const char* src) {");
+    this->out += R"(
+    char errbuf[200] = "";
+    tp_t tp;
+    int rc;
+
+    (void)terminated;
+    if (*)" + this->ptr + R"( == NULL) {
+        *)" + this->ptr + " = calloc(1, sizeof(" + name + R"());
+    } else {
+        )" + base_name + "_clear(*" + this->ptr + R"();
+    }
+)" + (this->opts.cold.empty() ? "" : "    if (0 == ((*" + this->ptr + ")->" + LIB_BASE_NAMEu + "cold = calloc(1, sizeof(" + base_name + "_cold_t)))) {\n        "
+        + base_name + "_error(\"%s() failed: out of memory\", fn);\n        return 1;\n    }\n") + R"(
+    /* Run the text through the parser. */
+    tp.start = tp.p = buf;
+    tp.end = buf + len;
+    tp.err = errbuf;
+    tp.errsz = sizeof(errbuf);
+    tp.line = 0;
+    STATS_START();
+    rc = )" + base_name + "_parse(&tp, *" + this->ptr + R"();
+    STATS_STOP(parse_ns);
+    if (rc) {
+        )" + base_name + R"(_error("%s() failed: error while parsing %s: %s", fn, src, errbuf);
+        return 1;
+    }
+    return 0;
+}
+
+)";
+}
+
+static const char* stream_runtime = R"rt(/* Streaming reader. The text is read in chunks into a window that always
+ * holds the unit being parsed whole: a statement, an element of an array,
+ * or an inline table. A unit that fails to parse because the window ends
+ * inside it is parsed again once more text has been read. */
+#ifndef T2C_STREAM_CHUNK
+#define T2C_STREAM_CHUNK 65536
+#endif
+#define TS_RUN 512
+
+enum { TS_SKIP, TS_INT, TS_DOUBLE, TS_BOOL, TS_STRING };
+
+typedef struct {
+    tp_t tp;
+    int fd;
+    char* buf;
+    size_t cap;
+    int eof;
+    int fixed;      /* the unit is known to be whole: no more reading */
+    int fatal;      /* the error stands, or a callback stopped the stream */
+    int stop;       /* what the callback returned */
+} ts_t;
+
+/* Hands n values, from the first-th on, to the callback of field. For
+ * strings v is one string, n its length and first its index. */
+typedef int (*ts_run_t)(void* arg, int field, size_t first, const void* v, size_t n);
+
+/* Keeps the text from mark on, moved to the front of the window, and fills
+ * the rest. The window doubles when what is kept fills half of it. */
+static int ts_more(ts_t* s, const char* mark) {
+    const size_t keep = s->tp.end - mark;
+    size_t len = keep;
+    ssize_t got;
+
+    for (const char* c = s->buf; (c = memchr(c, '\n', mark - c)); ++c) {
+        ++s->tp.line;
+    }
+    memmove(s->buf, mark, keep);
+    if (keep > s->cap / 2) {
+        char* grown = realloc(s->buf, 2 * s->cap);
+        if (!grown) {
+            s->fatal = 1;
+            return tp_fail(&s->tp, "out of memory");
+        }
+        s->buf = grown;
+        s->cap *= 2;
+    }
+    while (len < s->cap && !s->eof) {
+        if ((got = read(s->fd, s->buf + len, s->cap - len)) < 0 && errno != EINTR) {
+            s->fatal = 1;
+            return tp_fail(&s->tp, "couldn't read the file");
+        }
+        s->eof = got == 0;
+        len += got > 0 ? got : 0;
+    }
+    s->tp.start = s->tp.p = s->buf;
+    s->tp.end = s->buf + len;
+    return 0;
+}
+
+/* Called when the unit at mark failed. Returns 0, with more text read, when
+ * the window may have ended inside the unit: there is more to read and no
+ * newline after the point of failure. Otherwise the error stands. */
+static int ts_retry(ts_t* s, const char* mark) {
+    if (s->fatal || s->fixed || s->eof || memchr(s->tp.p, '\n', s->tp.end - s->tp.p)) {
+        s->fatal = 1;
+        return -1;
+    }
+    s->tp.err[0] = '\0';
+    return ts_more(s, mark);
+}
+
+/* A scalar ends at the first character that is not part of it, which must
+ * be in the window. */
+static int ts_done(ts_t* s) {
+    return s->tp.p < s->tp.end || s->eof ? 0 : tp_fail(&s->tp, "unexpected end of window");
+}
+
+/* Records what a callback returned: anything but 0 stops the stream. */
+static int ts_stop(ts_t* s, int rc) {
+    if (rc) {
+        s->stop = rc;
+        s->fatal = 1;
+        return -1;
+    }
+    return 0;
+}
+
+/* An error in a value that was read whole. */
+static inline int ts_error(ts_t* s, const char* msg) {
+    s->fatal = 1;
+    return tp_fail(&s->tp, msg);
+}
+
+/* The end of a line, with its newline in the window unless the file ended. */
+static int ts_eol(ts_t* s) {
+    for (;;) {
+        const char* mark = s->tp.p;
+        if (0 == tp_eol(&s->tp) && (s->eof || (s->tp.p > mark && s->tp.p[-1] == '\n'))) {
+            return 0;
+        }
+        if (ts_retry(s, mark)) {
+            return -1;
+        }
+    }
+}
+
+/* Reads the array at tp.p one element at a time, and hands the elements to
+ * run in runs of up to TS_RUN, strings one by one. */
+static int ts_list(ts_t* s, int kind, int field, ts_run_t run, void* arg) {
+    tp_t* tp = &s->tp;
+    union {
+        int64_t i[TS_RUN];
+        double d[TS_RUN];
+        bool b[TS_RUN];
+    } v;
+    size_t first = 0;
+    size_t n = 0;
+
+    /* A value past the window is read with the rest of the statement */
+    if (tp->p >= tp->end && !s->eof) {
+        return tp_fail(tp, "unexpected end of window");
+    }
+    if (tp->p >= tp->end || *tp->p != '[') {
+        return ts_error(s, "expected an array");
+    }
+    ++tp->p;
+    for (;;) {
+        const char* mark = tp->p;
+        char* str = NULL;
+        int rc;
+
+        tp_wsnl(tp);
+        if (tp->p < tp->end && *tp->p == ']') {
+            break;
+        }
+        switch (kind) {
+            case TS_INT: rc = tp_int(tp, &v.i[n]); break;
+            case TS_DOUBLE: rc = tp_double(tp, &v.d[n]); break;
+            case TS_BOOL: rc = tp_bool(tp, &v.b[n]); break;
+            case TS_STRING: rc = tp_string(tp, &str); break;
+            default: rc = tp_skip(tp); break;
+        }
+        if (rc == 0) {
+            tp_wsnl(tp);
+            if (tp->p < tp->end && *tp->p == ',') {
+                ++tp->p;
+            } else if (tp->p >= tp->end || *tp->p != ']') {
+                rc = tp_fail(tp, "expected ',' or ']'");
+            }
+        }
+        if (rc) {
+            free(str);
+            if (ts_retry(s, mark)) {
+                return -1;
+            }
+            continue;
+        }
+        if (kind == TS_STRING) {
+            rc = run ? run(arg, field, first++, str, strlen(str)) : 0;
+            free(str);
+        } else if (kind != TS_SKIP && ++n == TS_RUN) {
+            rc = run ? run(arg, field, first, &v, n) : 0;
+            first += n;
+            n = 0;
+        }
+        if (ts_stop(s, rc)) {
+            return -1;
+        }
+    }
+    ++tp->p;
+    return n && run ? ts_stop(s, run(arg, field, first, &v, n)) : 0;
+}
+
+)rt";
+
+// --stream: _stream() reads the file in chunks and hands every value outside
+// the arrays of tables to its callback, and every entry of an array of
+// tables, filled in, to the table's callback. Only the window and the entry
+// being filled are held in memory.
+void Writer::c_stream(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+    const std::string cb_t = base_name + "_callbacks_t";
+    const std::string st_t = base_name + "_stream_t";
+
+    const std::vector<const Table*> tables = schema_tables(root);
+    auto table_id = [&] (const Table* t)->int {
+        return std::find(tables.begin(), tables.end(), t) - tables.begin();
+    };
+    const bool arrays = std::any_of(tables.begin(), tables.end(), [] (const Table* t) { return t->array; });
+    auto entry = [&] (const Table* t) {
+        return "st->e" + std::to_string(table_id(t));
+    };
+
+    this->c_dispatch(root);
+    this->out += stream_runtime;
+
+    this->put("typedef struct {\n    ts_t s;\n    const ", cb_t, "* cb;\n    void* ctx;\n");
+    if (arrays) {
+        this->out += "    int entry;                  /* the array of tables being filled, or -1 */\n";
+        this->put("    size_t count[", std::to_string(tables.size()), "];\n");
+        for (const Table* t: tables) {
+            if (t->array) {
+                this->put("    struct ", base_name, t->path.substr(4), " ", entry(t).substr(4), ";\n");
+            }
+        }
+    }
+    this->put("} ", st_t, ";\n\n");
+
+    // Arrays outside the arrays of tables, handed over in runs
+    int n_fields = 0;
+    std::string runs;
+    for (const Table* t: tables) {
+        for (const Field& f: t->fields) {
+            const int id = n_fields++;
+            if (t->array || f.type <= Field::Type::t_array) {
+                continue;
+            }
+            const std::string cb = "st->cb->" + callback_name(*t, &f);
+            runs += "        case " + std::to_string(id) + ": /* " + cstr(key_path(*t, f.key)) + " */\n";
+            runs += "            return " + cb + " ? " + cb + "(st->ctx, first, ";
+            switch (f.type) {
+                case Field::Type::t_array_of_int: runs += "(const int64_t*)v, n) : 0;\n"; break;
+                case Field::Type::t_array_of_double: runs += "(const double*)v, n) : 0;\n"; break;
+                case Field::Type::t_array_of_bool: runs += "(const bool*)v, n) : 0;\n"; break;
+                default: runs += "(const char*)v, n) : 0;\n"; break;
+            }
+        }
+    }
+    if (!runs.empty()) {
+        this->put("static int ", base_name, "_stream_run(void* arg, int field, size_t first, const void* v, size_t n) {\n");
+        this->put("    ", st_t, "* st = arg;\n\n    switch (field) {\n");
+        this->out += runs;
+        this->out += "    }\n    return 0;\n}\n\n";
+    }
+    const std::string run = runs.empty() ? "NULL" : base_name + "_stream_run";
+
+    // Entries of arrays of tables: stored like --direct does, then handed
+    // over and cleared
+    if (arrays) {
+        auto entries_have = [&] (const std::function<bool(const Field&)>& pred) {
+            return std::any_of(tables.begin(), tables.end(), [&] (const Table* t) {
+                return t->array && std::any_of(t->fields.begin(), t->fields.end(), pred);
+            });
+        };
+        const bool array_fields = entries_have([] (const Field& f) { return f.type > Field::Type::t_array; });
+        const bool fixed = entries_have([] (const Field& f) {
+            return (f.cap && f.type == Field::Type::t_string) || f.type == Field::Type::t_enum;
+        });
+        this->put("static int ", base_name, "_stream_store(tp_t* tp, ", st_t, "* st, int field) {\n");
+        this->out += array_fields ? "    void* arr = NULL;\n    size_t n = 0;\n" : "";
+        this->out += array_fields || fixed ? "    int rc;\n" : "";
+        this->out += fixed ? "    char* s = NULL;\n" : "";
+        this->out += array_fields || fixed ? "\n    switch (field) {\n" : "    switch (field) {\n";
+        n_fields = 0;
+        for (const Table* t: tables) {
+            for (const Field& f: t->fields) {
+                const int id = n_fields++;
+                if (!t->array) {
+                    continue;
+                }
+                this->put("        case ", std::to_string(id), ": /* ", cstr(key_path(*t, f.key)), " */\n");
+                this->c_tp_store(*t, f, entry(t) + "." + f.name, entry(t) + "." + f.name + "_len");
+            }
+        }
+        this->out += "    }\n    return tp_skip(tp);\n}\n\n";
+
+        this->put("static void ", base_name, "_stream_clear(", st_t, "* st, int table) {\n");
+        this->out += "    switch (table) {\n";
+        for (const Table* t: tables) {
+            if (!t->array) {
+                continue;
+            }
+            const std::string e = entry(t);
+            this->put("        case ", std::to_string(table_id(t)), ": /* ", cstr(key_path(*t->parent, t->name)), " */\n");
+            for (const Field& f: t->fields) {
+                if (f.cap) {
+                    continue;
+                }
+                if (f.type == Field::Type::t_array_of_string) {
+                    this->put("            for (size_t i = 0; i < ", e, ".", f.name, "_len; ++i) {\n");
+                    this->put("                free(", e, ".", f.name, "[i]);\n            }\n");
+                }
+                if (f.type == Field::Type::t_string || f.type > Field::Type::t_array) {
+                    this->put("            free(", e, ".", f.name, ");\n");
+                }
+            }
+            this->put("            memset(&", e, ", 0, sizeof(", e, "));\n");
+            this->out += "            break;\n";
+        }
+        this->out += "    }\n}\n\n";
+
+        this->out += "/* Hands the entry being filled to its callback and clears it. */\n";
+        this->put("static int ", base_name, "_stream_flush(", st_t, "* st) {\n");
+        this->out += "    const int table = st->entry;\n    int rc = 0;\n\n";
+        this->out += "    st->entry = -1;\n";
+        this->out += "    switch (table) {\n";
+        for (const Table* t: tables) {
+            if (!t->array) {
+                continue;
+            }
+            const std::string cb = "st->cb->" + callback_name(*t, nullptr);
+            this->put("        case ", std::to_string(table_id(t)), ": /* ", cstr(key_path(*t->parent, t->name)), " */\n");
+            this->put("            rc = ", cb, " ? ", cb, "(st->ctx, st->count[table], &", entry(t), ") : 0;\n");
+            this->out += "            break;\n";
+        }
+        this->out += "        default:\n            return 0;\n    }\n";
+        this->out += "    ++st->count[table];\n";
+        this->put("    ", base_name, "_stream_clear(st, table);\n");
+        this->out += "    return ts_stop(&st->s, rc);\n}\n\n";
+    }
+
+    // Values: scalars go to their callback once they are whole, arrays
+    // element by element, and fields of entries into the entry
+    const bool enums = std::any_of(tables.begin(), tables.end(), [] (const Table* t) {
+        return !t->array && std::any_of(t->fields.begin(), t->fields.end(), [] (const Field& f) { return f.type == Field::Type::t_enum; });
+    });
+    auto outside_have = [&] (Field::Type type) {
+        return std::any_of(tables.begin(), tables.end(), [&] (const Table* t) {
+            return !t->array && std::any_of(t->fields.begin(), t->fields.end(), [&] (const Field& f) { return f.type == type; });
+        });
+    };
+    const bool strings = outside_have(Field::Type::t_string) || enums;
+    this->put("static int ", base_name, "_stream_value(", st_t, "* st, int field) {\n");
+    this->out += "    tp_t* tp = &st->s.tp;\n";
+    this->out += outside_have(Field::Type::t_int) ? "    int64_t i;\n" : "";
+    this->out += outside_have(Field::Type::t_double) ? "    double d;\n" : "";
+    this->out += outside_have(Field::Type::t_bool) ? "    bool b;\n" : "";
+    this->out += strings ? "    char* s = NULL;\n" : "";
+    this->out += outside_have(Field::Type::t_string) ? "    int rc;\n" : "";
+    this->out += enums ? "    int e;\n" : "";
+    this->out += "\n    switch (field) {\n";
+    n_fields = 0;
+    for (const Table* t: tables) {
+        for (const Field& f: t->fields) {
+            const int id = n_fields++;
+            if (t->array || f.type == Field::Type::t_array) {
+                continue;
+            }
+            const std::string cb = "st->cb->" + callback_name(*t, &f);
+            const std::string call = cb + " ? " + cb + "(st->ctx, ";
+            this->put("        case ", std::to_string(id), ": /* ", cstr(key_path(*t, f.key)), " */\n");
+            switch (f.type) {
+                case Field::Type::t_int:
+                    this->out += "            if (tp_int(tp, &i) || ts_done(&st->s)) {\n                return -1;\n            }\n";
+                    this->put("            return ts_stop(&st->s, ", call, "i) : 0);\n");
+                    break;
+                case Field::Type::t_double:
+                    this->out += "            if (tp_double(tp, &d) || ts_done(&st->s)) {\n                return -1;\n            }\n";
+                    this->put("            return ts_stop(&st->s, ", call, "d) : 0);\n");
+                    break;
+                case Field::Type::t_bool:
+                    this->out += "            if (tp_bool(tp, &b) || ts_done(&st->s)) {\n                return -1;\n            }\n";
+                    this->put("            return ts_stop(&st->s, ", call, "b) : 0);\n");
+                    break;
+                case Field::Type::t_string:
+                    this->out += "            if (tp_string(tp, &s) || ts_done(&st->s)) {\n                free(s);\n                return -1;\n            }\n";
+                    this->put("            rc = ", call, "s, strlen(s)) : 0;\n");
+                    this->out += "            free(s);\n            return ts_stop(&st->s, rc);\n";
+                    break;
+                case Field::Type::t_enum:
+                    this->out += "            if (tp_string(tp, &s) || ts_done(&st->s)) {\n                free(s);\n                return -1;\n            }\n";
+                    this->put("            e = ", this->enum_of(f, "s"), ";\n");
+                    this->out += "            free(s);\n";
+                    this->out += "            if (e < 0) {\n";
+                    this->put("                return ts_error(&st->s, \"", cstr(key_path(*t, f.key)), " is not one of ", cstr(enum_list(f)), "\");\n");
+                    this->out += "            }\n";
+                    this->put("            return ts_stop(&st->s, ", call, "(", this->enum_type(*t, f), ")e) : 0);\n");
+                    break;
+                case Field::Type::t_array_of_int:
+                    this->put("            return ts_list(&st->s, TS_INT, field, ", run, ", st);\n");
+                    break;
+                case Field::Type::t_array_of_double:
+                    this->put("            return ts_list(&st->s, TS_DOUBLE, field, ", run, ", st);\n");
+                    break;
+                case Field::Type::t_array_of_bool:
+                    this->put("            return ts_list(&st->s, TS_BOOL, field, ", run, ", st);\n");
+                    break;
+                case Field::Type::t_array_of_string:
+                    this->put("            return ts_list(&st->s, TS_STRING, field, ", run, ", st);\n");
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    this->out += "    }\n";
+    if (arrays) {
+        this->put("    if (", base_name, "_stream_store(tp, st, field)) {\n        return -1;\n    }\n");
+        this->out += "    return ts_done(&st->s);\n}\n\n";
+    } else {
+        this->out += "    return tp_skip(tp) || ts_done(&st->s) ? -1 : 0;\n}\n\n";
+    }
+
+    // Statements, as in --direct. Unknown arrays are skipped element by
+    // element, so they need not fit in the window either.
+    // seen holds a mark per table, then one per field
+    const std::string n_tables = std::to_string(tables.size());
+    const std::string ctx = st_t + "* st, int table, char* seen";
+    this->put("static int ", base_name, "_stream_inline(", ctx, ");\n");
+    if (arrays) {
+        this->put("static int ", base_name, "_stream_entries(", ctx, ");\n");
+    }
+    this->out += "\n";
+    this->out += "/* Parses key = value, with the key relative to table. */\n";
+    this->put("static int ", base_name, "_stream_keyval(", ctx, ") {");
+    this->out += R"(
+    tp_t* tp = &st->s.tp;
+    char scratch[TP_KEY_MAX];
+    const char* key;
+    size_t len;
+    int field;
+    int rc;
+
+    if (tp_key(tp, scratch, &key, &len)) {
+        return -1;
+    }
+    while (tp->p < tp->end && *tp->p == '.') {
+        ++tp->p;
+        if (table >= 0 && (table = )" + base_name + R"(_child(table, key, len)) >= 0) {
+            seen[table] = 1;
+        }
+        if (tp_key(tp, scratch, &key, &len)) {
+            return -1;
+        }
+    }
+    if (tp->p >= tp->end || *tp->p != '=') {
+        return tp_fail(tp, "expected '='");
+    }
+    ++tp->p;
+    tp_ws(tp);
+    if (table >= 0 && (field = )" + base_name + R"(_field(table, key, len)) >= 0) {
+        if (seen[)" + n_tables + R"( + field]) {
+            st->s.fatal = 1;
+            return tp_fail(tp, "key exists");
+        }
+        if ((rc = )" + base_name + R"(_stream_value(st, field)) == 0) {
+            seen[)" + n_tables + R"( + field] = 1;
+        }
+        return rc;
+    }
+    if (table >= 0 && tp->p < tp->end && *tp->p == '{' && (table = )" + base_name + R"(_child(table, key, len)) >= 0) {
+        seen[table] = 1;
+        return )" + base_name + R"(_stream_inline(st, table, seen);
+    }
+)" + (arrays ? R"(    if (table >= 0 && tp->p < tp->end && *tp->p == '[' && (table = )" + base_name + R"(_array(table, key, len)) >= 0) {
+        return )" + base_name + R"(_stream_entries(st, table, seen);
+    }
+)" : "") + R"(    if (tp->p < tp->end && *tp->p == '[') {
+        return ts_list(&st->s, TS_SKIP, -1, NULL, NULL);
+    }
+    return tp_skip(tp) || ts_done(&st->s) ? -1 : 0;
+}
+
+/* An inline table is checked to be whole before its values are handed
+ * over, so that no callback runs twice. */
+)";
+    this->put("static int ", base_name, "_stream_inline(", ctx, ") {");
+    this->out += R"(
+    tp_t* tp = &st->s.tp;
+    const char* value = tp->p;
+    const int fixed = st->s.fixed;
+    int rc = 0;
+
+    if (!fixed) {
+        if (tp_skip(tp)) {
+            return -1;
+        }
+        tp->p = value;
+        st->s.fixed = 1;
+    }
+    ++tp->p;
+    tp_ws(tp);
+    if (tp->p < tp->end && *tp->p == '}') {
+        ++tp->p;
+    } else {
+        for (;;) {
+            if ((rc = )" + base_name + R"(_stream_keyval(st, table, seen))) {
+                break;
+            }
+            tp_ws(tp);
+            if (tp->p < tp->end && *tp->p == ',') {
+                ++tp->p;
+            } else if (tp->p < tp->end && *tp->p == '}') {
+                ++tp->p;
+                break;
+            } else {
+                rc = tp_fail(tp, "expected ',' or '}'");
+                break;
+            }
+        }
+    }
+    st->s.fixed = fixed;
+    st->s.fatal |= rc != 0;
+    return rc;
+}
+
+)";
+    if (arrays) {
+        this->out += "/* Parses an inline array of tables, one entry per {...}. */\n";
+        this->put("static int ", base_name, "_stream_entries(", ctx, ") {");
+        this->out += R"(
+    tp_t* tp = &st->s.tp;
+    int rc;
+
+    ++tp->p;
+    for (;;) {
+        const char* mark = tp->p;
+
+        tp_wsnl(tp);
+        if (tp->p < tp->end && *tp->p == ']') {
+            ++tp->p;
+            return 0;
+        }
+        )" + base_name + R"(_fresh(seen, table);
+        if (tp->p >= tp->end || *tp->p != '{') {
+            rc = tp_fail(tp, "expected '{'");
+        } else if ((rc = )" + base_name + R"(_stream_inline(st, table, seen)) == 0) {
+            tp_wsnl(tp);
+            if (tp->p < tp->end && *tp->p == ',') {
+                ++tp->p;
+            } else if (tp->p >= tp->end || *tp->p != ']') {
+                rc = tp_fail(tp, "expected ',' or ']'");
+            }
+        }
+        if (rc) {
+            )" + base_name + R"(_stream_clear(st, table);
+            if (ts_retry(&st->s, mark)) {
+                return -1;
+            }
+            continue;
+        }
+        st->entry = table;
+        if ()" + base_name + R"(_stream_flush(st)) {
+            return -1;
+        }
+    }
+}
+
+)";
+    }
+
+    // Document
+    std::string seen;
+    for (const Table* t: tables) {
+        seen += std::string(seen.empty() ? "" : ", ") + (t->array || t == tables.front() ? "1" : "0");
+    }
+    this->put("static int ", base_name, "_stream_parse(", st_t, "* st) {");
+    this->out += R"(
+    tp_t* tp = &st->s.tp;
+    char seen[)" + n_tables + " + " + std::to_string(n_fields) + "] = {" + seen + R"(};
+    char scratch[TP_KEY_MAX];
+    const char* mark;
+    const char* key;
+    size_t len;
+    int table = 0;
+    int next;
+    int last;
+
+    if (tp->end - tp->p >= 3 && 0 == memcmp(tp->p, "\xEF\xBB\xBF", 3)) {
+        tp->p += 3;
+    }
+    for (;;) {
+        mark = tp->p;
+        tp_wsnl(tp);
+        if (tp->p >= tp->end) {
+            if (st->s.eof) {
+                break;
+            }
+            /* Blanks and comments, of which the last line may be cut */
+            for (mark = tp->end; mark > tp->start && mark[-1] != '\n'; --mark) {
+            }
+            if (ts_more(&st->s, mark)) {
+                return -1;
+            }
+            continue;
+        }
+        if (*tp->p == '[') {
+            const int array = tp->end - tp->p >= 2 && tp->p[1] == '[';
+            tp->p += array ? 2 : 1;
+            next = 0;
+            for (;;) {
+                if (tp_key(tp, scratch, &key, &len)) {
+                    goto retry;
+                }
+                last = tp->p >= tp->end || *tp->p != '.';
+                if (next >= 0) {
+                    next = )" + (arrays ? "last && array ? " + base_name + "_array(next, key, len) : " : "") + base_name + R"(_child(next, key, len);
+                }
+                if (last) {
+                    break;
+                }
+                ++tp->p;
+            }
+            if (tp->end - tp->p < 1 + array || tp->p[0] != ']' || (array && tp->p[1] != ']')) {
+                tp_fail(tp, "expected ']'");
+                goto retry;
+            }
+            tp->p += 1 + array;
+)" + (arrays ? R"(            /* The header is whole, so the entry before it is complete */
+            if ()" + base_name + R"(_stream_flush(st)) {
+                return -1;
+            }
+            if (next >= 0 && array) {
+                st->entry = next;
+                )" + base_name + R"(_fresh(seen, next);
+            }
+)" : R"(            /* Arrays of tables are not part of the schema */
+            if (array) {
+                next = -1;
+            }
+)") + R"(            if ((table = next) >= 0) {
+                seen[table] = 1;
+            }
+        } else if ()" + base_name + R"(_stream_keyval(st, table, seen)) {
+            goto retry;
+        }
+        if (ts_eol(&st->s)) {
+            return -1;
+        }
+        continue;
+
+retry:
+        if (ts_retry(&st->s, mark)) {
+            return -1;
+        }
+    }
+)" + (arrays ? "    if (" + base_name + "_stream_flush(st)) {\n        return -1;\n    }\n" : "") + R"(    for (int i = 0; i < )" + n_tables + R"(; ++i) {
+        if (!seen[i]) {
+            snprintf(tp->err, tp->errsz, "failed locating [%s] table", )" + base_name + R"(_table_names[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+)";
+
+    this->put("int ", base_name, "_stream(const char* file_path, const ", cb_t, "* cb, void* ctx) {");
+    this->out += R"(
+    char errbuf[200] = "";
+    )" + st_t + R"( st;
+    int rc;
+
+    memset(&st, 0, sizeof(st));
+    st.cb = cb;
+    st.ctx = ctx;
+)" + (arrays ? "    st.entry = -1;\n" : "") + R"(    st.s.tp.err = errbuf;
+    st.s.tp.errsz = sizeof(errbuf);
+    if ((st.s.fd = open(file_path, O_RDONLY)) < 0) {
+        )" + base_name + R"(_error(")" + base_name + R"(_stream() failed: couldn't open %s", file_path);
+        return 1;
+    }
+    if (!(st.s.buf = malloc(st.s.cap = T2C_STREAM_CHUNK))) {
+        )" + base_name + R"(_error(")" + base_name + R"(_stream() failed: out of memory");
+        close(st.s.fd);
+        return 1;
+    }
+    st.s.tp.start = st.s.tp.p = st.s.tp.end = st.s.buf;
+
+    rc = ts_more(&st.s, st.s.buf) || )" + base_name + R"(_stream_parse(&st);
+)";
+    for (const Table* t: tables) {
+        if (t->array) {
+            this->put("    ", base_name, "_stream_clear(&st, ", std::to_string(table_id(t)), ");\n");
+        }
+    }
+    this->out += R"(    free(st.s.buf);
+    close(st.s.fd);
+    if (rc && st.s.stop) {
+        return st.s.stop;
+    }
+    if (rc) {
+        )" + base_name + R"(_error(")" + base_name + R"(_stream() failed: error while parsing %s: %s", file_path, errbuf);
+        return 1;
+    }
+    return 0;
+}
+
+)";
+}
+
+void Writer::c_bin(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+    char schema[32];
+    // An image only fits a struct with the same layout
+    uint64_t h = schema_hash(root);
+    for (unsigned char c: layout_id(this->opts)) {
+        h = (h ^ c) * 1099511628211ull;
+    }
+    snprintf(schema, sizeof(schema), "0x%016llxull", static_cast<unsigned long long>(h));
+
+    this->out += R"(
+/* Snapshot image: header, struct, then strings and arrays. In the
+ * image every pointer holds the offset of its data from the header. */
+#define BIN_ALIGN(n) (((n) + 7) & ~(size_t)7)
+#define BIN_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint64_t schema;
+    uint64_t size;
+    uint32_t order;
+    uint32_t ptr_size;
+} bin_header_t;
+
+)";
+    this->put("static const uint64_t ", base_name, "_schema = ", schema, ";\n\n");
+
+    // Layout: sizes the image, and fills it when given one
+    this->put("static size_t ", base_name, "_bin_layout(const ", name, "* ", this->ptr, ", char* base) {\n");
+    this->put("    ", name, "* img = base ? (", name, "*)(base + BIN_ALIGN(sizeof(bin_header_t))) : NULL;\n");
+    this->put("    size_t used = BIN_ALIGN(sizeof(bin_header_t)) + BIN_ALIGN(sizeof(", name, "));\n");
+    this->out += "    size_t n;\n\n";
+    this->put("    if (img) {\n        *img = *", this->ptr, ";\n    }\n");
+    const std::string cold_t = base_name + "_cold_t";
+    if (!this->opts.cold.empty()) {
+        this->put("    ", cold_t, "* cold = img ? (", cold_t, "*)(base + used) : NULL;\n");
+        this->out += "    if (img) {\n";
+        this->put("        *cold = *", this->ptr, "->", LIB_BASE_NAMEu, "cold;\n");
+        this->put("        img->", LIB_BASE_NAMEu, "cold = (void*)(uintptr_t)used;\n");
+        this->out += "    }\n";
+        this->put("    used += BIN_ALIGN(sizeof(", cold_t, "));\n");
+    }
+
+    std::function<void(const Table&)> layout_r;
+    layout_r = [&] (const Table& t)->void {
+        const std::string index = t.path + "_i";
+        const std::string count = this->count(this->ptr, t);
+        std::vector<std::string> columns;
+        size_t body = 0;
+        if (t.array) {
+            // Entries, or columns with --soa, are copied as blocks, then
+            // what they point to is laid out entry by entry
+            if (this->opts.soa) {
+                for (const Field& f: t.fields) {
+                    columns.push_back(t.var + f.name);
+                    if (f.type >= Field::Type::t_array) {
+                        columns.push_back(t.var + f.name + "_len");
+                    }
+                }
+            } else {
+                columns.push_back(t.var.substr(0, t.var.size()-1));
+            }
+            this->put("    if (", count, ") {\n");
+            for (const std::string& c: columns) {
+                const std::string local = t.path + (this->opts.soa ? "_" + c.substr(t.var.size()) : "");
+                this->put("        char* ", local, " = img ? base + used : NULL;\n");
+                this->put("        n = ", count, " * sizeof(*", this->ptr, "->", c, ");\n");
+                this->out += "        if (img) {\n";
+                this->put("            memcpy(", local, ", ", this->ptr, "->", c, ", n);\n");
+                this->put("            img->", c, " = (void*)(uintptr_t)used;\n");
+                this->out += "        }\n";
+                this->out += "        used += BIN_ALIGN(n);\n";
+            }
+            this->put("        for (size_t ", index, " = 0; ", index, " < ", count, "; ++", index, ") {\n");
+            body = this->out.size();
+        }
+        for (const Field& f: t.fields) {
+            // Inline values were copied along with their struct
+            if (f.cap) {
+                continue;
+            }
+            const std::string src = this->member(this->ptr, t, f, index);
+            const std::string len = this->member(this->ptr, t, f, index, "_len");
+            std::string el;
+            std::string bytes;
+            std::string dst = (f.cold ? "cold->" : "img->") + t.var + f.name;
+            if (t.array) {
+                const std::string local = t.path + (this->opts.soa ? "_" + f.name : "");
+                dst = this->opts.soa ? "((" + c_type(f.type) + "*)" + local + ")[" + index + "]"
+                    : "((struct " + base_name + t.path.substr(4) + "*)" + local + ")[" + index + "]." + f.name;
+            }
+            switch (f.type) {
+                case Field::Type::t_string:
+                    this->put("    if (", src, ") {\n");
+                    this->put("        n = strlen(", src, ") + 1;\n");
+                    this->out += "        if (img) {\n";
+                    this->put("            memcpy(base + used, ", src, ", n);\n");
+                    this->put("            ", dst, " = (char*)(uintptr_t)used;\n");
+                    this->out += "        }\n";
+                    this->out += "        used += BIN_ALIGN(n);\n";
+                    this->out += "    }\n";
+                    break;
+
+                case Field::Type::t_array_of_int:
+                    el = "int64_t"; break;
+                case Field::Type::t_array_of_double:
+                    el = "double"; break;
+                case Field::Type::t_array_of_bool:
+                    el = f.packed ? "uint8_t" : "bool";
+                    bytes = f.packed ? "(" + len + " + 7) / 8" : "";
+                    break;
+
+                case Field::Type::t_array_of_string:
+                    this->put("    if (", len, ") {\n");
+                    this->out += "        char** offs = (char**)(base + used);\n";
+                    this->out += "        if (img) {\n";
+                    this->put("            ", dst, " = (char**)(uintptr_t)used;\n");
+                    this->out += "        }\n";
+                    this->put("        used += BIN_ALIGN(", len, " * sizeof(char*));\n");
+                    this->put("        for (size_t i = 0; i < ", len, "; ++i) {\n");
+                    this->put("            n = strlen(", src, "[i]) + 1;\n");
+                    this->out += "            if (img) {\n";
+                    this->put("                memcpy(base + used, ", src, "[i], n);\n");
+                    this->out += "                offs[i] = (char*)(uintptr_t)used;\n";
+                    this->out += "            }\n";
+                    this->out += "            used += BIN_ALIGN(n);\n";
+                    this->out += "        }\n";
+                    this->out += "    } else if (img) {\n";
+                    this->put("        ", dst, " = NULL;\n");
+                    this->out += "    }\n";
+                    break;
+
+                default:
+                    break;
+            }
+            if (!el.empty()) {
+                this->put("    if (", len, ") {\n");
+                this->put("        n = ", bytes.empty() ? len + " * sizeof(" + el + ")" : bytes, ";\n");
+                this->out += "        if (img) {\n";
+                this->put("            memcpy(base + used, ", src, ", n);\n");
+                this->put("            ", dst, " = (", el, "*)(uintptr_t)used;\n");
+                this->out += "        }\n";
+                this->out += "        used += BIN_ALIGN(n);\n";
+                this->out += "    } else if (img) {\n";
+                this->put("        ", dst, " = NULL;\n");
+                this->out += "    }\n";
+            }
+        }
+        if (t.array) {
+            this->indent_since(body);
+            this->indent_since(body);
+            this->out += "        }\n";
+            this->out += "    } else if (img) {\n";
+            for (const std::string& c: columns) {
+                this->put("        img->", c, " = NULL;\n");
+            }
+            this->out += "    }\n";
+        }
+        for (const Table* c: t.children) {
+            layout_r(*c);
+        }
+    };
+    layout_r(root);
+    this->out += "    return used;\n}\n\n";
+
+    // Save
+    this->put("int ", base_name, "_save_bin(const ", name, "* ", this->ptr, ", const char* path) {");
+    this->out += R"(
+    const size_t size = )" + base_name + "_bin_layout(" + this->ptr + R"(, NULL);
+    char* base = calloc(1, size);
+    bin_header_t* h = (bin_header_t*)base;
+    char tmp[4096];
+    FILE* fp;
+    int ok;
+
+    if (!base || snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        )" + base_name + R"(_error(")" + base_name + R"(_save_bin() failed: couldn't prepare %s", path);
+        free(base);
+        return 1;
+    }
+    memcpy(h->magic, "t2cbin1", 8);
+    h->schema = )" + base_name + R"(_schema;
+    h->size = size;
+    h->order = BIN_ORDER;
+    h->ptr_size = sizeof(void*);
+    )" + base_name + "_bin_layout(" + this->ptr + R"(, base);
+
+    /* Replace the image atomically, live mappings of the old one stay valid. */
+    ok = 0 != (fp = fopen(tmp, "wb"));
+    ok = ok && fwrite(base, 1, size, fp) == size;
+    ok = (fp && 0 == fclose(fp)) && ok;
+    ok = ok && 0 == rename(tmp, path);
+    free(base);
+    if (!ok) {
+        )" + base_name + R"(_error(")" + base_name + R"(_save_bin() failed: couldn't write %s", path);
+        remove(tmp);
+        return 1;
+    }
+    return 0;
+}
+
+)";
+
+    // Load: map privately, then turn offsets back into pointers in place
+    this->put("int ", base_name, "_load_bin(const char* path, ", name, "** ", this->ptr, ") {");
+    this->out += R"(
+    struct stat st;
+    char* base;
+    const bin_header_t* h;
+    size_t size;
+    uintptr_t off;
+    )" + name + R"(* img;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        )" + base_name + R"(_error(")" + base_name + R"(_load_bin() failed: couldn't open %s", path);
+        return 1;
+    }
+    if (fstat(fd, &st) || (size_t)st.st_size < BIN_ALIGN(sizeof(bin_header_t)) + BIN_ALIGN(sizeof()" + name + R"())) {
+        )" + base_name + R"(_error(")" + base_name + R"(_load_bin() failed: %s is not a snapshot", path);
+        close(fd);
+        return 1;
+    }
+    size = st.st_size;
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        )" + base_name + R"(_error(")" + base_name + R"(_load_bin() failed: couldn't map %s", path);
+        return 1;
+    }
+    h = (const bin_header_t*)base;
+    if (memcmp(h->magic, "t2cbin1", 8) || h->schema != )" + base_name + R"(_schema || h->size != size
+            || h->order != BIN_ORDER || h->ptr_size != sizeof(void*)) {
+        )" + base_name + R"(_error(")" + base_name + R"(_load_bin() failed: %s is stale or from another schema", path);
+        munmap(base, size);
+        return 1;
+    }
+    img = ()" + name + R"(*)(base + BIN_ALIGN(sizeof(bin_header_t)));
+
+)";
+    std::function<void(const Table&)> reloc_r;
+    reloc_r = [&] (const Table& t)->void {
+        const std::string index = t.path + "_i";
+        const std::string count = this->count("img", t);
+        size_t body = 0;
+        if (t.array) {
+            std::vector<std::string> columns;
+            if (this->opts.soa) {
+                for (const Field& f: t.fields) {
+                    columns.push_back("img->" + t.var + f.name);
+                    if (f.type >= Field::Type::t_array) {
+                        columns.push_back("img->" + t.var + f.name + "_len");
+                    }
+                }
+            } else {
+                columns.push_back("img->" + t.var.substr(0, t.var.size()-1));
+            }
+            for (const std::string& c: columns) {
+                this->put("    if ((off = (uintptr_t)", c, ")) {\n");
+                this->put("        if (off >= size || ", count, " > (size - off) / sizeof(*", c, ")) {\n");
+                this->out += "            goto corrupt;\n        }\n";
+                this->put("        ", c, " = (void*)(base + off);\n");
+                this->put("    } else if (", count, ") {\n");
+                this->out += "        goto corrupt;\n    }\n";
+            }
+            this->put("    for (size_t ", index, " = 0; ", index, " < ", count, "; ++", index, ") {\n");
+            body = this->out.size();
+        }
+        for (const Field& f: t.fields) {
+            const std::string dst = this->member("img", t, f, index);
+            const std::string len = this->member("img", t, f, index, "_len");
+            std::string el;
+            // Values handed out as they are must be valid too
+            if (f.type == Field::Type::t_enum) {
+                this->put("    if ((unsigned)", dst, " >= ", std::to_string(f.values.size()), ") {\n");
+                this->out += "        goto corrupt;\n    }\n";
+            } else if (f.cap && f.type == Field::Type::t_string) {
+                this->put("    if (!memchr(", dst, ", '\\0', ", std::to_string(f.cap), ")) {\n");
+                this->out += "        goto corrupt;\n    }\n";
+            } else if (f.cap) {
+                this->put("    if (", len, " > ", std::to_string(f.cap), ") {\n");
+                this->out += "        goto corrupt;\n    }\n";
+            }
+            if (f.cap) {
+                continue;
+            }
+            switch (f.type) {
+                case Field::Type::t_string:
+                    this->put("    if ((off = (uintptr_t)", dst, ")) {\n");
+                    this->out += "        if (off >= size || !memchr(base + off, '\\0', size - off)) {\n";
+                    this->out += "            goto corrupt;\n        }\n";
+                    this->put("        ", dst, " = base + off;\n");
+                    this->out += "    }\n";
+                    break;
+
+                case Field::Type::t_array_of_int:
+                    el = "int64_t"; break;
+                case Field::Type::t_array_of_double:
+                    el = "double"; break;
+                case Field::Type::t_array_of_bool:
+                    el = f.packed ? "uint8_t" : "bool"; break;
+
+                case Field::Type::t_array_of_string:
+                    this->put("    if ((off = (uintptr_t)", dst, ")) {\n");
+                    this->put("        if (off >= size || ", len, " > (size - off) / sizeof(char*)) {\n");
+                    this->out += "            goto corrupt;\n        }\n";
+                    this->put("        ", dst, " = (char**)(base + off);\n");
+                    this->put("        for (size_t i = 0; i < ", len, "; ++i) {\n");
+                    this->put("            if ((off = (uintptr_t)", dst, "[i]) >= size || !memchr(base + off, '\\0', size - off)) {\n");
+                    this->out += "                goto corrupt;\n            }\n";
+                    this->put("            ", dst, "[i] = base + off;\n");
+                    this->out += "        }\n";
+                    this->out += "    }\n";
+                    break;
+
+                default:
+                    break;
+            }
+            if (!el.empty()) {
+                this->put("    if ((off = (uintptr_t)", dst, ")) {\n");
+                if (f.packed) {
+                    this->put("        if (off >= size || (", len, " + 7) / 8 > size - off) {\n");
+                } else {
+                    this->put("        if (off >= size || ", len, " > (size - off) / sizeof(", el, ")) {\n");
+                }
+                this->out += "            goto corrupt;\n        }\n";
+                this->put("        ", dst, " = (", el, "*)(base + off);\n");
+                this->out += "    }\n";
+            }
+        }
+        if (t.array) {
+            this->indent_since(body);
+            this->out += "    }\n";
+        }
+        for (const Table* c: t.children) {
+            reloc_r(*c);
+        }
+    };
+    if (!this->opts.cold.empty()) {
+        const std::string cold = "img->" + LIB_BASE_NAMEu + "cold";
+        this->put("    if (0 == (off = (uintptr_t)", cold, ") || off >= size || sizeof(*", cold, ") > size - off) {\n");
+        this->out += "        goto corrupt;\n    }\n";
+        this->put("    ", cold, " = (void*)(base + off);\n");
+    }
+    reloc_r(root);
+    this->put("    *", this->ptr, " = img;\n    return 0;\n");
+    this->out += R"(
+corrupt:
+    )" + base_name + R"(_error(")" + base_name + R"(_load_bin() failed: %s is corrupt", path);
+    munmap(base, size);
+    return 1;
+}
+
+)";
+
+    this->put("void ", base_name, "_unload_bin(", name, "* ", this->ptr, ") {\n");
+    this->out += "    char* base;\n\n";
+    this->put("    if (!", this->ptr, ") {\n        return;\n    }\n");
+    this->put("    base = (char*)", this->ptr, " - BIN_ALIGN(sizeof(bin_header_t));\n");
+    this->out += "    munmap(base, ((bin_header_t*)base)->size);\n}\n";
+}
+
+// The sample's values as a constant instance, for --embed. Strings are
+// literals and arrays are static const, so the whole instance is read-only.
+void Writer::c_embed(const Table& root) {
+    const std::string& name = root.name;
+    const std::string prefix = this->base_name + "_default";
+
+    // Literal of a scalar of the given type, or 0 when n holds another type
+    auto scalar = [] (Field::Type type, const toml::node* n)->std::string {
+        if (!n) {
+            return "0";
+        }
+        if (type == Field::Type::t_string && n->as_string()) {
+            return c_string(n->as_string()->get());
+        }
+        if (type == Field::Type::t_bool && n->as_boolean()) {
+            return n->as_boolean()->get() ? "true" : "false";
+        }
+        if ((type == Field::Type::t_int || type == Field::Type::t_double) && n->as_integer()) {
+            const int64_t i = n->as_integer()->get();
+            return i == INT64_MIN ? "(-INT64_C(9223372036854775807) - 1)" : "INT64_C(" + std::to_string(i) + ")";
+        }
+        if (type == Field::Type::t_double && n->as_floating_point()) {
+            const double d = n->as_floating_point()->get();
+            if (std::isnan(d)) {
+                return "NAN";
+            }
+            if (std::isinf(d)) {
+                return d < 0 ? "-INFINITY" : "INFINITY";
+            }
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.17g", d);
+            return buf;
+        }
+        return "0";
+    };
+    // Emits a static array holding items and returns it cast to a member's type
+    auto array = [this] (const std::string& el, const std::string& helper, const std::vector<std::string>& items, const std::string& dim)->std::string {
+        const bool ptr = el.back() == '*';
+        this->put("static ", ptr ? "" : "const ", el, ptr ? " const " : " ", helper, "[]", dim, " = {");
+        for (size_t i = 0; i < items.size(); ++i) {
+            this->put(i ? ", " : "", items[i]);
+        }
+        this->out += "};\n";
+        return "(" + el + (dim.empty() ? "*" : "(*)" + dim) + ")" + helper;
+    };
+    auto length = [] (const toml::node* n)->size_t {
+        return n && n->as_array() ? n->as_array()->size() : 0;
+    };
+    // Initializer of field f holding n, with helper naming its array if any
+    auto value = [&] (const Table& t, const Field& f, const toml::node* n, const std::string& helper)->std::string {
+        if (f.type == Field::Type::t_enum) {
+            return this->enum_value(t, f, n ? n->value<std::string>().value_or("") : f.values[0]);
+        }
+        if (f.type < Field::Type::t_array) {
+            return f.cap && !n ? "\"\"" : scalar(f.type, n);
+        }
+        const Field::Type type = static_cast<Field::Type>(static_cast<int>(f.type) - static_cast<int>(Field::Type::t_array_of_int));
+        std::vector<std::string> items;
+        for (size_t i = 0; i < length(n); ++i) {
+            items.push_back(scalar(type, n->as_array()->get(i)));
+        }
+        if (f.cap) {
+            return items.empty() ? "{0}" : "{" + std::accumulate(items.begin() + 1, items.end(), items[0],
+                [] (const std::string& a, const std::string& b) { return a + ", " + b; }) + "}";
+        }
+        if (items.empty()) {
+            return "0";
+        }
+        if (f.packed) {
+            std::vector<std::string> bytes((items.size() + 7) / 8, "0");
+            for (size_t i = 0; i < items.size(); ++i) {
+                if (items[i] == "true") {
+                    bytes[i / 8] = std::to_string(std::stoi(bytes[i / 8]) | 1 << (i % 8));
+                }
+            }
+            return array("uint8_t", helper, bytes, "");
+        }
+        const std::string el = c_type(f.type);
+        return array(el.substr(0, el.size()-1), helper, items, "");
+    };
+
+    std::string hot;
+    std::string cold;
+    std::function<void(const Table&)> embed_r;
+    embed_r = [&] (const Table& t)->void {
+        const std::string helper = prefix + t.path.substr(4);
+        if (t.array) {
+            const toml::array& entries = *t.node->as_array();
+            const std::string block = t.var.substr(0, t.var.size()-1);
+            std::vector<std::string> items;
+            for (size_t i = 0; i < entries.size() && !this->opts.soa; ++i) {
+                const toml::table* e = entries.get(i)->as_table();
+                std::string item;
+                for (const Field& f: t.fields) {
+                    const toml::node* n = e ? e->get(f.key) : nullptr;
+                    if (n) {
+                        item += (item.empty() ? "." : ", .") + f.name + " = " + value(t, f, n, helper + "_" + std::to_string(i) + "_" + f.name);
+                        if (f.type >= Field::Type::t_array) {
+                            item += ", ." + f.name + "_len = " + std::to_string(length(n));
+                        }
+                    }
+                }
+                items.push_back(item.empty() ? "{0}" : "{" + item + "}");
+            }
+            if (!this->opts.soa) {
+                const std::string type = "struct " + this->base_name + t.path.substr(4);
+                this->put("static const ", type, " ", helper, "[] = {\n");
+                for (const std::string& item: items) {
+                    this->put("    ", item, ",\n");
+                }
+                this->out += "};\n";
+                hot += "    ." + block + " = (" + type + "*)" + helper + ",\n";
+                hot += "    ." + block + "_len = " + std::to_string(entries.size()) + ",\n";
+                return;
+            }
+            // Columns: one static array per field, and per _len
+            for (const Field& f: t.fields) {
+                std::vector<std::string> column;
+                std::vector<std::string> lens;
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    const toml::table* e = entries.get(i)->as_table();
+                    const toml::node* n = e ? e->get(f.key) : nullptr;
+                    column.push_back(value(t, f, n, helper + "_" + std::to_string(i) + "_" + f.name));
+                    lens.push_back(std::to_string(length(n)));
+                }
+                std::string el = f.type == Field::Type::t_enum ? this->enum_type(t, f) : c_type(f.type);
+                std::string dim;
+                if (f.cap) {
+                    el.erase(el.find('*'), 1);
+                    dim = "[" + std::to_string(f.cap) + "]";
+                }
+                hot += "    ." + t.var + f.name + " = " + array(el, helper + "_" + f.name, column, dim) + ",\n";
+                if (f.type >= Field::Type::t_array) {
+                    hot += "    ." + t.var + f.name + "_len = " + array("size_t", helper + "_" + f.name + "_len", lens, "") + ",\n";
+                }
+            }
+            hot += "    ." + t.var + "len = " + std::to_string(entries.size()) + ",\n";
+            return;
+        }
+
+        const toml::table& tbl = *t.node->as_table();
+        std::vector<int> bits;
+        for (const Field& f: t.fields) {
+            const toml::node* n = tbl.get(f.key);
+            if (f.packed && f.type == Field::Type::t_bool) {
+                bits.resize(f.bit / 8 + 1);
+                bits[f.bit / 8] |= (scalar(f.type, n) == "true") << (f.bit % 8);
+                continue;
+            }
+            std::string& init = f.cold ? cold : hot;
+            init += "    ." + t.var + f.name + " = " + value(t, f, n, helper + "_" + f.name) + ",\n";
+            if (f.type >= Field::Type::t_array) {
+                init += "    ." + t.var + f.name + "_len = " + std::to_string(length(n)) + ",\n";
+            }
+        }
+        for (size_t i = 0; i < bits.size(); ++i) {
+            if (bits[i]) {
+                hot += "    ." + t.var + LIB_BASE_NAMEu + "bits[" + std::to_string(i) + "] = " + std::to_string(bits[i]) + ",\n";
+            }
+        }
+        for (const Table* c: t.children) {
+            embed_r(*c);
+        }
+    };
+    embed_r(root);
+
+    if (!this->opts.cold.empty()) {
+        const std::string cold_t = this->base_name + "_cold_t";
+        this->put("static const ", cold_t, " ", prefix, "_cold = {\n", cold.empty() ? "    0\n" : cold, "};\n");
+        hot = "    ." + LIB_BASE_NAMEu + "cold = (" + cold_t + "*)&" + prefix + "_cold,\n" + hot;
+    }
+    this->put("const ", name, " ", prefix, " = {\n", hot.empty() ? "    0\n" : hot, "};\n\n");
+}
+
+// Entry points over file descriptors and memory, on top of the backend's _text()
+void Writer::c_entry(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+    const std::string sig = name + "** " + this->ptr;
+
+    this->out += "/* Parses the file behind fd, mapping it when it is a regular file. */\n";
+    this->put("static int ", base_name, "_fd(int fd, ", sig, ", const char* fn, const char* src) {");
+    this->out += R"(
+    struct stat st;
+    char* buf = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    ssize_t got;
+    int rc;
+
+    if (0 == fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* map;
+        STATS_START();
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        STATS_STOP(io_ns);
+        if (map != MAP_FAILED) {
+            /* Past the end of file, the last page reads as zeros */
+            const int terminated = st.st_size % sysconf(_SC_PAGESIZE) != 0;
+            posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+            rc = )" + base_name + "_text(map, st.st_size, terminated, " + this->ptr + R"(, fn, src);
+            munmap(map, st.st_size);
+            return rc;
+        }
+    }
+
+    /* Pipes, sockets and empty files */
+    STATS_START();
+    for (;;) {
+        if (cap - len < 4096) {
+            char* grown = realloc(buf, cap = cap ? 2 * cap : 65536);
+            if (!grown) {
+                )" + base_name + R"(_error("%s() failed: out of memory", fn);
+                free(buf);
+                return 1;
+            }
+            buf = grown;
+        }
+        if ((got = read(fd, buf + len, cap - len - 1)) == 0) {
+            break;
+        }
+        if (got < 0 && errno != EINTR) {
+            )" + base_name + R"(_error("%s() failed: couldn't read %s", fn, src);
+            free(buf);
+            return 1;
+        }
+        len += got > 0 ? got : 0;
+    }
+    STATS_STOP(io_ns);
+    buf[len] = '\0';
+    rc = )" + base_name + "_text(buf, len, 1, " + this->ptr + R"(, fn, src);
+    free(buf);
+    return rc;
+}
+
+)";
+
+    if (this->opts.direct) {
+        this->put("int ", base_name, "_read(const char* file_path, ", sig, ") {");
+        this->out += R"(
+    int fd;
+    int rc;
+
+    STATS_BEGIN(file_path);
+
+    /* Open the file. */
+    STATS_START();
+    fd = open(file_path, O_RDONLY);
+    STATS_STOP(io_ns);
+    if (fd < 0) {
+        )" + base_name + R"(_error(")" + base_name + R"(_read() failed: couldn't open %s", file_path);
+        return STATS_END(1);
+    }
+    rc = )" + base_name + "_fd(fd, " + this->ptr + ", \"" + base_name + R"(_read", file_path);
+    close(fd);
+    return STATS_END(rc);
+}
+
+)";
+    }
+    this->put("int ", base_name, "_read_fd(int fd, ", sig, ") {\n");
+    this->out += "    STATS_BEGIN(\"fd\");\n";
+    this->put("    return STATS_END(", base_name, "_fd(fd, ", this->ptr, ", \"", base_name, "_read_fd\", \"fd\"));\n}\n\n");
+    this->put("int ", base_name, "_read_mem(const char* buf, size_t len, ", sig, ") {\n");
+    this->out += "    STATS_BEGIN(\"buffer\");\n";
+    this->put("    return STATS_END(", base_name, "_text(buf, len, 0, ", this->ptr, ", \"", base_name, "_read_mem\", \"buffer\"));\n}\n\n");
+}
+
+// Instrumentation compiled in with -DT2C_STATS, and the STATS_* macros the
+// readers are annotated with, which compile to nothing otherwise
+void Writer::c_stats(const Table& root) {
+    const std::string stats_t = LIB_BASE_NAMEu + "stats_t";
+    const std::string st = this->base_name + "_st";
+    const std::string n = std::to_string(root.children.size());
+
+    this->put("#ifdef ", mvar(LIB_BASE_NAMEu), "STATS\n");
+    this->out += "#include <time.h>\n\n";
+    this->put("static const char* ", this->base_name, "_stats_names[] = {");
+    for (const Table* c: root.children) {
+        this->put(c == root.children.front() ? "" : ", ", c_string(c->name));
+    }
+    this->out += root.children.empty() ? "NULL};\n\n" : "};\n\n";
+    this->out += "static _Thread_local struct {\n";
+    this->put("    ", stats_t, " stats;\n");
+    this->put("    ", LIB_BASE_NAMEu, "stats_table_t tables[", root.children.empty() ? "1" : n, "];\n");
+    this->out += R"(    uint64_t marks[8];
+    int depth;
+    int active;
+    int table;
+    uint64_t since;
+} )" + st + R"(;
+static )" + LIB_BASE_NAMEu + "stats_fn " + this->base_name + R"(_stats_fn;
+static void* )" + this->base_name + R"(_stats_ctx;
+
+static uint64_t )" + this->base_name + R"(_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void )" + this->base_name + R"(_stats_begin(const char* src) {
+    memset(&)" + st + ", 0, sizeof(" + st + R"());
+    for (size_t i = 0; i < )" + n + R"(; ++i) {
+        )" + st + ".tables[i].name = " + this->base_name + R"(_stats_names[i];
+    }
+    )" + st + R"(.stats.src = src;
+    )" + st + R"(.stats.n_tables = )" + n + R"(;
+    )" + st + ".stats.tables = " + st + R"(.tables;
+    )" + st + R"(.active = 1;
+    )" + st + R"(.table = -1;
+    )" + st + ".marks[" + st + ".depth++] = " + this->base_name + R"(_clock();
+}
+
+static int )" + this->base_name + R"(_stats_end(int rc) {
+    )" + st + ".stats.total_ns = " + this->base_name + "_clock() - " + st + R"(.marks[0];
+    )" + st + R"(.stats.rc = rc;
+    )" + st + R"(.active = 0;
+    if ()" + this->base_name + R"(_stats_fn) {
+        )" + this->base_name + "_stats_fn(&" + st + ".stats, " + this->base_name + R"(_stats_ctx);
+    }
+    return rc;
+}
+
+/* Charges the time since the last switch to the current top-level table */
+static inline void )" + this->base_name + R"(_stats_table(int table) {
+    const uint64_t now = )" + this->base_name + R"(_clock();
+    if ()" + st + R"(.table >= 0) {
+        )" + st + ".tables[" + st + ".table].ns += now - " + st + R"(.since;
+    }
+    )" + st + R"(.table = table;
+    )" + st + R"(.since = now;
+}
+
+static inline void* )" + this->base_name + R"(_malloc(size_t size) {
+    )" + st + ".stats.allocs += " + st + R"(.active;
+    )" + st + ".stats.alloc_bytes += " + st + R"(.active ? size : 0;
+    return malloc(size);
+}
+
+static inline void* )" + this->base_name + R"(_calloc(size_t n, size_t size) {
+    )" + st + ".stats.allocs += " + st + R"(.active;
+    )" + st + ".stats.alloc_bytes += " + st + R"(.active ? n * size : 0;
+    return calloc(n, size);
+}
+
+static inline void* )" + this->base_name + R"(_realloc(void* p, size_t size) {
+    )" + st + ".stats.allocs += " + st + R"(.active;
+    )" + st + ".stats.alloc_bytes += " + st + R"(.active ? size : 0;
+    return realloc(p, size);
+}
+
+const )" + stats_t + "* " + this->base_name + R"(_stats(void) {
+    return &)" + st + R"(.stats;
+}
+
+void )" + this->base_name + "_stats_callback(" + LIB_BASE_NAMEu + R"(stats_fn fn, void* ctx) {
+    )" + this->base_name + R"(_stats_fn = fn;
+    )" + this->base_name + R"(_stats_ctx = ctx;
+}
+
+#define malloc(size) )" + this->base_name + R"(_malloc(size)
+#define calloc(n, size) )" + this->base_name + R"(_calloc(n, size)
+#define realloc(p, size) )" + this->base_name + R"(_realloc(p, size)
+#define STATS_BEGIN(src) )" + this->base_name + R"(_stats_begin(src)
+#define STATS_END(rc) )" + this->base_name + R"(_stats_end(rc)
+/* Marks only count inside a read: the lazy accessors and _set_path share
+ * the timed code, and each read starts again from an empty stack. */
+#define STATS_START() ()" + st + ".active ? (void)(" + st + ".marks[" + st + ".depth++] = " + this->base_name + R"(_clock()) : (void)0)
+#define STATS_STOP(what) ()" + st + ".active ? (void)(" + st + ".stats.what += " + this->base_name + "_clock() - " + st + ".marks[--" + st + R"(.depth]) : (void)0)
+#define STATS_TABLE(table) )" + this->base_name + R"(_stats_table(table)
+#else
+#define STATS_BEGIN(src) ((void)0)
+#define STATS_END(rc) (rc)
+#define STATS_START() ((void)0)
+#define STATS_STOP(what) ((void)0)
+#define STATS_TABLE(table) ((void)0)
+#endif
+
+)";
+}
+
+// _read_many(): files are handed out to the workers through an atomic
+// index, and each worker's errors go to the file's slot
+void Writer::c_many(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+    const std::string many_t = base_name + "_many_t";
+
+    this->out += R"(
+/* Files left to read by the )" + base_name + R"(_read_many() workers */
+typedef struct {
+    const char** paths;
+    size_t n;
+    )" + name + R"(** out;
+    )" + LIB_BASE_NAMEu + R"(error_t* errors;
+    atomic_size_t next;
+    atomic_size_t failed;
+} )" + many_t + R"(;
+
+static void* )" + base_name + R"(_worker(void* arg) {
+    )" + many_t + R"(* m = arg;
+    size_t i;
+    int rc;
+
+    while ((i = atomic_fetch_add(&m->next, 1)) < m->n) {
+        if (m->errors) {
+            )" + base_name + R"(_err = &m->errors[i];
+            m->errors[i].msg[0] = '\0';
+        }
+        rc = )" + base_name + R"(_read(m->paths[i], &m->out[i]);
+        )" + base_name + R"(_err = NULL;
+        if (m->errors) {
+            m->errors[i].rc = rc;
+        }
+        if (rc) {
+            atomic_fetch_add(&m->failed, 1);
+        }
+    }
+    return NULL;
+}
+
+int )" + base_name + "_read_many(const char** paths, size_t n, " + name + "** " + this->ptr + ", " + LIB_BASE_NAMEu + R"(error_t* errors, unsigned threads) {
+    )" + many_t + " m = {.paths = paths, .n = n, .out = " + this->ptr + R"(, .errors = errors};
+    pthread_t* pool = NULL;
+    size_t started = 0;
+
+    atomic_init(&m.next, 0);
+    atomic_init(&m.failed, 0);
+    if (threads == 0) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    if (threads > n) {
+        threads = n;
+    }
+
+    /* The calling thread is a worker too. If a thread can't be
+     * started, the ones running take over its share. */
+    if (threads > 1) {
+        pool = malloc((threads - 1) * sizeof(*pool));
+    }
+    while (pool && started < threads - 1 && 0 == pthread_create(&pool[started], NULL, )" + base_name + R"(_worker, &m)) {
+        ++started;
+    }
+    )" + base_name + R"(_worker(&m);
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(pool[i], NULL);
+    }
+    free(pool);
+    return (int)atomic_load(&m.failed);
+}
+)";
+}
+
+// Schema independent part of _print and the TOML writers, emitted verbatim
+static const char* writer_runtime = R"rt(/* Output buffer: a caller's buffer, whose overflow is only counted, or
+ * one on the heap that grows. */
+typedef struct {
+    char* buf;
+    size_t len;
+    size_t cap;
+    int heap;
+    int failed;
+} tw_t;
+
+#define TW_LIT(w, s) tw_put(w, s, sizeof(s) - 1)
+
+static inline void tw_put(tw_t* w, const char* s, size_t n) {
+    if (w->heap && !w->failed && w->cap - w->len < n) {
+        size_t cap = w->cap ? w->cap : 4096;
+        char* grown;
+        while (cap - w->len < n) {
+            cap *= 2;
+        }
+        if ((grown = realloc(w->buf, cap))) {
+            w->buf = grown;
+            w->cap = cap;
+        } else {
+            w->failed = 1;
+        }
+    }
+    if (w->len < w->cap) {
+        memcpy(w->buf + w->len, s, n < w->cap - w->len ? n : w->cap - w->len);
+    }
+    w->len += n;
+}
+
+static inline void tw_int(tw_t* w, int64_t v) {
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    uint64_t u = v < 0 ? -(uint64_t)v : (uint64_t)v;
+
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0) {
+        *--p = '-';
+    }
+    tw_put(w, p, tmp + sizeof(tmp) - p);
+}
+
+static inline void tw_bool(tw_t* w, bool v) {
+    tw_put(w, v ? "true" : "false", v ? 4 : 5);
+}
+
+/* Verbatim, as printf's %s would */
+static inline void tw_raw(tw_t* w, const char* s) {
+    s = s ? s : "(null)";
+    tw_put(w, s, strlen(s));
+}
+
+/* A TOML basic string */
+static inline void tw_quoted(tw_t* w, const char* s) {
+    static const char hex[] = "0123456789abcdef";
+    const char* run = s;
+
+    TW_LIT(w, "\"");
+    for (; *s; ++s) {
+        const unsigned char c = (unsigned char)*s;
+        char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+        size_t n = 6;
+
+        if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7f) {
+            continue;
+        }
+        tw_put(w, run, s - run);
+        run = s + 1;
+        switch (c) {
+            case '"': case '\\': esc[1] = (char)c; n = 2; break;
+            case '\b': esc[1] = 'b'; n = 2; break;
+            case '\t': esc[1] = 't'; n = 2; break;
+            case '\n': esc[1] = 'n'; n = 2; break;
+            case '\f': esc[1] = 'f'; n = 2; break;
+            case '\r': esc[1] = 'r'; n = 2; break;
+        }
+        tw_put(w, esc, n);
+    }
+    tw_put(w, run, s - run);
+    TW_LIT(w, "\"");
+}
+
+)rt";
+
+// tw_double and its exact digits, for the schemas with a float
+static const char* double_runtime = R"rt(/* A natural number for tw_digits, in 32-bit words, least significant
+ * first and without leading zero words. */
+typedef struct {
+    int n;
+    uint32_t w[40];
+} tw_big_t;
+
+static inline void tw_big_shl(tw_big_t* a, int bits) {
+    int words = bits / 32;
+    uint32_t carry = 0;
+
+    if ((bits %= 32)) {
+        for (int i = 0; i < a->n; ++i) {
+            uint32_t x = a->w[i];
+            a->w[i] = x << bits | carry;
+            carry = x >> (32 - bits);
+        }
+        if (carry) {
+            a->w[a->n++] = carry;
+        }
+    }
+    if (words && a->n) {
+        memmove(a->w + words, a->w, a->n * sizeof(a->w[0]));
+        memset(a->w, 0, words * sizeof(a->w[0]));
+        a->n += words;
+    }
+}
+
+/* a = v << bits */
+static inline void tw_big_set(tw_big_t* a, uint64_t v, int bits) {
+    for (a->n = 0; v; v >>= 32) {
+        a->w[a->n++] = (uint32_t)v;
+    }
+    tw_big_shl(a, bits);
+}
+
+static inline void tw_big_mul(tw_big_t* a, uint32_t m) {
+    uint64_t carry = 0;
+
+    for (int i = 0; i < a->n; ++i) {
+        carry += (uint64_t)a->w[i] * m;
+        a->w[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry) {
+        a->w[a->n++] = (uint32_t)carry;
+    }
+}
+
+static inline void tw_big_pow10(tw_big_t* a, int k) {
+    static const uint32_t pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000,
+                                      10000000, 100000000, 1000000000 };
+
+    for (; k >= 9; k -= 9) {
+        tw_big_mul(a, pow10[9]);
+    }
+    tw_big_mul(a, pow10[k]);
+}
+
+/* Divides a by d, returning the remainder */
+static inline uint32_t tw_big_div(tw_big_t* a, uint32_t d) {
+    uint64_t rem = 0;
+
+    for (int i = a->n; i-- > 0;) {
+        rem = rem << 32 | a->w[i];
+        a->w[i] = (uint32_t)(rem / d);
+        rem %= d;
+    }
+    while (a->n && !a->w[a->n - 1]) {
+        --a->n;
+    }
+    return (uint32_t)rem;
+}
+
+static inline void tw_big_add(tw_big_t* sum, const tw_big_t* a, const tw_big_t* b) {
+    uint64_t carry = 0;
+    int n = a->n > b->n ? a->n : b->n;
+
+    for (int i = 0; i < n; ++i) {
+        carry += (uint64_t)(i < a->n ? a->w[i] : 0) + (i < b->n ? b->w[i] : 0);
+        sum->w[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    sum->n = n;
+    if (carry) {
+        sum->w[sum->n++] = (uint32_t)carry;
+    }
+}
+
+/* a -= b, where b <= a */
+static inline void tw_big_sub(tw_big_t* a, const tw_big_t* b) {
+    uint32_t borrow = 0;
+
+    for (int i = 0; i < a->n; ++i) {
+        uint64_t d = (uint64_t)a->w[i] - (i < b->n ? b->w[i] : 0) - borrow;
+        a->w[i] = (uint32_t)d;
+        borrow = (uint32_t)(d >> 63);
+    }
+    while (a->n && !a->w[a->n - 1]) {
+        --a->n;
+    }
+}
+
+static inline int tw_big_cmp(const tw_big_t* a, const tw_big_t* b) {
+    if (a->n != b->n) {
+        return a->n < b->n ? -1 : 1;
+    }
+    for (int i = a->n; i-- > 0;) {
+        if (a->w[i] != b->w[i]) {
+            return a->w[i] < b->w[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/* Puts the fewest digits that read back as v, finite and > 0, in digits,
+ * the closest to v of them, and returns their count; v is 0.DIGITS times
+ * 10^*k. This is the free-format algorithm of Burger and Dybvig on exact
+ * integers: r / s is the value still to write, m- / s and m+ / s the
+ * distances to the midpoints with its neighbours, which round to v when
+ * its mantissa is even. */
+static inline int tw_digits(double v, char* digits, int* k) {
+    tw_big_t r, s, mm, mp, t;
+    uint64_t bits, f;
+    int e, even, lower, bit_len, n = 0;
+    double est;
+
+    memcpy(&bits, &v, sizeof(bits));
+    f = bits & (((uint64_t)1 << 52) - 1);
+    e = (int)(bits >> 52 & 0x7ff);
+    if (e) {
+        f |= (uint64_t)1 << 52;
+        e -= 1075;
+    } else {
+        e = -1074;
+    }
+    even = !(f & 1);
+    /* At a power of two the neighbour below is half as far as the one above */
+    lower = e > -1074 && f == (uint64_t)1 << 52;
+    if (e >= 0) {
+        tw_big_set(&r, f, e + 1 + lower);
+        tw_big_set(&s, 2, lower);
+        tw_big_set(&mp, 1, e + lower);
+        tw_big_set(&mm, 1, e);
+    } else {
+        tw_big_set(&r, f, 1 + lower);
+        tw_big_set(&s, 1, 1 - e + lower);
+        tw_big_set(&mp, 1, lower);
+        tw_big_set(&mm, 1, 0);
+    }
+    /* log10(v) from below, then up to the first k where r + m+ < s */
+    for (bit_len = 0; f >> bit_len; ++bit_len) {
+    }
+    est = (e + bit_len - 1) * 0.30102999566398114;
+    *k = (int)est;
+    *k += est > *k;
+    if (*k >= 0) {
+        tw_big_pow10(&s, *k);
+    } else {
+        tw_big_pow10(&r, -*k);
+        tw_big_pow10(&mp, -*k);
+        tw_big_pow10(&mm, -*k);
+    }
+    for (;;) {
+        int c;
+        tw_big_add(&t, &r, &mp);
+        c = tw_big_cmp(&t, &s);
+        if (even ? c < 0 : c <= 0) {
+            break;
+        }
+        tw_big_mul(&s, 10);
+        ++*k;
+    }
+    for (;;) {
+        int d = 0, low, high, c;
+
+        tw_big_mul(&r, 10);
+        tw_big_mul(&mp, 10);
+        tw_big_mul(&mm, 10);
+        while (tw_big_cmp(&r, &s) >= 0) {
+            tw_big_sub(&r, &s);
+            ++d;
+        }
+        c = tw_big_cmp(&r, &mm);
+        low = even ? c <= 0 : c < 0;
+        tw_big_add(&t, &r, &mp);
+        c = tw_big_cmp(&t, &s);
+        high = even ? c >= 0 : c > 0;
+        if (low && high) {
+            /* Either digit reads back: the closer, or the even one on a tie */
+            tw_big_shl(&r, 1);
+            c = tw_big_cmp(&r, &s);
+            d += c > 0 || (c == 0 && (d & 1));
+        } else if (high) {
+            ++d;
+        }
+        digits[n++] = (char)('0' + d);
+        if (low || high) {
+            return n;
+        }
+    }
+}
+
+/* The digits of v, integral and >= 1 */
+static inline int tw_integral(double v, char* digits) {
+    tw_big_t a;
+    uint64_t bits, f;
+    int e, n = 0;
+
+    memcpy(&bits, &v, sizeof(bits));
+    f = (bits & (((uint64_t)1 << 52) - 1)) | (uint64_t)1 << 52;
+    e = (int)(bits >> 52 & 0x7ff) - 1075;
+    tw_big_set(&a, e < 0 ? f >> -e : f, e < 0 ? 0 : e);
+    while (a.n) {
+        digits[n++] = (char)('0' + tw_big_div(&a, 10));
+    }
+    for (int i = 0; i < n / 2; ++i) {
+        char c = digits[i];
+        digits[i] = digits[n - 1 - i];
+        digits[n - 1 - i] = c;
+    }
+    return n;
+}
+
+/* v as std::to_chars writes it, which is the shortest text that reads back
+ * as v: the fewest digits, in fixed or exponent notation, whichever is
+ * shorter. A fixed integral value gets ".0" to read as a TOML float. */
+static inline void tw_double(tw_t* w, double v) {
+    char digits[32];
+    char tmp[40];
+    int n, k, len = 0, exp, fixed, sci;
+
+    if (isnan(v)) {
+        TW_LIT(w, "nan");
+        return;
+    }
+    if (isinf(v)) {
+        tw_put(w, v < 0 ? "-inf" : "inf", v < 0 ? 4 : 3);
+        return;
+    }
+    if (v == 0) {
+        tw_put(w, signbit(v) ? "-0.0" : "0.0", signbit(v) ? 4 : 3);
+        return;
+    }
+    if (v < 0) {
+        tmp[len++] = '-';
+        v = -v;
+    }
+    n = tw_digits(v, digits, &k);
+    exp = k - 1;
+    fixed = k >= n ? k : k > 0 ? n + 1 : n + 2 - k;
+    sci = n + (n > 1) + 2 + (exp <= -100 || exp >= 100 ? 3 : 2);
+    if (fixed <= sci) {
+        if (k > n) {
+            /* Past the shortest digits, std::to_chars writes v exactly */
+            n = tw_integral(v, digits);
+        }
+        if (k <= 0) {
+            tmp[len++] = '0';
+            tmp[len++] = '.';
+            for (int i = k; i < 0; ++i) {
+                tmp[len++] = '0';
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            if (i == k && k > 0) {
+                tmp[len++] = '.';
+            }
+            tmp[len++] = digits[i];
+        }
+        if (k >= n) {
+            tmp[len++] = '.';
+            tmp[len++] = '0';
+        }
+    } else {
+        tmp[len++] = digits[0];
+        if (n > 1) {
+            tmp[len++] = '.';
+            memcpy(tmp + len, digits + 1, n - 1);
+            len += n - 1;
+        }
+        tmp[len++] = 'e';
+        tmp[len++] = exp < 0 ? '-' : '+';
+        exp = exp < 0 ? -exp : exp;
+        if (exp >= 100) {
+            tmp[len++] = (char)('0' + exp / 100);
+        }
+        tmp[len++] = (char)('0' + exp / 10 % 10);
+        tmp[len++] = (char)('0' + exp % 10);
+    }
+    tw_put(w, tmp, len);
+}
+
+)rt";
+
+// _print, and with --write the TOML writers _write_toml and _write_file. All
+// format into a tw_t buffer, which is written out at once.
+void Writer::c_print(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+    const std::string obj = this->ptr;
+    const std::vector<const Table*> tables = schema_tables(root);
+
+    this->out += writer_runtime;
+    if (std::any_of(tables.begin(), tables.end(), [] (const Table* t) {
+        return std::any_of(t->fields.begin(), t->fields.end(), [] (const Field& f) {
+            return f.type == Field::Type::t_double || f.type == Field::Type::t_array_of_double;
+        });
+    })) {
+        this->out += double_runtime;
+    }
+
+    // Appends the value expression src of a field of type type
+    auto value = [&] (Field::Type type, const std::string& src, bool toml) {
+        switch (type) {
+            case Field::Type::t_int:
+            case Field::Type::t_array_of_int:
+                return "tw_int(w, " + src + ");";
+            case Field::Type::t_double:
+            case Field::Type::t_array_of_double:
+                return "tw_double(w, " + src + ");";
+            case Field::Type::t_bool:
+            case Field::Type::t_array_of_bool:
+                return "tw_bool(w, " + src + ");";
+            default:
+                return std::string(toml ? "tw_quoted(w, " : "tw_raw(w, ") + src + ");";
+        }
+    };
+    auto lit = [&] (const std::string& s) {
+        return "TW_LIT(w, " + c_string(s) + ");";
+    };
+
+    // The dump _print shows: one line per value, named after the struct members
+    this->put("static void ", base_name, "_dump(const ", name, "* ", obj, ", tw_t* w) {\n");
+    this->put("    ", lit("Read " + this->o_name + ".toml values:\n"), "\n");
+    std::function<void(const Table&)> dump_r;
+    dump_r = [&] (const Table& t)->void {
+        // Entries print as routes[1].via, whatever their layout
+        const std::string index = t.path + "_i";
+        std::string label = this->o_var + "." + t.var;
+        size_t body = 0;
+        if (t.array) {
+            this->put("    for (size_t ", index, " = 0; ", index, " < ", this->count(obj, t), "; ++", index, ") {\n");
+            body = this->out.size();
+        }
+        for (const Field& f: t.fields) {
+            std::string src = f.packed && f.type == Field::Type::t_bool ? this->bit(obj, t, f) : this->member(obj, t, f, index);
+            if (f.type == Field::Type::t_enum) {
+                src = this->enum_string(t, f, src);
+            }
+            const std::string len = this->member(obj, t, f, index, "_len");
+            std::string head;
+            if (t.array) {
+                head = "    " + lit(this->o_var + "." + t.var.substr(0, t.var.size()-1) + "[") + " tw_int(w, (int64_t)" + index + "); " + lit("]." + f.name);
+            } else {
+                head = "    " + lit(label + f.name);
+            }
+            if (f.type < Field::Type::t_array) {
+                this->put(head, "\n    ", lit(" = "), " ", value(f.type, src, false), " ", lit("\n"), "\n");
+                continue;
+            }
+            const std::string el = f.packed ? this->base_name + t.path.substr(4) + "_" + f.name + "(" + obj + ", i)" : src + "[i]";
+            this->put("    for (size_t i = 0; i < ", len, "; ++i) {\n");
+            this->put("    ", head, "\n");
+            this->put("        ", lit("["), " tw_int(w, (int64_t)i); ", lit("] = "), " ", value(f.type, el, false), " ", lit("\n"), "\n");
+            this->out += "    }\n";
+        }
+        if (t.array) {
+            this->indent_since(body);
+            this->out += "    }\n";
+        }
+        for (const Table* c: t.children) {
+            dump_r(*c);
+        }
+    };
+    dump_r(root);
+    this->out += "}\n\n";
+
+    this->put("void ", base_name, "_print(const ", name, "* ", obj, ") {\n");
+    this->out += "    tw_t w = {.heap = 1};\n\n";
+    this->put("    ", base_name, "_dump(", obj, ", &w);\n");
+    this->out += "    fwrite(w.buf, 1, w.len < w.cap ? w.len : w.cap, stdout);\n";
+    this->out += "    fflush(stdout);\n    free(w.buf);\n}\n\n";
+    if (!this->opts.write) {
+        return;
+    }
+
+    // TOML: the root's keys, then one [table] or [[array]] header per table
+    this->put("static void ", base_name, "_toml(const ", name, "* ", obj, ", tw_t* w) {\n");
+    std::function<void(const Table&)> toml_r;
+    toml_r = [&] (const Table& t)->void {
+        const std::string index = t.path + "_i";
+        std::string header;
+        for (const Table* p = &t; p->parent; p = p->parent) {
+            header = toml_key(p->name) + (header.empty() ? "" : ".") + header;
+        }
+        size_t body = 0;
+        if (t.array) {
+            this->put("    for (size_t ", index, " = 0; ", index, " < ", this->count(obj, t), "; ++", index, ") {\n");
+            body = this->out.size();
+            this->put("    ", lit("\n[[" + header + "]]\n"), "\n");
+        } else if (t.parent) {
+            this->put("    ", lit("\n[" + header + "]\n"), "\n");
+        }
+        for (const Field& f: t.fields) {
+            std::string src = f.packed && f.type == Field::Type::t_bool ? this->bit(obj, t, f) : this->member(obj, t, f, index);
+            if (f.type == Field::Type::t_enum) {
+                src = this->enum_string(t, f, src);
+            }
+            const std::string len = this->member(obj, t, f, index, "_len");
+            const std::string key = lit(toml_key(f.key) + " = ");
+            if (f.type == Field::Type::t_string && !f.cap) {
+                // A missing string stays missing
+                this->put("    if (", src, ") {\n");
+                this->put("        ", key, " ", value(f.type, src, true), " ", lit("\n"), "\n");
+                this->out += "    }\n";
+            } else if (f.type < Field::Type::t_array) {
+                this->put("    ", key, " ", value(f.type, src, true), " ", lit("\n"), "\n");
+            } else {
+                const std::string el = f.packed ? this->base_name + t.path.substr(4) + "_" + f.name + "(" + obj + ", i)" : src + "[i]";
+                this->put("    ", key, " ", lit("["), "\n");
+                this->put("    for (size_t i = 0; i < ", len, "; ++i) {\n");
+                this->put("        if (i) {\n            ", lit(", "), "\n        }\n");
+                if (f.type == Field::Type::t_array_of_string) {
+                    this->put("        ", value(f.type, el + " ? " + el + " : \"\"", true), "\n");
+                } else {
+                    this->put("        ", value(f.type, el, true), "\n");
+                }
+                this->put("    }\n    ", lit("]\n"), "\n");
+            }
+        }
+        if (t.array) {
+            this->indent_since(body);
+            this->out += "    }\n";
+        }
+        for (const Table* c: t.children) {
+            toml_r(*c);
+        }
+    };
+    toml_r(root);
+    this->out += "}\n\n";
+
+    this->put("size_t ", base_name, "_write_toml(const ", name, "* ", obj, ", char* buf, size_t cap) {\n");
+    this->out += "    tw_t w = {.buf = buf, .cap = cap ? cap - 1 : 0};\n\n";
+    this->put("    ", base_name, "_toml(", obj, ", &w);\n");
+    this->out += "    if (cap) {\n        buf[w.len < w.cap ? w.len : w.cap] = '\\0';\n    }\n";
+    this->out += "    return w.len;\n}\n\n";
+
+    this->put("int ", base_name, "_write_file(const ", name, "* ", obj, ", const char* path) {");
+    this->out += R"(
+    tw_t w = {.heap = 1};
+    size_t done = 0;
+    ssize_t n;
+    int fd;
+
+    )" + base_name + "_toml(" + obj + R"(, &w);
+    if (w.failed) {
+        )" + base_name + "_error(\"" + base_name + R"(_write_file() failed: out of memory");
+        free(w.buf);
+        return 1;
+    }
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        )" + base_name + "_error(\"" + base_name + R"(_write_file() failed: couldn't open %s", path);
+        free(w.buf);
+        return 1;
+    }
+    while (done < w.len) {
+        if ((n = write(fd, w.buf + done, w.len - done)) < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    free(w.buf);
+    if (close(fd) || done < w.len) {
+        )" + base_name + "_error(\"" + base_name + R"(_write_file() failed: couldn't write %s", path);
+        return 1;
+    }
+    return 0;
+}
+
+)";
+}
+
+// Schema independent part of _hash, _equal and _diff, emitted verbatim
+static const char* compare_runtime = R"rt(static inline uint64_t th_mix(uint64_t h, uint64_t v) {
+    h = (h ^ v) * 0xff51afd7ed558ccdu;
+    return h ^ (h >> 32);
+}
+
+/* Eight bytes at a time, then the tail and the length */
+static inline uint64_t th_bytes(uint64_t h, const void* p, size_t n) {
+    const unsigned char* s = p;
+    uint64_t v = 0;
+
+    for (; n >= 8; n -= 8, s += 8) {
+        memcpy(&v, s, 8);
+        h = th_mix(h, v);
+    }
+    v = 0;
+    if (n) {
+        memcpy(&v, s, n);
+    }
+    return th_mix(h, v ^ (uint64_t)n << 56);
+}
+
+static inline uint64_t th_str(uint64_t h, const char* s) {
+    return s ? th_bytes(h, s, strlen(s)) : th_mix(h, 0x6e756c6cu);
+}
+
+static inline uint64_t th_strs(uint64_t h, char* const* s, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        h = th_str(h, s[i]);
+    }
+    return th_mix(h, n);
+}
+
+/* n packed bools: whole bytes, then the used bits of the last one */
+static inline uint64_t th_bits(uint64_t h, const uint8_t* bits, size_t n) {
+    h = th_bytes(h, bits, n >> 3);
+    return th_mix(h, n & 7 ? bits[n >> 3] & ((1u << (n & 7)) - 1) : 0);
+}
+
+static inline bool th_mem_eq(const void* a, const void* b, size_t n) {
+    return !n || !memcmp(a, b, n);
+}
+
+static inline bool th_str_eq(const char* a, const char* b) {
+    return a && b ? !strcmp(a, b) : a == b;
+}
+
+static inline bool th_strs_eq(char* const* a, char* const* b, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (!th_str_eq(a[i], b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline bool th_bits_eq(const uint8_t* a, const uint8_t* b, size_t n) {
+    const unsigned mask = (1u << (n & 7)) - 1;
+    return th_mem_eq(a, b, n >> 3) && (!(n & 7) || !((a[n >> 3] ^ b[n >> 3]) & mask));
+}
+
+)rt";
+
+// _hash, _equal and _diff. Arrays compare and hash as whole blocks of
+// memory, and so do the scalar columns of --soa; floats compare bitwise,
+// so a NaN equals itself and the hash agrees with _equal.
+void Writer::c_compare(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+
+    this->out += compare_runtime;
+
+    // A whole column of t: the scalar f of every entry, contiguous with --soa
+    auto column = [&] (const std::string& obj, const Table& t, const Field& f) {
+        return this->opts.soa && t.array && (f.type < Field::Type::t_string || f.type == Field::Type::t_enum)
+            ? obj + "->" + t.var + f.name : std::string();
+    };
+    // Expression that is true when f of t is the same in a and b
+    auto same = [&] (const Table& t, const Field& f, const std::string& index) {
+        const std::string x = f.packed && f.type == Field::Type::t_bool ? this->bit("a", t, f) : this->member("a", t, f, index);
+        const std::string y = f.packed && f.type == Field::Type::t_bool ? this->bit("b", t, f) : this->member("b", t, f, index);
+        const std::string n = this->member("a", t, f, index, "_len");
+        const std::string lens = n + " == " + this->member("b", t, f, index, "_len") + " && ";
+        switch (f.type) {
+            case Field::Type::t_int:
+            case Field::Type::t_bool:
+            case Field::Type::t_enum:
+                return x + " == " + y;
+            case Field::Type::t_double:
+                return "th_mem_eq(&" + x + ", &" + y + ", sizeof(double))";
+            case Field::Type::t_string:
+                return f.cap ? "!strcmp(" + x + ", " + y + ")" : "th_str_eq(" + x + ", " + y + ")";
+            case Field::Type::t_array_of_string:
+                return lens + "th_strs_eq(" + x + ", " + y + ", " + n + ")";
+            default:
+                if (f.packed) {
+                    return lens + "th_bits_eq(" + x + ", " + y + ", " + n + ")";
+                }
+                return lens + "th_mem_eq(" + x + ", " + y + ", " + n + " * sizeof *" + x + ")";
+        }
+    };
+
+    this->put("uint64_t ", base_name, "_hash(const ", name, "* a) {\n");
+    this->out += "    uint64_t h = 0x243f6a8885a308d3u;\n";
+    this->out += "    uint64_t v;\n\n";
+    std::function<void(const Table&)> hash_r;
+    hash_r = [&] (const Table& t)->void {
+        const std::string index = t.path + "_i";
+        size_t body = 0;
+        if (t.array) {
+            const std::string n = this->count("a", t);
+            this->put("    h = th_mix(h, ", n, ");\n");
+            for (const Field& f: t.fields) {
+                const std::string col = column("a", t, f);
+                if (!col.empty()) {
+                    this->put("    h = th_bytes(h, ", col, ", ", n, " * sizeof *", col, ");\n");
+                }
+            }
+            this->put("    for (size_t ", index, " = 0; ", index, " < ", n, "; ++", index, ") {\n");
+            body = this->out.size();
+        }
+        for (const Field& f: t.fields) {
+            if (!column("a", t, f).empty()) {
+                continue;
+            }
+            const std::string x = f.packed && f.type == Field::Type::t_bool ? this->bit("a", t, f) : this->member("a", t, f, index);
+            const std::string n = this->member("a", t, f, index, "_len");
+            switch (f.type) {
+                case Field::Type::t_int:
+                case Field::Type::t_enum:
+                    this->put("    h = th_mix(h, (uint64_t)", x, ");\n");
+                    break;
+                case Field::Type::t_double:
+                    this->put("    memcpy(&v, &", x, ", 8);\n    h = th_mix(h, v);\n");
+                    break;
+                case Field::Type::t_bool:
+                    this->put("    h = th_mix(h, ", x, ");\n");
+                    break;
+                case Field::Type::t_string:
+                    this->put("    h = th_str(h, ", x, ");\n");
+                    break;
+                case Field::Type::t_array_of_string:
+                    this->put("    h = th_strs(h, ", x, ", ", n, ");\n");
+                    break;
+                default:
+                    if (f.packed) {
+                        this->put("    h = th_bits(h, ", x, ", ", n, ");\n");
+                    } else {
+                        this->put("    h = th_bytes(h, ", x, ", ", n, " * sizeof *", x, ");\n");
+                    }
+                    break;
+            }
+        }
+        if (t.array) {
+            this->indent_since(body);
+            this->out += "    }\n";
+        }
+        for (const Table* c: t.children) {
+            hash_r(*c);
+        }
+    };
+    hash_r(root);
+    this->out += "    (void)v;\n    return th_mix(h, h >> 29);\n}\n\n";
+
+    this->put("int ", base_name, "_equal(const ", name, "* a, const ", name, "* b) {\n");
+    std::function<void(const Table&)> equal_r;
+    equal_r = [&] (const Table& t)->void {
+        const std::string index = t.path + "_i";
+        size_t body = 0;
+        if (t.array) {
+            const std::string n = this->count("a", t);
+            this->put("    if (", n, " != ", this->count("b", t), ") {\n        return 0;\n    }\n");
+            for (const Field& f: t.fields) {
+                const std::string col = column("a", t, f);
+                if (!col.empty()) {
+                    this->put("    if (!th_mem_eq(", col, ", ", column("b", t, f), ", ", n, " * sizeof *", col, ")) {\n        return 0;\n    }\n");
+                }
+            }
+            this->put("    for (size_t ", index, " = 0; ", index, " < ", n, "; ++", index, ") {\n");
+            body = this->out.size();
+        }
+        for (const Field& f: t.fields) {
+            if (column("a", t, f).empty()) {
+                this->put("    if (!(", same(t, f, index), ")) {\n        return 0;\n    }\n");
+            }
+        }
+        if (t.array) {
+            this->indent_since(body);
+            this->out += "    }\n";
+        }
+        for (const Table* c: t.children) {
+            equal_r(*c);
+        }
+    };
+    equal_r(root);
+    this->out += "    return 1;\n}\n\n";
+
+    // Every field is tested on its own, so one entry of an array of tables
+    // that differs in two keys reports both
+    this->put("size_t ", base_name, "_diff(const ", name, "* a, const ", name, "* b, const char** changed, size_t cap) {\n");
+    this->out += "    size_t n = 0;\n\n";
+    std::function<void(const Table&)> diff_r;
+    diff_r = [&] (const Table& t)->void {
+        const std::string index = t.path + "_i";
+        auto changed = [&] (const std::string& path, const std::string& indent) {
+            this->put(indent, "if (n < cap) {\n", indent, "    changed[n] = ", c_string(path), ";\n", indent, "}\n");
+            this->put(indent, "++n;\n");
+        };
+        if (t.array) {
+            const std::string n = this->count("a", t);
+            this->put("    if (", n, " != ", this->count("b", t), ") {\n");
+            changed(key_path(*t.parent, t.name), "        ");
+            this->out += "    } else {\n";
+            for (const Field& f: t.fields) {
+                const std::string col = column("a", t, f);
+                if (!col.empty()) {
+                    this->put("        if (!th_mem_eq(", col, ", ", column("b", t, f), ", ", n, " * sizeof *", col, ")) {\n");
+                    changed(key_path(t, f.key), "            ");
+                    this->out += "        }\n";
+                    continue;
+                }
+                this->put("        for (size_t ", index, " = 0; ", index, " < ", n, "; ++", index, ") {\n");
+                this->put("            if (!(", same(t, f, index), ")) {\n");
+                changed(key_path(t, f.key), "                ");
+                this->out += "                break;\n            }\n        }\n";
+            }
+            this->out += "    }\n";
+        } else {
+            for (const Field& f: t.fields) {
+                this->put("    if (!(", same(t, f, index), ")) {\n");
+                changed(key_path(t, f.key), "        ");
+                this->out += "    }\n";
+            }
+        }
+        for (const Table* c: t.children) {
+            diff_r(*c);
+        }
+    };
+    diff_r(root);
+    this->out += "    return n;\n}\n\n";
+}
+
+// Names of the --enum values, and their lookup: one perfect hash over all
+// enums, salted with the enum's number
+void Writer::c_enums(const Table& root) {
+    std::vector<std::pair<uint32_t, std::string>> keys;
+    std::vector<int> values;
+
+    this->enum_ids.clear();
+    std::function<void(const Table&)> enums_r;
+    enums_r = [&] (const Table& t)->void {
+        for (const Field& f: t.fields) {
+            if (f.type != Field::Type::t_enum) {
+                continue;
+            }
+            const int id = this->enum_ids.size();
+            this->enum_ids[&f] = id;
+            this->put("static const char* const ", this->base_name, t.path.substr(4), "_", f.name, "_names[] = {");
+            for (size_t i = 0; i < f.values.size(); ++i) {
+                this->put(i ? ", " : "", c_string(f.values[i]));
+                keys.emplace_back(id, f.values[i]);
+                values.push_back(i);
+            }
+            this->out += "};\n";
+        }
+        for (const Table* c: t.children) {
+            enums_r(*c);
+        }
+    };
+    enums_r(root);
+    // The runtime of --table looks names up in the arrays, --stream still
+    // needs the lookup
+    if (!keys.empty()) {
+        this->out += "\n";
+    }
+    if (!keys.empty() && (!this->opts.table || this->opts.stream)) {
+        this->c_phash(this->base_name + "_enum", keys, values);
+    }
+}
+
+// Reflection: a table of the fields outside arrays of tables, found by
+// dotted key path through a perfect hash, and generic accessors over it.
+// Without --reflect, only the tables --table runs on.
+void Writer::c_reflect(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+    const std::string u = mvar(LIB_BASE_NAMEu);
+    const std::string field_t = LIB_BASE_NAMEu + "field_t";
+    static const char* types[] = {
+        "INT", "DOUBLE", "BOOL", "STRING", "ENUM", "ARRAY",
+        "ARRAY_OF_INT", "ARRAY_OF_DOUBLE", "ARRAY_OF_BOOL", "ARRAY_OF_STRING"
+    };
+
+    // Entries of arrays of tables have no fixed offset
+    std::vector<std::pair<const Table*, const Field*>> fields;
+    std::function<void(const Table&)> fields_r;
+    fields_r = [&] (const Table& t)->void {
+        if (t.array) {
+            return;
+        }
+        for (const Field& f: t.fields) {
+            fields.emplace_back(&t, &f);
+        }
+        for (const Table* c: t.children) {
+            fields_r(*c);
+        }
+    };
+    fields_r(root);
+    const size_t outside = fields.size();
+
+    // With --table the runtime needs them too, after the others, and every
+    // table, breadth first so that the children of each are contiguous
+    std::vector<const Table*> tables{&root};
+    std::map<const Table*, size_t> first;
+    if (this->opts.table) {
+        for (size_t i = 0; i < tables.size(); ++i) {
+            tables.insert(tables.end(), tables[i]->children.begin(), tables[i]->children.end());
+        }
+        for (const Table* t: tables) {
+            if (t->array) {
+                first[t] = fields.size();
+                for (const Field& f: t->fields) {
+                    fields.emplace_back(t, &f);
+                }
+            }
+        }
+    }
+
+    // A quoted key with a dot can spell another field's path: the first wins
+    std::vector<std::pair<uint32_t, std::string>> keys;
+    std::vector<int> values;
+    std::set<std::string> seen;
+    std::string enum_ids;
+    bool enums = false;
+    this->put(this->opts.reflect ? "" : "static ", "const ", field_t, " ", base_name, "_fields[", std::to_string(std::max<size_t>(fields.size(), 1)), "] = {\n");
+    for (size_t i = 0; i < fields.size(); ++i) {
+        const Table& t = *fields[i].first;
+        const Field& f = *fields[i].second;
+        const std::string path = key_path(t, f.key);
+        const std::string of = t.array ? "offsetof(struct " + base_name + t.path.substr(4) + ", "
+            : "offsetof(" + (f.cold ? base_name + "_cold_t" : name) + ", " + t.var;
+        const bool bit = f.packed && f.type == Field::Type::t_bool;
+        const bool enumerated = f.type == Field::Type::t_enum;
+
+        if (!first.count(&t)) {
+            first[&t] = i;
+        }
+        if (i == outside) {
+            this->out += "    /* Entries of arrays of tables */\n";
+        }
+        this->put("    { ", c_string(path), ", ", c_string(f.name), ", ", u, types[static_cast<int>(f.type)], ", ", f.cold ? "true" : "false", ", ", f.packed ? "true" : "false", ", ");
+        if (bit) {
+            this->put(std::to_string(f.bit % 8), ", ", of, LIB_BASE_NAMEu, "bits) + ", std::to_string(f.bit / 8), ", ");
+        } else {
+            this->put("0, ", of, f.name, "), ");
+        }
+        this->put(f.type >= Field::Type::t_array ? of + f.name + "_len)" : "SIZE_MAX", ", ", std::to_string(f.cap), ", ");
+        if (enumerated) {
+            this->put(base_name, t.path.substr(4), "_", f.name, "_names, ", std::to_string(f.values.size()), " },\n");
+        } else {
+            this->out += "NULL, 0 },\n";
+        }
+        enums |= enumerated && i < outside;
+        enum_ids += (i ? ", " : "") + (enumerated ? std::to_string(this->enum_ids.at(&f)) : std::string("-1"));
+        if (i < outside && seen.insert(path).second) {
+            keys.emplace_back(0, path);
+            values.push_back(i);
+        }
+    }
+    if (fields.empty()) {
+        this->out += "    { 0 }\n";
+    }
+    this->out += "};\n";
+    if (this->opts.reflect) {
+        this->put("const size_t ", base_name, "_n_fields = ", std::to_string(outside), ";\n");
+    }
+    this->out += "\n";
+    if (this->opts.table) {
+        const std::string table_t = LIB_BASE_NAMEu + "rt_table_t";
+        size_t child = 1;
+        this->put("static const ", table_t, " ", base_name, "_tables[] = {\n");
+        for (const Table* t: tables) {
+            std::string header;
+            for (const Table* p = t; p->parent; p = p->parent) {
+                header = toml_key(p->name) + (header.empty() ? "" : ".") + header;
+            }
+            this->put("    { ", t->parent ? c_string(t->name) : "NULL", ", ", c_string(t->parent ? key_path(*t->parent, t->name) : ""), ", ");
+            this->put(c_string(header), ", ", c_string(t->var), ", ");
+            if (t->array) {
+                const std::string entries = t->var.substr(0, t->var.size()-1);
+                this->put("true, offsetof(", name, ", ", entries, "), offsetof(", name, ", ", entries, "_len), sizeof(struct ", base_name, t->path.substr(4), "), ");
+            } else {
+                this->out += "false, 0, 0, 0, ";
+            }
+            this->put(std::to_string(t->fields.empty() ? 0 : first.at(t)), ", ", std::to_string(t->fields.size()), ", ");
+            this->put(std::to_string(child), ", ", std::to_string(t->children.size()), " },\n");
+            child += t->children.size();
+        }
+        this->out += "};\n\n";
+        this->put("static const ", LIB_BASE_NAMEu, "schema_t ", base_name, "_rt = {\n");
+        this->put("    ", c_string(base_name), ", ", c_string(this->o_name), ", ", c_string(this->o_var), ",\n");
+        this->put("    sizeof(", name, "), ", base_name, "_tables, ", base_name, "_fields, ", base_name, "_error\n};\n\n");
+    }
+    if (!this->opts.reflect) {
+        return;
+    }
+    if (enums && !this->opts.table) {
+        this->out += "/* Each field's number for the enum lookup, or -1 */\n";
+        this->put("static const int ", base_name, "_fields_enum[] = {", enum_ids, "};\n\n");
+    }
+    if (!keys.empty()) {
+        this->c_phash(base_name + "_path", keys, values);
+    }
+
+    this->put("const ", field_t, "* ", base_name, "_find_path(const char* path) {\n");
+    if (keys.empty()) {
+        this->out += "    (void)path;\n    return NULL;\n}\n\n";
+    } else {
+        this->put("    const int i = ", base_name, "_path(0, path, strlen(path));\n\n");
+        this->put("    return i < 0 ? NULL : &", base_name, "_fields[i];\n}\n\n");
+    }
+
+    this->put("static char* ", base_name, "_at(const ", name, "* ", this->ptr, ", const ", field_t, "* f) {\n");
+    if (this->opts.cold.empty()) {
+        this->put("    return (char*)", this->ptr, " + f->offset;\n}\n\n");
+    } else {
+        this->put("    return (f->cold ? (char*)", this->ptr, "->", LIB_BASE_NAMEu, "cold : (char*)", this->ptr, ") + f->offset;\n}\n\n");
+    }
+
+    this->put("const void* ", base_name, "_get_path(const ", name, "* ", this->ptr, ", const char* path, const ", field_t, "** field) {\n");
+    this->put("    const ", field_t, "* f = ", base_name, "_find_path(path);\n\n");
+    this->out += "    if (field) {\n        *field = f;\n    }\n";
+    this->put("    return f ? ", base_name, "_at(", this->ptr, ", f) : NULL;\n}\n\n");
+    if (this->opts.table) {
+        this->put("int ", base_name, "_set_path(", name, "* ", this->ptr, ", const char* path, const char* value) {\n");
+        this->put("    return ", LIB_BASE_NAMEu, "rt_set_path(&", base_name, "_rt, ", this->ptr, ", ", base_name, "_find_path(path), path, value);\n}\n\n");
+        return;
+    }
+
+    // A parsed value, which owns its string or array until stored
+    this->put("typedef struct {\n    int64_t i;\n    double d;\n    bool b;\n    char* s;\n    void* v;\n    size_t len;\n} ", base_name, "_value_t;\n\n");
+    this->put("static void ", base_name, "_value_free(", LIB_BASE_NAMEu, "type_t type, ", base_name, "_value_t* v) {\n");
+    this->put("    if (type == ", u, "ARRAY_OF_STRING) {\n");
+    this->out += "        for (size_t i = 0; i < v->len; ++i) {\n            free(((char**)v->v)[i]);\n        }\n    }\n";
+    this->out += "    free(v->s);\n    free(v->v);\n}\n\n";
+
+    // The value, parsed by the backend's own parser
+    this->put("static int ", base_name, "_parse_value(", LIB_BASE_NAMEu, "type_t type, const char* value, ", base_name, "_value_t* v) {\n");
+    if (this->opts.direct) {
+        this->out += R"(    char err[128] = "";
+    tp_t tp = { value, value, value + strlen(value), err, sizeof(err), 0 };
+    int rc;
+
+    tp_ws(&tp);
+    switch (type) {
+        case )" + u + R"(INT: rc = tp_int(&tp, &v->i); break;
+        case )" + u + R"(DOUBLE: rc = tp_double(&tp, &v->d); break;
+        case )" + u + R"(BOOL: rc = tp_bool(&tp, &v->b); break;
+        case )" + u + R"(STRING:
+        case )" + u + R"(ENUM: rc = tp_string(&tp, &v->s); break;
+        case )" + u + R"(ARRAY_OF_INT: rc = tp_numbers(&tp, &v->v, &v->len, 0); break;
+        case )" + u + R"(ARRAY_OF_DOUBLE: rc = tp_numbers(&tp, &v->v, &v->len, 1); break;
+        case )" + u + R"(ARRAY_OF_BOOL: rc = tp_array(&tp, &v->v, &v->len, sizeof(bool), tp_bool_el); break;
+        case )" + u + R"(ARRAY_OF_STRING: rc = tp_array(&tp, &v->v, &v->len, sizeof(char*), tp_string_el); break;
+        default: rc = -1; break;
+    }
+    tp_ws(&tp);
+    return rc || tp.p != tp.end ? -1 : 0;
+}
+
+)";
+    } else {
+        // A one-key document
+        this->out += R"(    const size_t n = strlen(value);
+    char* conf = malloc(n + 6);
+    char err[128];
+    toml_table_t* doc;
+    toml_array_t* arr;
+    toml_datum_t datum = { 0 };
+    int rc = 0;
+
+    if (!conf) {
+        return -1;
+    }
+    memcpy(conf, "v = ", 4);
+    memcpy(conf + 4, value, n);
+    memcpy(conf + 4 + n, "\n", 2);
+    doc = toml_parse(conf, err, sizeof(err));
+    free(conf);
+    if (!doc) {
+        return -1;
+    }
+    if (toml_key_in(doc, 1)) {
+        toml_free(doc);
+        return -1;
+    }
+    switch (type) {
+        case )" + u + R"(INT: datum = toml_int_in(doc, "v"); v->i = datum.u.i; break;
+        case )" + u + R"(DOUBLE: datum = toml_double_in(doc, "v"); v->d = datum.u.d; break;
+        case )" + u + R"(BOOL: datum = toml_bool_in(doc, "v"); v->b = datum.u.b; break;
+        case )" + u + R"(STRING:
+        case )" + u + R"(ENUM: datum = toml_string_in(doc, "v"); v->s = datum.u.s; break;
+        case )" + u + R"(ARRAY_OF_INT:
+        case )" + u + R"(ARRAY_OF_DOUBLE:
+        case )" + u + R"(ARRAY_OF_BOOL:
+        case )" + u + R"(ARRAY_OF_STRING:
+            if (!(arr = toml_array_in(doc, "v"))) {
+                break;
+            }
+            v->len = toml_array_nelem(arr);
+            v->v = calloc(v->len ? v->len : 1, type == )" + u + R"(ARRAY_OF_BOOL ? sizeof(bool) : 8);
+            datum.ok = v->v != NULL;
+            for (size_t i = 0; i < v->len && datum.ok; ++i) {
+                switch (type) {
+                    case )" + u + R"(ARRAY_OF_INT: datum = toml_int_at(arr, i); ((int64_t*)v->v)[i] = datum.u.i; break;
+                    case )" + u + R"(ARRAY_OF_DOUBLE: datum = toml_double_at(arr, i); ((double*)v->v)[i] = datum.u.d; break;
+                    case )" + u + R"(ARRAY_OF_BOOL: datum = toml_bool_at(arr, i); ((bool*)v->v)[i] = datum.u.b; break;
+                    default: datum = toml_string_at(arr, i); ((char**)v->v)[i] = datum.u.s; break;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    rc = datum.ok ? 0 : -1;
+    toml_free(doc);
+    return rc;
+}
+
+)";
+    }
+
+    const std::string fail = base_name + "_error(\"" + base_name + "_set_path() failed: ";
+    this->put("int ", base_name, "_set_path(", name, "* ", this->ptr, ", const char* path, const char* value) {\n");
+    this->put("    const ", field_t, "* f = ", base_name, "_find_path(path);\n");
+    this->put("    ", base_name, "_value_t v = { 0 };\n");
+    this->out += "    char* dst;\n    size_t size;\n\n";
+    this->out += "    if (!f) {\n";
+    this->put("        ", fail, "no field %s\", path);\n        return 1;\n    }\n");
+    if (this->opts.arena) {
+        // Only the arena's own free releases what _read placed in it
+        this->put("    if (!f->cap && (f->type == ", u, "STRING || f->type >= ", u, "ARRAY)) {\n");
+        this->put("        ", fail, "%s lives in the arena\", path);\n        return 1;\n    }\n");
+    }
+    this->out += "    /* An unquoted string is taken as is */\n";
+    if (enums) {
+        this->put("    if ((f->type == ", u, "STRING || f->type == ", u, "ENUM) && value[0] != '\"' && value[0] != '\\'') {\n");
+    } else {
+        this->put("    if (f->type == ", u, "STRING && value[0] != '\"' && value[0] != '\\'') {\n");
+    }
+    this->out += "        v.s = strdup(value);\n";
+    this->put("    } else if (f->type == ", u, "ARRAY || ", base_name, "_parse_value(f->type, value, &v)) {\n");
+    this->put("        ", base_name, "_value_free(f->type, &v);\n");
+    this->put("        ", fail, "%s = %s is not a valid value\", path, value);\n        return 1;\n    }\n");
+    this->out += "    if (f->type == " + u + "STRING && !v.s) {\n";
+    this->put("        ", fail, "out of memory\");\n        return 1;\n    }\n");
+    this->put("    dst = ", base_name, "_at(", this->ptr, ", f);\n");
+    this->out += R"(    switch (f->type) {
+        case )" + u + R"(INT:
+            *(int64_t*)dst = v.i;
+            return 0;
+        case )" + u + R"(DOUBLE:
+            *(double*)dst = v.d;
+            return 0;
+        case )" + u + R"(BOOL:
+            if (f->packed) {
+                *(uint8_t*)dst = v.b ? *(uint8_t*)dst | 1u << f->bit : *(uint8_t*)dst & ~(1u << f->bit);
+            } else {
+                *(bool*)dst = v.b;
+            }
+            return 0;
+)";
+    if (enums) {
+        this->out += "        case " + u + "ENUM: {\n";
+        this->put("            const int e = v.s ? ", base_name, "_enum(", base_name, "_fields_enum[f - ", base_name, "_fields], v.s, strlen(v.s)) : -1;\n");
+        this->out += R"(
+            if (e < 0) {
+                )" + fail + R"(%s = %s is not one of its names", path, value);
+                free(v.s);
+                return 1;
+            }
+            *(int*)dst = e;
+            free(v.s);
+            return 0;
+        }
+)";
+    }
+    this->out += R"(        case )" + u + R"(STRING:
+            if (!f->cap) {
+                free(*(char**)dst);
+                *(char**)dst = v.s;
+                return 0;
+            }
+            if (strlen(v.s) >= f->cap) {
+                )" + fail + R"(%s is longer than %zu bytes", path, f->cap - 1);
+                free(v.s);
+                return 1;
+            }
+            memcpy(dst, v.s, strlen(v.s) + 1);
+            free(v.s);
+            return 0;
+        default:
+            break;
+    }
+
+    // Arrays
+    size = f->type == )" + u + R"(ARRAY_OF_BOOL ? sizeof(bool) : f->type == )" + u + R"(ARRAY_OF_STRING ? sizeof(char*) : 8;
+    if (f->packed) {
+        uint8_t* bits = calloc((v.len + 7) / 8 + 1, 1);
+
+        if (!bits) {
+            )" + base_name + R"(_value_free(f->type, &v);
+            )" + fail + R"(out of memory");
+            return 1;
+        }
+        for (size_t i = 0; i < v.len; ++i) {
+            bits[i >> 3] |= (uint8_t)(((bool*)v.v)[i] << (i & 7));
+        }
+        free(v.v);
+        v.v = bits;
+    }
+    if (f->cap) {
+        if (v.len > f->cap) {
+            )" + base_name + R"(_value_free(f->type, &v);
+            )" + fail + R"(%s has more than %zu elements", path, f->cap);
+            return 1;
+        }
+        memcpy(dst, v.v, v.len * size);
+        free(v.v);
+    } else {
+        if (f->type == )" + u + R"(ARRAY_OF_STRING) {
+            for (size_t i = 0; i < *(size_t*)(dst - f->offset + f->len_offset); ++i) {
+                free((*(char***)dst)[i]);
+            }
+        }
+        free(*(void**)dst);
+        *(void**)dst = v.v;
+    }
+    *(size_t*)(dst - f->offset + f->len_offset) = v.len;
+    return 0;
+}
+
+)";
+}
+
+// The shared runtime of --table, written next to the outputs as t2c-rt.h and
+// t2c-rt.c. Spelled with the default prefix, which write_runtime() replaces.
+static const char* table_runtime_h = R"rt(/* Runtime of t2c --table: reads, prints, writes, compares and frees the
+ * struct of any schema by walking the schema's tables. Build t2c-rt.c once
+ * and link it with every t2c-FILE.c. */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+)rt";
+
+static const char* table_runtime_types = R"rt(
+/* A table, or an array of tables, of a schema. The fields of a table are
+ * at their offsets in the struct, those of an array in each entry. */
+typedef struct {
+    const char* key;            /* in the parent table, NULL for the root */
+    const char* path;           /* dotted key path, "" for the root */
+    const char* header;         /* as written in a TOML [header] */
+    const char* var;            /* member prefix, "cat.family." */
+    bool array;
+    size_t offset;              /* of an array's entries, */
+    size_t len_offset;          /* of their count, */
+    size_t size;                /* and the size of one entry */
+    size_t fields;              /* first of the schema's fields, */
+    size_t n_fields;
+    size_t children;            /* first of the schema's tables */
+    size_t n_children;
+} t2c_rt_table_t;
+
+typedef struct {
+    const char* name;           /* of the functions, "t2c_pet" */
+    const char* file;           /* "pet", of pet.toml */
+    const char* var;            /* the struct, as _print names it */
+    size_t size;
+    const t2c_rt_table_t* tables;   /* breadth first, the root first */
+    const t2c_field_t* fields;
+    void (*error)(const char* fmt, ...);
+} t2c_schema_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+int  t2c_rt_read(const t2c_schema_t* s, const char* file_path, void** ptr);
+int  t2c_rt_read_fd(const t2c_schema_t* s, int fd, void** ptr);
+int  t2c_rt_read_mem(const t2c_schema_t* s, const char* buf, size_t len, void** ptr);
+void t2c_rt_print(const t2c_schema_t* s, const void* ptr);
+size_t t2c_rt_write_toml(const t2c_schema_t* s, const void* ptr, char* buf, size_t cap);
+int  t2c_rt_write_file(const t2c_schema_t* s, const void* ptr, const char* path);
+uint64_t t2c_rt_hash(const t2c_schema_t* s, const void* a);
+int  t2c_rt_equal(const t2c_schema_t* s, const void* a, const void* b);
+size_t t2c_rt_diff(const t2c_schema_t* s, const void* a, const void* b, const char** changed, size_t cap);
+int  t2c_rt_set_path(const t2c_schema_t* s, void* ptr, const t2c_field_t* f, const char* path, const char* value);
+void t2c_rt_free(const t2c_schema_t* s, void* ptr);
+#ifdef __cplusplus
+}
+#endif
+)rt";
+
+static const char* table_runtime_c = R"rt(#define _POSIX_C_SOURCE 200809L
+#include "t2c-rt.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <toml.h>
+
+)rt";
+
+// Schema independent: the fields of one table, at base
+static const char* table_runtime_fields = R"rt(/* The key of f in its table t */
+static const char* rt_key(const t2c_rt_table_t* t, const t2c_field_t* f) {
+    return t->path[0] ? f->path + strlen(t->path) + 1 : f->path;
+}
+
+/* The size of an element of the array f */
+static size_t rt_size(const t2c_field_t* f) {
+    switch (f->type) {
+        case T2C_ARRAY_OF_BOOL: return sizeof(bool);
+        case T2C_ARRAY_OF_STRING: return sizeof(char*);
+        default: return 8;
+    }
+}
+
+/* The string or the elements of f, inline or behind a pointer */
+static const char* rt_data(const char* base, const t2c_field_t* f) {
+    return f->cap ? base + f->offset : *(char* const*)(base + f->offset);
+}
+
+static size_t rt_len(const char* base, const t2c_field_t* f) {
+    return *(const size_t*)(base + f->len_offset);
+}
+
+/* Entry e of the array of tables t in the struct at p */
+static char* rt_entry(const t2c_rt_table_t* t, const void* p, size_t e) {
+    return *(char* const*)((const char*)p + t->offset) + e * t->size;
+}
+
+static size_t rt_count(const t2c_rt_table_t* t, const void* p) {
+    return *(const size_t*)((const char*)p + t->len_offset);
+}
+
+static int rt_enum(const t2c_field_t* f, const char* s) {
+    for (size_t i = 0; i < f->n_names; ++i) {
+        if (!strcmp(f->names[i], s)) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void rt_unknown(const t2c_schema_t* s, const t2c_field_t* f, const char* value) {
+    tw_t w = {.heap = 1};
+
+    for (size_t i = 0; i < f->n_names; ++i) {
+        if (i) {
+            TW_LIT(&w, ", ");
+        }
+        tw_raw(&w, f->names[i]);
+    }
+    tw_put(&w, "", 1);
+    s->error("%s: %s = '%s' is not one of %s", s->name, f->path, value, w.failed ? "its names" : w.buf);
+    free(w.buf);
+}
+
+/* Frees the strings and arrays of one instance of t */
+static void rt_release(const t2c_schema_t* s, const t2c_rt_table_t* t, char* base) {
+    for (size_t i = 0; i < t->n_fields; ++i) {
+        const t2c_field_t* f = &s->fields[t->fields + i];
+        char** dst = (char**)(base + f->offset);
+
+        if (f->cap || (f->type != T2C_STRING && f->type <= T2C_ARRAY)) {
+            continue;
+        }
+        if (f->type == T2C_ARRAY_OF_STRING) {
+            for (size_t j = 0; j < rt_len(base, f); ++j) {
+                free(((char**)*dst)[j]);
+            }
+        }
+        free(*dst);
+    }
+}
+
+static void rt_clear(const t2c_schema_t* s, const t2c_rt_table_t* t, char* p) {
+    if (t->array) {
+        for (size_t e = 0; e < rt_count(t, p); ++e) {
+            rt_release(s, t, rt_entry(t, p, e));
+        }
+        free(*(char**)(p + t->offset));
+        return;
+    }
+    rt_release(s, t, p);
+    for (size_t i = 0; i < t->n_children; ++i) {
+        rt_clear(s, &s->tables[t->children + i], p);
+    }
+}
+
+/* Looks the tables up first, in the order and with the messages of the
+ * unrolled reader */
+static int rt_check(const t2c_schema_t* s, const t2c_rt_table_t* t, toml_table_t* in) {
+    for (size_t i = 0; i < t->n_children; ++i) {
+        const t2c_rt_table_t* c = &s->tables[t->children + i];
+        toml_table_t* sub;
+
+        if (c->array) {
+            continue;
+        }
+        if (!(sub = toml_table_in(in, c->key))) {
+            s->error("%s_read() failed: failed locating [%s] table", s->name, c->key);
+            return 1;
+        }
+        if (rt_check(s, c, sub)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* The keys of one instance of t, read from in */
+static int rt_fill(const t2c_schema_t* s, const t2c_rt_table_t* t, toml_table_t* in, char* base) {
+    for (size_t i = 0; i < t->n_fields; ++i) {
+        const t2c_field_t* f = &s->fields[t->fields + i];
+        const char* key = rt_key(t, f);
+        char* dst = base + f->offset;
+        const size_t size = rt_size(f);
+        toml_datum_t datum;
+        toml_array_t* arr;
+        size_t n;
+
+        switch (f->type) {
+            case T2C_INT:
+                *(int64_t*)dst = toml_int_in(in, key).u.i;
+                continue;
+            case T2C_DOUBLE:
+                *(double*)dst = toml_double_in(in, key).u.d;
+                continue;
+            case T2C_BOOL:
+                *(bool*)dst = toml_bool_in(in, key).u.b;
+                continue;
+            case T2C_STRING:
+                datum = toml_string_in(in, key);
+                if (!f->cap) {
+                    *(char**)dst = datum.u.s;
+                    continue;
+                }
+                if (datum.ok) {
+                    n = strlen(datum.u.s) + 1;
+                    if (n > f->cap) {
+                        free(datum.u.s);
+                        s->error("%s: %s is longer than %zu bytes", s->name, f->path, f->cap - 1);
+                        return 1;
+                    }
+                    memcpy(dst, datum.u.s, n);
+                    free(datum.u.s);
+                }
+                continue;
+            case T2C_ENUM:
+                datum = toml_string_in(in, key);
+                if (datum.ok) {
+                    const int e = rt_enum(f, datum.u.s);
+                    if (e < 0) {
+                        rt_unknown(s, f, datum.u.s);
+                        free(datum.u.s);
+                        return 1;
+                    }
+                    *(int*)dst = e;
+                    free(datum.u.s);
+                }
+                continue;
+            case T2C_ARRAY:
+                continue;
+            default:
+                break;
+        }
+
+        arr = toml_array_in(in, key);
+        n = arr ? (size_t)toml_array_nelem(arr) : 0;
+        if (f->cap && n > f->cap) {
+            s->error("%s: %s has more than %zu elements", s->name, f->path, f->cap);
+            return 1;
+        }
+        if (!f->cap) {
+            dst = *(char**)dst = malloc(n * size);
+        }
+        for (size_t j = 0; j < n; ++j, dst += size) {
+            switch (f->type) {
+                case T2C_ARRAY_OF_INT: *(int64_t*)dst = toml_int_at(arr, j).u.i; break;
+                case T2C_ARRAY_OF_DOUBLE: *(double*)dst = toml_double_at(arr, j).u.d; break;
+                case T2C_ARRAY_OF_BOOL: *(bool*)dst = toml_bool_at(arr, j).u.b; break;
+                default: *(char**)dst = toml_string_at(arr, j).u.s; break;
+            }
+        }
+        *(size_t*)(base + f->len_offset) = n;
+    }
+    return 0;
+}
+
+/* t, and the tables inside it. An array of tables is read from its parent
+ * in. */
+static int rt_load(const t2c_schema_t* s, const t2c_rt_table_t* t, toml_table_t* in, char* p) {
+    if (t->array) {
+        toml_array_t* arr = toml_array_in(in, t->key);
+        const size_t n = arr ? (size_t)toml_array_nelem(arr) : 0;
+
+        /* Entries are zeroed, so keys an entry lacks read as 0 */
+        *(char**)(p + t->offset) = calloc(n, t->size);
+        *(size_t*)(p + t->len_offset) = n;
+        for (size_t e = 0; e < n; ++e) {
+            if (rt_fill(s, t, toml_table_at(arr, e), rt_entry(t, p, e))) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    if (rt_fill(s, t, in, p)) {
+        return 1;
+    }
+    for (size_t i = 0; i < t->n_children; ++i) {
+        const t2c_rt_table_t* c = &s->tables[t->children + i];
+
+        if (rt_load(s, c, c->array ? in : toml_table_in(in, c->key), p)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int rt_doc(const t2c_schema_t* s, toml_table_t* doc, void** ptr) {
+    if (*ptr == NULL) {
+        *ptr = calloc(1, s->size);
+    } else {
+        rt_clear(s, s->tables, *ptr);
+        memset(*ptr, 0, s->size);
+    }
+    return rt_check(s, s->tables, doc) || rt_load(s, s->tables, doc, *ptr);
+}
+
+int t2c_rt_read(const t2c_schema_t* s, const char* file_path, void** ptr) {
+    FILE* fp;
+    toml_table_t* doc;
+    char errbuf[200];
+    int rc;
+
+    if (0 == (fp = fopen(file_path, "r"))) {
+        s->error("%s_read() failed: couldn't open %s", s->name, file_path);
+        return 1;
+    }
+    doc = toml_parse_file(fp, errbuf, sizeof(errbuf));
+    fclose(fp);
+    if (0 == doc) {
+        s->error("%s_read() failed: error while parsing %s", s->name, file_path);
+        return 1;
+    }
+    rc = rt_doc(s, doc, ptr);
+    toml_free(doc);
+    return rc;
+}
+
+/* Text already in memory, tomlc99 needs it NUL-terminated */
+static int rt_text(const t2c_schema_t* s, const char* buf, size_t len, int terminated, void** ptr, const char* fn, const char* src) {
+    char* text = (char*)buf;
+    toml_table_t* doc;
+    char errbuf[200];
+    int rc;
+
+    if (!terminated) {
+        if (0 == (text = malloc(len + 1))) {
+            s->error("%s_%s() failed: out of memory", s->name, fn);
+            return 1;
+        }
+        memcpy(text, buf, len);
+        text[len] = '\0';
+    }
+    doc = toml_parse(text, errbuf, sizeof(errbuf));
+    if (text != buf) {
+        free(text);
+    }
+    if (0 == doc) {
+        s->error("%s_%s() failed: error while parsing %s: %s", s->name, fn, src, errbuf);
+        return 1;
+    }
+    rc = rt_doc(s, doc, ptr);
+    toml_free(doc);
+    return rc;
+}
+
+int t2c_rt_read_fd(const t2c_schema_t* s, int fd, void** ptr) {
+    struct stat st;
+    char* buf = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    ssize_t got;
+    int rc;
+
+    if (0 == fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            /* Past the end of file, the last page reads as zeros */
+            const int terminated = st.st_size % sysconf(_SC_PAGESIZE) != 0;
+            posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+            rc = rt_text(s, map, st.st_size, terminated, ptr, "read_fd", "fd");
+            munmap(map, st.st_size);
+            return rc;
+        }
+    }
+
+    /* Pipes, sockets and empty files */
+    for (;;) {
+        if (cap - len < 4096) {
+            char* grown = realloc(buf, cap = cap ? 2 * cap : 65536);
+            if (!grown) {
+                s->error("%s_read_fd() failed: out of memory", s->name);
+                free(buf);
+                return 1;
+            }
+            buf = grown;
+        }
+        if ((got = read(fd, buf + len, cap - len - 1)) == 0) {
+            break;
+        }
+        if (got < 0 && errno != EINTR) {
+            s->error("%s_read_fd() failed: couldn't read fd", s->name);
+            free(buf);
+            return 1;
+        }
+        len += got > 0 ? got : 0;
+    }
+    buf[len] = '\0';
+    rc = rt_text(s, buf, len, 1, ptr, "read_fd", "fd");
+    free(buf);
+    return rc;
+}
+
+int t2c_rt_read_mem(const t2c_schema_t* s, const char* buf, size_t len, void** ptr) {
+    return rt_text(s, buf, len, 0, ptr, "read_mem", "buffer");
+}
+
+void t2c_rt_free(const t2c_schema_t* s, void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    rt_clear(s, s->tables, ptr);
+    free(ptr);
+}
+
+/* The scalar, or the array element, of f at v */
+static void rt_value(tw_t* w, const t2c_field_t* f, const char* v, bool toml) {
+    const char* str;
+
+    switch (f->type) {
+        case T2C_INT:
+        case T2C_ARRAY_OF_INT:
+            tw_int(w, *(const int64_t*)v);
+            return;
+        case T2C_DOUBLE:
+        case T2C_ARRAY_OF_DOUBLE:
+            tw_double(w, *(const double*)v);
+            return;
+        case T2C_BOOL:
+        case T2C_ARRAY_OF_BOOL:
+            tw_bool(w, *(const bool*)v);
+            return;
+        case T2C_ENUM:
+            str = (unsigned)*(const int*)v < f->n_names ? f->names[*(const int*)v] : "";
+            break;
+        case T2C_STRING:
+            str = f->cap ? v : *(char* const*)v;
+            break;
+        default:
+            str = *(char* const*)v;
+            str = str || !toml ? str : "";
+            break;
+    }
+    if (toml) {
+        tw_quoted(w, str);
+    } else {
+        tw_raw(w, str);
+    }
+}
+
+/* Entries print as routes[1].via */
+static void rt_label(tw_t* w, const t2c_schema_t* s, const t2c_rt_table_t* t, const t2c_field_t* f, size_t e) {
+    tw_raw(w, s->var);
+    TW_LIT(w, ".");
+    if (t->array) {
+        tw_put(w, t->var, strlen(t->var) - 1);
+        TW_LIT(w, "[");
+        tw_int(w, (int64_t)e);
+        TW_LIT(w, "].");
+    } else {
+        tw_raw(w, t->var);
+    }
+    tw_raw(w, f->name);
+}
+
+static void rt_dump(const t2c_schema_t* s, const t2c_rt_table_t* t, const char* base, size_t e, tw_t* w) {
+    for (size_t i = 0; i < t->n_fields; ++i) {
+        const t2c_field_t* f = &s->fields[t->fields + i];
+        const char* data;
+
+        if (f->type < T2C_ARRAY) {
+            rt_label(w, s, t, f, e);
+            TW_LIT(w, " = ");
+            rt_value(w, f, base + f->offset, false);
+            TW_LIT(w, "\n");
+            continue;
+        }
+        data = rt_data(base, f);
+        for (size_t j = 0; j < rt_len(base, f); ++j) {
+            rt_label(w, s, t, f, e);
+            TW_LIT(w, "[");
+            tw_int(w, (int64_t)j);
+            TW_LIT(w, "] = ");
+            rt_value(w, f, data + j * rt_size(f), false);
+            TW_LIT(w, "\n");
+        }
+    }
+}
+
+/* The key of f as written in TOML, quoted unless it is bare */
+static void rt_toml_key(tw_t* w, const char* key) {
+    bool bare = *key != '\0';
+
+    for (const char* c = key; *c && bare; ++c) {
+        bare = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '_' || *c == '-';
+    }
+    if (bare) {
+        tw_raw(w, key);
+    } else {
+        tw_quoted(w, key);
+    }
+}
+
+static void rt_toml_fields(const t2c_schema_t* s, const t2c_rt_table_t* t, const char* base, tw_t* w) {
+    for (size_t i = 0; i < t->n_fields; ++i) {
+        const t2c_field_t* f = &s->fields[t->fields + i];
+        const char* data;
+
+        /* A missing string stays missing */
+        if (f->type == T2C_STRING && !f->cap && !*(char* const*)(base + f->offset)) {
+            continue;
+        }
+        rt_toml_key(w, rt_key(t, f));
+        TW_LIT(w, " = ");
+        if (f->type < T2C_ARRAY) {
+            rt_value(w, f, base + f->offset, true);
+            TW_LIT(w, "\n");
+            continue;
+        }
+        data = rt_data(base, f);
+        TW_LIT(w, "[");
+        for (size_t j = 0; j < rt_len(base, f); ++j) {
+            if (j) {
+                TW_LIT(w, ", ");
+            }
+            rt_value(w, f, data + j * rt_size(f), true);
+        }
+        TW_LIT(w, "]\n");
+    }
+}
+
+/* The dump of _print, or with toml the TOML text */
+static void rt_write(const t2c_schema_t* s, const t2c_rt_table_t* t, const char* p, bool toml, tw_t* w) {
+    if (t->array) {
+        for (size_t e = 0; e < rt_count(t, p); ++e) {
+            if (toml) {
+                TW_LIT(w, "\n[[");
+                tw_raw(w, t->header);
+                TW_LIT(w, "]]\n");
+                rt_toml_fields(s, t, rt_entry(t, p, e), w);
+            } else {
+                rt_dump(s, t, rt_entry(t, p, e), e, w);
+            }
+        }
+        return;
+    }
+    if (toml && t->key) {
+        TW_LIT(w, "\n[");
+        tw_raw(w, t->header);
+        TW_LIT(w, "]\n");
+    }
+    if (toml) {
+        rt_toml_fields(s, t, p, w);
+    } else {
+        rt_dump(s, t, p, 0, w);
+    }
+    for (size_t i = 0; i < t->n_children; ++i) {
+        rt_write(s, &s->tables[t->children + i], p, toml, w);
+    }
+}
+
+void t2c_rt_print(const t2c_schema_t* s, const void* ptr) {
+    tw_t w = {.heap = 1};
+
+    TW_LIT(&w, "Read ");
+    tw_raw(&w, s->file);
+    TW_LIT(&w, ".toml values:\n");
+    rt_write(s, s->tables, ptr, false, &w);
+    fwrite(w.buf, 1, w.len < w.cap ? w.len : w.cap, stdout);
+    fflush(stdout);
+    free(w.buf);
+}
+
+size_t t2c_rt_write_toml(const t2c_schema_t* s, const void* ptr, char* buf, size_t cap) {
+    tw_t w = {.buf = buf, .cap = cap ? cap - 1 : 0};
+
+    rt_write(s, s->tables, ptr, true, &w);
+    if (cap) {
+        buf[w.len < w.cap ? w.len : w.cap] = '\0';
+    }
+    return w.len;
+}
+
+int t2c_rt_write_file(const t2c_schema_t* s, const void* ptr, const char* path) {
+    tw_t w = {.heap = 1};
+    size_t done = 0;
+    ssize_t n;
+    int fd;
+
+    rt_write(s, s->tables, ptr, true, &w);
+    if (w.failed) {
+        s->error("%s_write_file() failed: out of memory", s->name);
+        free(w.buf);
+        return 1;
+    }
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        s->error("%s_write_file() failed: couldn't open %s", s->name, path);
+        free(w.buf);
+        return 1;
+    }
+    while (done < w.len) {
+        if ((n = write(fd, w.buf + done, w.len - done)) < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    free(w.buf);
+    if (close(fd) || done < w.len) {
+        s->error("%s_write_file() failed: couldn't write %s", s->name, path);
+        return 1;
+    }
+    return 0;
+}
+
+/* Mixes one instance of t into h, like the unrolled _hash */
+static uint64_t rt_hash_fields(const t2c_schema_t* s, const t2c_rt_table_t* t, const char* base, uint64_t h) {
+    for (size_t i = 0; i < t->n_fields; ++i) {
+        const t2c_field_t* f = &s->fields[t->fields + i];
+        const char* v = base + f->offset;
+        uint64_t d;
+
+        switch (f->type) {
+            case T2C_INT: h = th_mix(h, *(const uint64_t*)v); break;
+            case T2C_ENUM: h = th_mix(h, (uint64_t)*(const int*)v); break;
+            case T2C_DOUBLE: memcpy(&d, v, 8); h = th_mix(h, d); break;
+            case T2C_BOOL: h = th_mix(h, *(const bool*)v); break;
+            case T2C_STRING: h = th_str(h, rt_data(base, f)); break;
+            case T2C_ARRAY: break;
+            case T2C_ARRAY_OF_STRING: h = th_strs(h, (char* const*)rt_data(base, f), rt_len(base, f)); break;
+            default: h = th_bytes(h, rt_data(base, f), rt_len(base, f) * rt_size(f)); break;
+        }
+    }
+    return h;
+}
+
+static uint64_t rt_hash(const t2c_schema_t* s, const t2c_rt_table_t* t, const char* p, uint64_t h) {
+    if (t->array) {
+        h = th_mix(h, rt_count(t, p));
+        for (size_t e = 0; e < rt_count(t, p); ++e) {
+            h = rt_hash_fields(s, t, rt_entry(t, p, e), h);
+        }
+        return h;
+    }
+    h = rt_hash_fields(s, t, p, h);
+    for (size_t i = 0; i < t->n_children; ++i) {
+        h = rt_hash(s, &s->tables[t->children + i], p, h);
+    }
+    return h;
+}
+
+uint64_t t2c_rt_hash(const t2c_schema_t* s, const void* a) {
+    const uint64_t h = rt_hash(s, s->tables, a, 0x243f6a8885a308d3u);
+    return th_mix(h, h >> 29);
+}
+
+/* True when f is the same in the instances at a and b */
+static bool rt_same(const t2c_field_t* f, const char* a, const char* b) {
+    const char* x = a + f->offset;
+    const char* y = b + f->offset;
+
+    switch (f->type) {
+        case T2C_INT: return *(const int64_t*)x == *(const int64_t*)y;
+        case T2C_ENUM: return *(const int*)x == *(const int*)y;
+        case T2C_BOOL: return *(const bool*)x == *(const bool*)y;
+        case T2C_DOUBLE: return th_mem_eq(x, y, sizeof(double));
+        case T2C_STRING: return f->cap ? !strcmp(x, y) : th_str_eq(rt_data(a, f), rt_data(b, f));
+        case T2C_ARRAY: return true;
+        default: break;
+    }
+    if (rt_len(a, f) != rt_len(b, f)) {
+        return false;
+    }
+    if (f->type == T2C_ARRAY_OF_STRING) {
+        return th_strs_eq((char* const*)rt_data(a, f), (char* const*)rt_data(b, f), rt_len(a, f));
+    }
+    return th_mem_eq(rt_data(a, f), rt_data(b, f), rt_len(a, f) * rt_size(f));
+}
+
+/* Counts the fields of t that differ on top of n, recording them in changed
+ * up to cap. Unless all, stops at the first. */
+static size_t rt_diff(const t2c_schema_t* s, const t2c_rt_table_t* t, const char* a, const char* b, const char** changed, size_t cap, size_t n, bool all) {
+    if (t->array && rt_count(t, a) != rt_count(t, b)) {
+        if (n < cap) {
+            changed[n] = t->path;
+        }
+        return n + 1;
+    }
+    for (size_t i = 0; i < t->n_fields && (all || !n); ++i) {
+        const t2c_field_t* f = &s->fields[t->fields + i];
+        const size_t entries = t->array ? rt_count(t, a) : 1;
+
+        for (size_t e = 0; e < entries; ++e) {
+            const char* x = t->array ? rt_entry(t, a, e) : a;
+            const char* y = t->array ? rt_entry(t, b, e) : b;
+
+            if (!rt_same(f, x, y)) {
+                if (n < cap) {
+                    changed[n] = f->path;
+                }
+                ++n;
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < t->n_children && (all || !n); ++i) {
+        n = rt_diff(s, &s->tables[t->children + i], a, b, changed, cap, n, all);
+    }
+    return n;
+}
+
+int t2c_rt_equal(const t2c_schema_t* s, const void* a, const void* b) {
+    return rt_diff(s, s->tables, a, b, NULL, 0, 0, false) == 0;
+}
+
+size_t t2c_rt_diff(const t2c_schema_t* s, const void* a, const void* b, const char** changed, size_t cap) {
+    return rt_diff(s, s->tables, a, b, changed, cap, 0, true);
+}
+
+/* A parsed value, which owns its string or array until stored */
+typedef struct {
+    int64_t i;
+    double d;
+    bool b;
+    char* s;
+    void* v;
+    size_t len;
+} rt_value_t;
+
+static void rt_value_free(const t2c_field_t* f, rt_value_t* v) {
+    if (f->type == T2C_ARRAY_OF_STRING) {
+        for (size_t i = 0; i < v->len; ++i) {
+            free(((char**)v->v)[i]);
+        }
+    }
+    free(v->s);
+    free(v->v);
+}
+
+/* The value of f, parsed as a one-key document */
+static int rt_parse_value(const t2c_field_t* f, const char* value, rt_value_t* v) {
+    const size_t n = strlen(value);
+    char* conf = malloc(n + 6);
+    char err[128];
+    toml_table_t* doc;
+    toml_array_t* arr;
+    toml_datum_t datum = { 0 };
+    int rc = 0;
+
+    if (!conf) {
+        return -1;
+    }
+    memcpy(conf, "v = ", 4);
+    memcpy(conf + 4, value, n);
+    memcpy(conf + 4 + n, "\n", 2);
+    doc = toml_parse(conf, err, sizeof(err));
+    free(conf);
+    if (!doc) {
+        return -1;
+    }
+    if (toml_key_in(doc, 1)) {
+        toml_free(doc);
+        return -1;
+    }
+    switch (f->type) {
+        case T2C_INT: datum = toml_int_in(doc, "v"); v->i = datum.u.i; break;
+        case T2C_DOUBLE: datum = toml_double_in(doc, "v"); v->d = datum.u.d; break;
+        case T2C_BOOL: datum = toml_bool_in(doc, "v"); v->b = datum.u.b; break;
+        case T2C_STRING:
+        case T2C_ENUM: datum = toml_string_in(doc, "v"); v->s = datum.u.s; break;
+        case T2C_ARRAY_OF_INT:
+        case T2C_ARRAY_OF_DOUBLE:
+        case T2C_ARRAY_OF_BOOL:
+        case T2C_ARRAY_OF_STRING:
+            if (!(arr = toml_array_in(doc, "v"))) {
+                break;
+            }
+            v->len = toml_array_nelem(arr);
+            v->v = calloc(v->len ? v->len : 1, rt_size(f));
+            datum.ok = v->v != NULL;
+            for (size_t i = 0; i < v->len && datum.ok; ++i) {
+                switch (f->type) {
+                    case T2C_ARRAY_OF_INT: datum = toml_int_at(arr, i); ((int64_t*)v->v)[i] = datum.u.i; break;
+                    case T2C_ARRAY_OF_DOUBLE: datum = toml_double_at(arr, i); ((double*)v->v)[i] = datum.u.d; break;
+                    case T2C_ARRAY_OF_BOOL: datum = toml_bool_at(arr, i); ((bool*)v->v)[i] = datum.u.b; break;
+                    default: datum = toml_string_at(arr, i); ((char**)v->v)[i] = datum.u.s; break;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    rc = datum.ok ? 0 : -1;
+    toml_free(doc);
+    return rc;
+}
+
+int t2c_rt_set_path(const t2c_schema_t* s, void* ptr, const t2c_field_t* f, const char* path, const char* value) {
+    rt_value_t v = { 0 };
+    char* dst;
+    int e;
+
+    if (!f) {
+        s->error("%s_set_path() failed: no field %s", s->name, path);
+        return 1;
+    }
+    /* An unquoted string is taken as is */
+    if ((f->type == T2C_STRING || f->type == T2C_ENUM) && value[0] != '"' && value[0] != '\'') {
+        v.s = strdup(value);
+    } else if (f->type == T2C_ARRAY || rt_parse_value(f, value, &v)) {
+        rt_value_free(f, &v);
+        s->error("%s_set_path() failed: %s = %s is not a valid value", s->name, path, value);
+        return 1;
+    }
+    if ((f->type == T2C_STRING || f->type == T2C_ENUM) && !v.s) {
+        s->error("%s_set_path() failed: out of memory", s->name);
+        return 1;
+    }
+    dst = (char*)ptr + f->offset;
+    switch (f->type) {
+        case T2C_INT:
+            *(int64_t*)dst = v.i;
+            return 0;
+        case T2C_DOUBLE:
+            *(double*)dst = v.d;
+            return 0;
+        case T2C_BOOL:
+            *(bool*)dst = v.b;
+            return 0;
+        case T2C_ENUM:
+            if ((e = rt_enum(f, v.s)) < 0) {
+                s->error("%s_set_path() failed: %s = %s is not one of its names", s->name, path, value);
+                free(v.s);
+                return 1;
+            }
+            *(int*)dst = e;
+            free(v.s);
+            return 0;
+        case T2C_STRING:
+            if (!f->cap) {
+                free(*(char**)dst);
+                *(char**)dst = v.s;
+                return 0;
+            }
+            if (strlen(v.s) >= f->cap) {
+                s->error("%s_set_path() failed: %s is longer than %zu bytes", s->name, path, f->cap - 1);
+                free(v.s);
+                return 1;
+            }
+            memcpy(dst, v.s, strlen(v.s) + 1);
+            free(v.s);
+            return 0;
+        default:
+            break;
+    }
+
+    /* Arrays */
+    if (f->cap) {
+        if (v.len > f->cap) {
+            rt_value_free(f, &v);
+            s->error("%s_set_path() failed: %s has more than %zu elements", s->name, path, f->cap);
+            return 1;
+        }
+        memcpy(dst, v.v, v.len * rt_size(f));
+        free(v.v);
+    } else {
+        if (f->type == T2C_ARRAY_OF_STRING) {
+            for (size_t i = 0; i < rt_len(ptr, f); ++i) {
+                free((*(char***)dst)[i]);
+            }
+        }
+        free(*(void**)dst);
+        *(void**)dst = v.v;
+    }
+    *(size_t*)((char*)ptr + f->len_offset) = v.len;
+    return 0;
+}
+)rt";
+
+// The runtime's text under lib_base_name, for text spelled with the default
+// t2c_, T2C_ and t2c- prefixes
+static std::string lib_prefixed(const std::string& text) {
+    std::string s;
+    s.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ) {
+        if (text.compare(i, 4, "t2c_") == 0) {
+            s += LIB_BASE_NAMEu;
+        } else if (text.compare(i, 4, "T2C_") == 0) {
+            s += mvar(LIB_BASE_NAMEu);
+        } else if (text.compare(i, 4, "t2c-") == 0) {
+            s += LIB_BASE_NAMEh;
+        } else {
+            s += text[i++];
+            continue;
+        }
+        i += 4;
+    }
+    return s;
+}
+
+// Writes t2c-rt.h and t2c-rt.c, leaving them untouched, mtimes included,
+// when they are already current
+static void write_runtime() {
+    const std::string rt = LIB_BASE_NAMEh + "rt";
+    const std::pair<std::string, std::string> files[] = {
+        { rt + ".h", lib_prefixed(table_runtime_h) + field_decl() + lib_prefixed(table_runtime_types) },
+        { rt + ".c", lib_prefixed(table_runtime_c) + writer_runtime + double_runtime + compare_runtime + lib_prefixed(table_runtime_fields) }
+    };
+    for (const auto& [path, text]: files) {
+        std::ifstream in(path);
+        const std::string prev((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (prev != text) {
+            std::ofstream(path) << text;
+        }
+    }
+}
+
+// --table: the entry points hand the schema's tables to the runtime. Stats
+// only time the whole read.
+void Writer::c_rt(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+    const std::string rt = LIB_BASE_NAMEu + "rt_";
+    const std::string schema = "&" + base_name + "_rt, ";
+    const std::string obj = this->ptr;
+
+    auto read = [&] (const std::string& fn, const std::string& params, const std::string& src, const std::string& args) {
+        this->put("int ", base_name, "_", fn, "(", params, ", ", name, "** ", obj, ") {\n");
+        this->put("    void* p = *", obj, ";\n    int rc;\n\n");
+        this->put("    STATS_BEGIN(", src, ");\n");
+        this->put("    rc = ", rt, fn, "(", schema, args, ", &p);\n");
+        this->put("    *", obj, " = p;\n    return STATS_END(rc);\n}\n\n");
+    };
+    read("read", "const char* file_path", "file_path", "file_path");
+    read("read_fd", "int fd", "\"fd\"", "fd");
+    read("read_mem", "const char* buf, size_t len", "\"buffer\"", "buf, len");
+
+    this->put("void ", base_name, "_print(const ", name, "* ", obj, ") {\n");
+    this->put("    ", rt, "print(", schema, obj, ");\n}\n\n");
+    if (this->opts.write) {
+        this->put("size_t ", base_name, "_write_toml(const ", name, "* ", obj, ", char* buf, size_t cap) {\n");
+        this->put("    return ", rt, "write_toml(", schema, obj, ", buf, cap);\n}\n\n");
+        this->put("int ", base_name, "_write_file(const ", name, "* ", obj, ", const char* path) {\n");
+        this->put("    return ", rt, "write_file(", schema, obj, ", path);\n}\n\n");
+    }
+    if (this->opts.compare) {
+        this->put("uint64_t ", base_name, "_hash(const ", name, "* a) {\n");
+        this->put("    return ", rt, "hash(", schema, "a);\n}\n\n");
+        this->put("int ", base_name, "_equal(const ", name, "* a, const ", name, "* b) {\n");
+        this->put("    return ", rt, "equal(", schema, "a, b);\n}\n\n");
+        this->put("size_t ", base_name, "_diff(const ", name, "* a, const ", name, "* b, const char** changed, size_t cap) {\n");
+        this->put("    return ", rt, "diff(", schema, "a, b, changed, cap);\n}\n\n");
+    }
+    this->put("void ", base_name, "_free(", name, "* ", obj, ") {\n");
+    this->put("    ", rt, "free(", schema, obj, ");\n}\n\n");
+}
+
+void Writer::c_src(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+
+    this->out += this->stamp;
+    this->out += "#define _POSIX_C_SOURCE 200809L\n";
+    this->put("#include \"", LIB_BASE_NAMEh, this->o_name);
+    this->out += R"(.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+)";
+    if (this->opts.handle || this->opts.many) {
+        this->out += "#include <pthread.h>\n#include <stdatomic.h>\n";
+    }
+    if (this->opts.table) {
+        this->put("#include \"", LIB_BASE_NAMEh, "rt.h\"\n");
+    } else if (!this->opts.direct) {
+        this->out += "#include <toml.h>\n";
+    }
+    this->out += "#include <stdarg.h>\n\n";
+    this->c_stats(root);
+
+    if (this->opts.many) {
+        this->out += "/* Where this thread's errors go: stderr, or a _read_many() slot */\n";
+        this->put("static _Thread_local ", LIB_BASE_NAMEu, "error_t* ", base_name, "_err;\n\n");
+    }
+    this->put("static void ", base_name, "_error(const char* fmt, ...) {\n");
+    this->out += "    va_list ap;\n\n    va_start(ap, fmt);\n";
+    if (this->opts.many) {
+        this->put("    if (", base_name, "_err) {\n");
+        this->put("        vsnprintf(", base_name, "_err->msg, sizeof(", base_name, "_err->msg), fmt, ap);\n");
+        this->out += "    } else {\n        vfprintf(stderr, fmt, ap);\n    }\n";
+    } else {
+        this->out += "    vfprintf(stderr, fmt, ap);\n";
+    }
+    this->out += "    va_end(ap);\n}\n\n";
+
+    this->c_enums(root);
+    if (this->opts.table) {
+        this->c_reflect(root);
+        this->c_rt(root);
+    } else {
+        if (!this->opts.arena) {
+            this->c_clear(root);
+        }
+        if (this->opts.direct) {
+            this->c_direct(root);
+        } else if (this->opts.arena) {
+            this->c_arena(root);
+        } else {
+            this->c_read(root);
+        }
+        this->c_entry(root);
+    }
+    if (this->opts.many) {
+        this->c_many(root);
+    }
+    if (this->opts.stream) {
+        this->c_stream(root);
+    }
+    if (this->opts.embed) {
+        this->c_embed(root);
+    }
+    if (!this->opts.table) {
+        this->c_print(root);
+        if (this->opts.compare) {
+            this->c_compare(root);
+        }
+        if (this->opts.reflect) {
+            this->c_reflect(root);
+        }
+        this->c_free(root);
+    }
+    if (this->opts.bin) {
+        this->c_bin(root);
+    }
+    if (this->opts.handle) {
+        this->c_handle(root);
+    }
+}
+
+// Frees every string and array, leaving the struct zeroed for reuse
+void Writer::c_clear(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+
+    this->put("static void ", base_name, "_clear(", name, "* ", this->ptr, ") {\n");
+
+    // The cold fields, or the others. No array of tables has cold fields.
+    std::function<void(const Table&, bool)> free_r;
+    free_r = [&] (const Table& t, bool cold)->void {
+        if (t.array && cold) {
+            return;
+        }
+        const std::string index = t.path + "_i";
+        size_t body = 0;
+        if (t.array) {
+            this->put("    for (size_t ", index, " = 0; ", index, " < ", this->count(this->ptr, t), "; ++", index, ") {\n");
+            body = this->out.size();
+        }
+        for (const Field& f: t.fields) {
+            // Inline values live in the struct
+            if (f.cap || f.cold != cold) {
+                continue;
+            }
+            const std::string dst = this->member(this->ptr, t, f, index);
+            switch (f.type) {
+                case Field::Type::t_string:
+                case Field::Type::t_array_of_int:
+                case Field::Type::t_array_of_bool:
+                case Field::Type::t_array_of_double:
+                    this->put("    free(", dst, ");\n");
+                    break;
+
+                case Field::Type::t_array_of_string:
+                    this->put("    for (size_t i = 0; i < ", this->member(this->ptr, t, f, index, "_len"), "; ++i) {\n");
+                    this->put("        free(", dst, "[i]);\n");
+                    this->out += "    }\n";
+                    this->put("    free(", dst, ");\n");
+                    break;
+
+                default:
+                    break;
+            }
+        }
+        if (t.array) {
+            this->indent_since(body);
+            this->out += "    }\n";
+            if (this->opts.soa) {
+                for (const Field& f: t.fields) {
+                    this->put("    free(", this->ptr, "->", t.var, f.name, ");\n");
+                    if (f.type >= Field::Type::t_array) {
+                        this->put("    free(", this->ptr, "->", t.var, f.name, "_len);\n");
+                    }
+                }
+            } else {
+                this->put("    free(", this->ptr, "->", t.var.substr(0, t.var.size()-1), ");\n");
+            }
+        }
+        for (const Table* c: t.children) {
+            free_r(*c, cold);
+        }
+    };
+    free_r(root, false);
+
+    // A zeroed struct has no cold block yet
+    if (!this->opts.cold.empty()) {
+        this->put("    if (", this->ptr, "->", LIB_BASE_NAMEu, "cold) {\n");
+        const size_t body = this->out.size();
+        free_r(root, true);
+        this->put("    free(", this->ptr, "->", LIB_BASE_NAMEu, "cold);\n");
+        this->indent_since(body);
+        this->out += "    }\n";
+    }
+    this->put("    memset(", this->ptr, ", 0, sizeof(*", this->ptr, "));\n}\n\n");
+}
+
+void Writer::c_free(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+
+    this->put("void ", base_name, "_free(", name, "* ", this->ptr, ") {\n");
+    this->put("    if (!", this->ptr, ") {\n");
+    this->out += "        return;\n";
+    this->out += "    }\n";
+
+    if (this->opts.arena) {
+        // Strings and arrays live in the struct's own allocation
+        this->put("\n    free(", this->ptr, ");\n}\n");
+        return;
+    }
+    this->put("    ", base_name, "_clear(", this->ptr, ");\n");
+    this->put("    free(", this->ptr, ");\n}\n");
+}
+
+// Snapshots published through an atomic pointer and reclaimed by epochs
+void Writer::c_handle(const Table& root) {
+    const std::string& name = root.name;
+    const std::string base_name = name.substr(0, name.size()-2);
+    const std::string handle_t = base_name + "_handle_t";
+    const std::string max = mvar(LIB_BASE_NAMEu) + "MAX_READERS";
+
+    this->out += R"(
+/* Each reader thread owns a slot holding the epoch it entered in, or 0. */
+#ifndef )" + max + R"(
+#define )" + max + R"( 128
+#endif
+
+typedef struct retired {
+    )" + name + R"(* snapshot;
+    uint64_t epoch;
+    struct retired* next;
+} retired_t;
+
+struct )" + base_name + R"(_handle {
+    _Atomic()" + name + R"(*) cur;
+    _Atomic uint64_t epoch;
+    struct {
+        _Atomic uint64_t epoch;
+        char pad[64 - sizeof(uint64_t)];
+    } readers[)" + max + R"(];
+    pthread_mutex_t lock;
+    retired_t* retired;
+};
+
+/* Slots are numbered once and handed back when their thread exits. */
+static pthread_mutex_t )" + base_name + R"(_slot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t )" + base_name + R"(_slot_once = PTHREAD_ONCE_INIT;
+static pthread_key_t )" + base_name + R"(_slot_key;
+static int )" + base_name + R"(_slots;
+static int )" + base_name + "_free_slots[" + max + R"(];
+static int )" + base_name + R"(_free_n;
+static _Thread_local int )" + base_name + R"(_slot = -1;
+
+/* Frees the retired snapshots no reader can still see, lock held. */
+static void )" + base_name + R"(_reclaim()" + handle_t + R"(* h) {
+    uint64_t oldest = UINT64_MAX;
+    retired_t** r = &h->retired;
+
+    for (int i = 0; i < )" + max + R"(; ++i) {
+        const uint64_t e = atomic_load(&h->readers[i].epoch);
+        if (e && e < oldest) {
+            oldest = e;
+        }
+    }
+    while (*r) {
+        if ((*r)->epoch <= oldest) {
+            retired_t* done = *r;
+            *r = done->next;
+            )" + base_name + R"(_free(done->snapshot);
+            free(done);
+        } else {
+            r = &(*r)->next;
+        }
+    }
+}
+
+)" + handle_t + "* " + base_name + R"(_handle_new(const char* file_path) {
+    )" + handle_t + R"(* h = calloc(1, sizeof()" + handle_t + R"());
+    )" + name + R"(* first = NULL;
+
+    if (!h || )" + base_name + R"(_read(file_path, &first)) {
+        )" + base_name + R"(_free(first);
+        free(h);
+        return NULL;
+    }
+    atomic_init(&h->cur, first);
+    atomic_init(&h->epoch, 1);
+    pthread_mutex_init(&h->lock, NULL);
+    return h;
+}
+
+void )" + base_name + "_handle_free(" + handle_t + R"(* h) {
+    if (!h) {
+        return;
+    }
+    while (h->retired) {
+        retired_t* done = h->retired;
+        h->retired = done->next;
+        )" + base_name + R"(_free(done->snapshot);
+        free(done);
+    }
+    )" + base_name + R"(_free(atomic_load(&h->cur));
+    pthread_mutex_destroy(&h->lock);
+    free(h);
+}
+
+int )" + base_name + "_reload(" + handle_t + R"(* h, const char* file_path) {
+    )" + name + R"(* fresh = NULL;
+    retired_t* r = malloc(sizeof(retired_t));
+
+    /* Build the new snapshot off to the side. */
+    if (!r || )" + base_name + R"(_read(file_path, &fresh)) {
+        )" + base_name + R"(_free(fresh);
+        free(r);
+        return 1;
+    }
+
+    /* Publish it, then retire the old one past the current epoch. */
+    pthread_mutex_lock(&h->lock);
+    r->snapshot = atomic_exchange(&h->cur, fresh);
+    r->epoch = atomic_fetch_add(&h->epoch, 1) + 1;
+    r->next = h->retired;
+    h->retired = r;
+    )" + base_name + R"(_reclaim(h);
+    pthread_mutex_unlock(&h->lock);
+    return 0;
+}
+
+static void )" + base_name + R"(_slot_exit(void* slot) {
+    pthread_mutex_lock(&)" + base_name + R"(_slot_lock);
+    )" + base_name + "_free_slots[" + base_name + R"(_free_n++] = (int)(intptr_t)slot - 1;
+    pthread_mutex_unlock(&)" + base_name + R"(_slot_lock);
+}
+
+static void )" + base_name + R"(_slot_init(void) {
+    pthread_key_create(&)" + base_name + "_slot_key, " + base_name + R"(_slot_exit);
+}
+
+/* Takes a free slot for the calling thread, or returns -1. */
+static int )" + base_name + R"(_slot_take(void) {
+    int slot = -1;
+
+    pthread_once(&)" + base_name + "_slot_once, " + base_name + R"(_slot_init);
+    pthread_mutex_lock(&)" + base_name + R"(_slot_lock);
+    if ()" + base_name + R"(_free_n) {
+        slot = )" + base_name + "_free_slots[--" + base_name + R"(_free_n];
+    } else if ()" + base_name + "_slots < " + max + R"() {
+        slot = )" + base_name + R"(_slots++;
+    }
+    pthread_mutex_unlock(&)" + base_name + R"(_slot_lock);
+    if (slot >= 0) {
+        pthread_setspecific()" + base_name + R"(_slot_key, (void*)(intptr_t)(slot + 1));
+    }
+    return slot;
+}
+
+const )" + name + "* " + base_name + "_acquire(" + handle_t + R"(* h) {
+    if ()" + base_name + R"(_slot < 0 && ()" + base_name + "_slot = " + base_name + R"(_slot_take()) < 0) {
+        return NULL;
+    }
+    atomic_store(&h->readers[)" + base_name + R"(_slot].epoch, atomic_load(&h->epoch));
+    return atomic_load(&h->cur);
+}
+
+void )" + base_name + "_release(" + handle_t + R"(* h) {
+    if ()" + base_name + "_slot < 0 || " + base_name + "_slot >= " + max + R"() {
+        return;
+    }
+    atomic_store_explicit(&h->readers[)" + base_name + R"(_slot].epoch, 0, memory_order_release);
+}
+)";
+}
+
+void Writer::c_finalize() {
+    std::ofstream src;
+    src.open(LIB_BASE_NAMEh+this->o_name+".c");
+    src << out;
+    src.close();
+}
+
+// True when path starts with the stamp this run would write
+bool Writer::is_current(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    return std::getline(in, line) && line + "\n" == this->stamp;
+}
+
+// Rewrites t2c-FILE.d only when its rule changes
+void Writer::depfile(const std::string& input) {
+    const std::string out = LIB_BASE_NAMEh + this->o_name;
+    const std::string rule = make_escape(out + ".h") + " " + make_escape(out + ".c")
+        + (this->opts.cpp ? " " + make_escape(out + ".hpp") : "") + ": " + make_escape(input) + "\n";
+
+    std::ifstream in(out + ".d");
+    std::string prev((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (prev != rule) {
+        std::ofstream(out + ".d") << rule;
+    }
+}
+
+// t2c-FILE-bench.c: times _read/_free and _print over TOML files and prints
+// one JSON object per file
+void Writer::c_bench(const Table& root) {
+    const std::string& name = root.name;
+    const std::string bench = LIB_BASE_NAMEh + this->o_name + "-bench";
+    const std::string schema = c_string(this->o_name);
+
+    this->out += this->stamp;
+    this->put("/* Benchmark of the code generated for ", this->o_name, ".toml. Build it with\n");
+    this->put(" *   cc -O2 ", bench, ".c ", LIB_BASE_NAMEh, this->o_name, ".c", this->opts.direct ? "" : " -ltoml", " -o ", bench, "\n");
+    this->out += " * and add -DT2C_BENCH_ALLOCS -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc\n";
+    this->out += " * to count allocations. Usage: " + bench + (this->opts.stream ? " [--stream]" : "") + (this->opts.bin ? " [--bin]" : "") + " [-n ITERATIONS] [FILE.toml...] */\n";
+    this->out += "#define _POSIX_C_SOURCE 200809L\n";
+    this->put("#include \"", LIB_BASE_NAMEh, this->o_name, ".h\"\n");
+    this->out += R"(#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef T2C_BENCH_ALLOCS
+static size_t bench_allocs;
+void* __real_malloc(size_t n);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t n);
+void* __wrap_malloc(size_t n) { ++bench_allocs; return __real_malloc(n); }
+void* __wrap_calloc(size_t n, size_t size) { ++bench_allocs; return __real_calloc(n, size); }
+void* __wrap_realloc(void* p, size_t n) { ++bench_allocs; return __real_realloc(p, n); }
+#endif
+
+static uint64_t bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int bench_cmp(const void* a, const void* b) {
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* Prints the first, mean, median and 99th percentile of n timings in ns.
+ * The first one is the closest to a cold start. */
+static void bench_report(const char* op, uint64_t* ns, size_t n) {
+    const uint64_t first = ns[0];
+    double sum = 0;
+
+    qsort(ns, n, sizeof(*ns), bench_cmp);
+    for (size_t i = 0; i < n; ++i) {
+        sum += ns[i];
+    }
+    printf(", \"%s\": {\"first\": %llu, \"ns_op\": %.1f, \"p50\": %llu, \"p99\": %llu}", op, (unsigned long long)first,
+           sum / n, (unsigned long long)ns[n / 2], (unsigned long long)ns[n * 99 / 100]);
+}
+
+)";
+    if (this->opts.bin) {
+        this->out += "/* Set by --bin: also time _load_bin and _unload_bin of a snapshot */\n";
+        this->out += "static int bench_bin;\n\n";
+    }
+    this->put("static int bench_file(const char* file, size_t iters, uint64_t* ns) {\n");
+    this->put("    ", name, "* ", this->ptr, " = NULL;\n");
+    this->out += R"(    struct stat st;
+    struct rusage ru;
+    size_t allocs = 0;
+    int out;
+    int null;
+
+)";
+    this->put("    /* Warm up, and keep one instance to print */\n");
+    this->put("    if (stat(file, &st) || ", this->base_name, "_read(file, &", this->ptr, ")) {\n");
+    this->put("        printf(\"{\\\"schema\\\": \\\"%s\\\", \\\"file\\\": \\\"%s\\\", \\\"error\\\": \\\"read failed\\\"}\\n\", ", schema, ", file);\n");
+    this->out += "        return 1;\n    }\n";
+    this->put("    printf(\"{\\\"schema\\\": \\\"%s\\\", \\\"file\\\": \\\"%s\\\", \\\"bytes\\\": %lld, \\\"iterations\\\": %zu\", ", schema, ", file, (long long)st.st_size, iters);\n\n");
+
+    this->out += "    for (size_t i = 0; i < iters; ++i) {\n";
+    this->put("        ", name, "* p = NULL;\n");
+    this->out += "        uint64_t t0 = bench_now();\n";
+    this->out += "#ifdef T2C_BENCH_ALLOCS\n        size_t a0 = bench_allocs;\n#endif\n";
+    this->put("        if (", this->base_name, "_read(file, &p)) {\n");
+    this->out += "            printf(\", \\\"error\\\": \\\"read failed\\\"}\\n\");\n";
+    this->put("            ", this->base_name, "_free(", this->ptr, ");\n");
+    this->out += "            return 1;\n        }\n";
+    this->out += "#ifdef T2C_BENCH_ALLOCS\n        allocs += bench_allocs - a0;\n#endif\n";
+    this->put("        ", this->base_name, "_free(p);\n");
+    this->out += "        ns[i] = bench_now() - t0;\n    }\n";
+    this->out += "    bench_report(\"read_free\", ns, iters);\n\n";
+    if (this->opts.bin) {
+        this->out += "    /* The same values from a snapshot, mapped anew each time */\n";
+        this->out += "    if (bench_bin) {\n";
+        this->out += "        char bin[64];\n";
+        this->put("        ", name, "* img = NULL;\n\n");
+        this->out += "        snprintf(bin, sizeof(bin), \"/tmp/t2c-bench-%ld.bin\", (long)getpid());\n";
+        this->put("        if (", this->base_name, "_save_bin(", this->ptr, ", bin)) {\n");
+        this->out += "            printf(\", \\\"error\\\": \\\"save_bin failed\\\"}\\n\");\n";
+        this->put("            ", this->base_name, "_free(", this->ptr, ");\n");
+        this->out += "            return 1;\n        }\n";
+        this->out += "        for (size_t i = 0; i < iters; ++i) {\n";
+        this->out += "            uint64_t t0 = bench_now();\n";
+        this->put("            if (", this->base_name, "_load_bin(bin, &img)) {\n");
+        this->out += "                printf(\", \\\"error\\\": \\\"load_bin failed\\\"}\\n\");\n";
+        this->out += "                remove(bin);\n";
+        this->put("                ", this->base_name, "_free(", this->ptr, ");\n");
+        this->out += "                return 1;\n            }\n";
+        this->put("            ", this->base_name, "_unload_bin(img);\n");
+        this->out += "            ns[i] = bench_now() - t0;\n        }\n";
+        this->out += "        remove(bin);\n";
+        this->out += "        bench_report(\"load_bin_unload\", ns, iters);\n    }\n\n";
+    }
+
+    this->out += "    /* Print into /dev/null */\n";
+    this->out += "    fflush(stdout);\n";
+    this->out += "    if ((out = dup(1)) >= 0 && (null = open(\"/dev/null\", O_WRONLY)) >= 0) {\n";
+    this->out += "        dup2(null, 1);\n";
+    this->out += "        close(null);\n";
+    this->out += "        for (size_t i = 0; i < iters; ++i) {\n";
+    this->out += "            uint64_t t0 = bench_now();\n";
+    this->put("            ", this->base_name, "_print(", this->ptr, ");\n");
+    this->out += "            ns[i] = bench_now() - t0;\n        }\n";
+    this->out += "        dup2(out, 1);\n";
+    this->out += "        close(out);\n";
+    this->out += "        bench_report(\"print\", ns, iters);\n    }\n";
+    this->put("    ", this->base_name, "_free(", this->ptr, ");\n\n");
+
+    this->out += R"(#ifdef T2C_BENCH_ALLOCS
+    printf(", \"allocs_op\": %.1f", (double)allocs / iters);
+#else
+    (void)allocs;
+    printf(", \"allocs_op\": null");
+#endif
+    getrusage(RUSAGE_SELF, &ru);
+    printf(", \"peak_rss_kb\": %ld}\n", ru.ru_maxrss);
+    return 0;
+}
+
+)";
+    if (this->opts.stream) {
+        this->out += "/* Times _stream with no callbacks: every value is parsed and dropped. Run\n";
+        this->out += " * one process per file to compare the peak RSS of growing inputs. */\n";
+        this->put("static int bench_stream(const char* file, size_t iters, uint64_t* ns) {\n");
+        this->put("    static const ", this->base_name, "_callbacks_t cb;\n");
+        this->out += R"(    struct stat st;
+    struct rusage ru;
+
+    if (stat(file, &st)) {
+)";
+        this->put("        printf(\"{\\\"schema\\\": \\\"%s\\\", \\\"file\\\": \\\"%s\\\", \\\"error\\\": \\\"stat failed\\\"}\\n\", ", schema, ", file);\n");
+        this->out += "        return 1;\n    }\n";
+        this->put("    printf(\"{\\\"schema\\\": \\\"%s\\\", \\\"file\\\": \\\"%s\\\", \\\"bytes\\\": %lld, \\\"iterations\\\": %zu\", ", schema, ", file, (long long)st.st_size, iters);\n");
+        this->out += "    for (size_t i = 0; i < iters; ++i) {\n";
+        this->out += "        uint64_t t0 = bench_now();\n";
+        this->put("        if (", this->base_name, "_stream(file, &cb, NULL)) {\n");
+        this->out += "            printf(\", \\\"error\\\": \\\"stream failed\\\"}\\n\");\n";
+        this->out += "            return 1;\n        }\n";
+        this->out += "        ns[i] = bench_now() - t0;\n    }\n";
+        this->out += "    bench_report(\"stream\", ns, iters);\n";
+        this->out += "    getrusage(RUSAGE_SELF, &ru);\n";
+        this->out += "    printf(\", \\\"peak_rss_kb\\\": %ld}\\n\", ru.ru_maxrss);\n";
+        this->out += "    return 0;\n}\n\n";
+    }
+    // With --stream the driver times _stream instead
+    auto run = [this] (const std::string& file) {
+        return (this->opts.stream ? "stream ? bench_stream(" + file + ", iters, ns) : " : std::string()) + "bench_file(" + file + ", iters, ns)";
+    };
+    this->out += R"(int main(int argc, char** argv) {
+    size_t iters = 1000;
+    int first = 1;
+)" + std::string(this->opts.stream ? "    int stream = 0;\n" : "") + R"(    int rc = 0;
+    uint64_t* ns;
+
+)" + (this->opts.stream ? R"(    if (argc > first && 0 == strcmp(argv[first], "--stream")) {
+        stream = 1;
+        ++first;
+    }
+)" : "") + (this->opts.bin ? R"(    if (argc > first && 0 == strcmp(argv[first], "--bin")) {
+        bench_bin = 1;
+        ++first;
+    }
+)" : "") + R"(    if (argc > first + 1 && 0 == strcmp(argv[first], "-n")) {
+        iters = strtoul(argv[first + 1], NULL, 10);
+        first += 2;
+    }
+    if (iters == 0 || 0 == (ns = malloc(iters * sizeof(*ns)))) {
+        fprintf(stderr, "usage: %s )" + (this->opts.stream ? "[--stream] " : "") + (this->opts.bin ? "[--bin] " : "") + R"([-n ITERATIONS] [FILE.toml...]\n", argv[0]);
+        return 1;
+    }
+    if (first == argc) {
+        rc = )" + run(c_string(this->o_name + ".toml")) + R"(;
+    }
+    for (int i = first; i < argc; ++i) {
+        rc |= )" + run("argv[i]") + R"(;
+    }
+    free(ns);
+    return rc;
+}
+)";
+    std::ofstream(bench + ".c") << this->out;
+}
+
+// TOML text of n with strings and arrays repeated scale times
+static std::string toml_value(const toml::node& n, int scale) {
+    if (const auto* s = n.as_string()) {
+        return toml_string(s->get(), scale);
+    }
+    if (const auto* i = n.as_integer()) {
+        return std::to_string(i->get());
+    }
+    if (const auto* d = n.as_floating_point()) {
+        if (std::isnan(d->get())) {
+            return "nan";
+        }
+        if (std::isinf(d->get())) {
+            return d->get() < 0 ? "-inf" : "inf";
+        }
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.17g", d->get());
+        return std::string(buf) + (strpbrk(buf, ".e") ? "" : ".0");
+    }
+    if (const auto* b = n.as_boolean()) {
+        return b->get() ? "true" : "false";
+    }
+    std::string text = "[";
+    if (const auto* a = n.as_array()) {
+        for (int k = 0; k < scale; ++k) {
+            for (size_t i = 0; i < a->size(); ++i) {
+                text += (text.size() > 1 ? ", " : "") + toml_value(*a->get(i), 1);
+            }
+        }
+    }
+    return text + "]";
+}
+
+// t2c-FILE-xN.toml: the sample with every string, array and array of tables
+// scaled up N times, for the same schema
+void Writer::synth(const Table& root, int scale) {
+    std::string text = "# " + this->o_name + ".toml scaled " + std::to_string(scale) + " times\n";
+    auto keyvals = [&] (const Table& t, const toml::table& tbl) {
+        for (const Field& f: t.fields) {
+            if (const toml::node* n = tbl.get(f.key)) {
+                text += toml_key(f.key) + " = " + toml_value(*n, f.type == Field::Type::t_enum ? 1 : scale) + "\n";
+            }
+        }
+    };
+    std::function<void(const Table&)> synth_r;
+    synth_r = [&] (const Table& t)->void {
+        std::string header;
+        for (const Table* p = &t; p->parent; p = p->parent) {
+            header = toml_key(p->name) + (header.empty() ? "" : ".") + header;
+        }
+        if (t.array) {
+            const toml::array& entries = *t.node->as_array();
+            for (int k = 0; k < scale; ++k) {
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    text += "\n[[" + header + "]]\n";
+                    if (const toml::table* e = entries.get(i)->as_table()) {
+                        keyvals(t, *e);
+                    }
+                }
+            }
+        } else {
+            if (t.parent) {
+                text += "\n[" + header + "]\n";
+            }
+            keyvals(t, *t.node->as_table());
+        }
+        for (const Table* c: t.children) {
+            synth_r(*c);
+        }
+    };
+    synth_r(root);
+
+    const std::string path = LIB_BASE_NAMEh + this->o_name + "-x" + std::to_string(scale) + ".toml";
+    std::ifstream in(path);
+    if (std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>()) != text) {
+        std::ofstream(path) << text;
+    }
+}
+
+void Writer::write(const std::string& name, const Table& root) {
+    this->o_name = fname(name);
+    this->o_var = cvar(this->o_name);
+    this->base_name = root.name.substr(0, root.name.size()-2);
+
+    uint64_t h = schema_hash(root);
+    std::string id = options_id(this->opts);
+    if (this->opts.embed) {
+        // The values are part of the output too
+        std::ifstream input(name, std::ios::binary);
+        id.append(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+    for (unsigned char c: id) {
+        h = (h ^ c) * 1099511628211ull;
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(h));
+    this->stamp = "/* " + std::string(lib_base_name) + " stamp " + hex + " */\n";
+
+    for (int scale: this->opts.synth) {
+        this->synth(root, scale);
+    }
+    if (this->opts.incremental) {
+        this->depfile(name);
+        if (this->is_current(LIB_BASE_NAMEh + this->o_name + ".h") && this->is_current(LIB_BASE_NAMEh + this->o_name + ".c")
+            && (!this->opts.bench || this->is_current(LIB_BASE_NAMEh + this->o_name + "-bench.c"))
+            && (!this->opts.cpp || this->is_current(LIB_BASE_NAMEh + this->o_name + ".hpp"))) {
+            return;
+        }
+    }
+
+    this->h_header();
+    this->h_enums(root);
+    if (!this->opts.cold.empty()) {
+        this->h_struct(root, true);
+        this->out += "\n";
+    }
+    this->h_struct(root, false);
+    this->h_bits(root);
+    this->h_functions(root);
+    this->h_finalize();
+    this->out.clear();
+
+    this->phash_emitted = false;
+    this->dispatch_emitted = false;
+    this->c_src(root);
+    this->c_finalize();
+    this->out.clear();
+
+    if (this->opts.bench) {
+        this->c_bench(root);
+        this->out.clear();
+    }
+    if (this->opts.cpp) {
+        this->h_cpp(root);
+        this->out.clear();
+    }
+}
+
+// Adds FILE.toml, every *.toml in a directory, or the paths listed in an @response file
+static int collect_inputs(const std::string& arg, std::vector<std::string>& files) {
+    if (arg[0] == '@') {
+        std::ifstream rsp(arg.substr(1));
+        if (!rsp) {
+            std::cerr << "cannot open response file " << arg.substr(1) << "\n";
+            return 1;
+        }
+        std::string line;
+        while (std::getline(rsp, line)) {
+            line.erase(0, line.find_first_not_of(" \t\r"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty() && line[0] != '#' && collect_inputs(line, files)) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    std::error_code ec;
+    if (std::filesystem::is_directory(arg, ec)) {
+        std::vector<std::string> found;
+        for (const auto& e: std::filesystem::directory_iterator(arg, ec)) {
+            if (e.is_regular_file() && e.path().extension() == ".toml") {
+                found.push_back(e.path().string());
+            }
+        }
+        if (ec) {
+            std::cerr << "cannot list directory " << arg << ": " << ec.message() << "\n";
+            return 1;
+        }
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+        return 0;
+    }
+    files.push_back(arg);
+    return 0;
+}
+
+// Runs job(0..count-1) on up to `threads` workers. Each worker drains its
+// own deque from the back and, once empty, steals from the front of the others.
+static void run_pool(size_t count, unsigned threads, const std::function<void(size_t)>& job) {
+    threads = std::max(1u, std::min<unsigned>(threads, count));
+    if (threads == 1) {
+        for (size_t i = 0; i < count; ++i) {
+            job(i);
+        }
+        return;
+    }
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> jobs;
+    };
+    std::vector<Queue> queues(threads);
+    for (size_t i = 0; i < count; ++i) {
+        queues[i * threads / count].jobs.push_back(i);
+    }
+
+    auto worker = [&] (unsigned self) {
+        for (;;) {
+            size_t i = 0;
+            bool got = false;
+            {
+                std::lock_guard<std::mutex> g(queues[self].lock);
+                if (!queues[self].jobs.empty()) {
+                    i = queues[self].jobs.back();
+                    queues[self].jobs.pop_back();
+                    got = true;
+                }
+            }
+            for (unsigned k = 1; !got && k < threads; ++k) {
+                Queue& victim = queues[(self + k) % threads];
+                std::lock_guard<std::mutex> g(victim.lock);
+                if (!victim.jobs.empty()) {
+                    i = victim.jobs.front();
+                    victim.jobs.pop_front();
+                    got = true;
+                }
+            }
+            // Jobs are never added once started, so all queues empty means done
+            if (!got) {
+                return;
+            }
+            job(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(worker, t);
+    }
+    worker(0);
+    for (std::thread& t: pool) {
+        t.join();
+    }
+}
+
+// Times the generator on synthetic schemas: a chain of `depth` nested tables
+// under the root, each holding `width` keys of every supported type
+static int bench(const Options& opts) {
+    const std::filesystem::path cwd = std::filesystem::current_path();
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "t2c-bench";
+    std::filesystem::create_directories(dir);
+    std::filesystem::current_path(dir);
+
+    static const char* values[] = { "1", "1.5", "true", "\"s\"", "[1, 2]", "[1.5]", "[true]", "[\"a\", \"b\"]" };
+    printf("%8s %6s %9s %10s %10s %10s %12s\n", "width", "depth", "keys", "parse ms", "write ms", "output KB", "peak RSS KB");
+
+    int rc = 0;
+    for (int depth: {1, 8, 64}) {
+        for (int width: {100, 1000, 10000}) {
+            const std::string file = "bench_" + std::to_string(width) + "_" + std::to_string(depth) + ".toml";
+            {
+                std::string text, header;
+                for (int d = 0; d <= depth; ++d) {
+                    if (d) {
+                        header += (d > 1 ? ".t" : "t") + std::to_string(d);
+                        text += "\n[" + header + "]\n";
+                    }
+                    for (int w = 0; w < width; ++w) {
+                        text += "key_" + std::to_string(w) + " = " + values[w % 8] + "\n";
+                    }
+                }
+                std::ofstream(file) << text;
+            }
+
+            Writer writer(opts);
+            Reader reader(opts);
+
+            const auto t0 = std::chrono::steady_clock::now();
+            if (reader.parser(file)) {
+                rc = 1;
+                break;
+            }
+            const auto t1 = std::chrono::steady_clock::now();
+            writer.write(file, reader.get_root());
+            const auto t2 = std::chrono::steady_clock::now();
+
+            const std::string out = LIB_BASE_NAMEh + fname(file);
+            const uintmax_t size = std::filesystem::file_size(out + ".h") + std::filesystem::file_size(out + ".c");
+            struct rusage ru;
+            getrusage(RUSAGE_SELF, &ru);
+
+            printf("%8d %6d %9d %10.1f %10.1f %10ju %12ld\n", width, depth, width * (depth + 1),
+                std::chrono::duration<double, std::milli>(t1 - t0).count(),
+                std::chrono::duration<double, std::milli>(t2 - t1).count(),
+                size / 1024, ru.ru_maxrss);
+            fflush(stdout);
+
+            std::filesystem::remove(file);
+            std::filesystem::remove(out + ".h");
+            std::filesystem::remove(out + ".c");
+        }
+    }
+
+    std::filesystem::current_path(cwd);
+    return rc;
+}
+
+// What the schema of file would clash with among the names t2c emits for
+// every schema (its t2c_NAME_t type, or with --cpp its t2c::NAME namespace),
+// or an empty string
+static std::string reserved(const std::string& file, const Options& opts) {
+    static const std::set<std::string> types = {
+        "field", "type", "stats", "stats_table", "arena", "error", "schema", "rt_table",
+    };
+    static const std::set<std::string> cpp = {
+        "span", "field", "make_field", "schema", "enum_names", "is_table", "is_span", "is_entries",
+        "visit", "equal", "hash", "write_toml", "detail",
+    };
+    const std::string var = cvar(fname(file));
+    if (types.count(var)) {
+        return LIB_BASE_NAMEu + var + "_t";
+    }
+    if (opts.table && var == "rt") {
+        return LIB_BASE_NAMEh + var + ".c";
+    }
+    if (opts.cpp && cpp.count(var)) {
+        return LIB_BASE_NAMEu.substr(0, LIB_BASE_NAMEu.size()-1) + "::" + var;
+    }
+    return "";
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    std::vector<std::string> files;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    bool usage = argc < 2;
+    bool self_bench = false;
+
+    for (int i = 1; i < argc && !usage; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--arena") {
+            opts.arena = true;
+        } else if (arg == "--direct") {
+            opts.direct = true;
+        } else if (arg == "--bin") {
+            opts.bin = true;
+        } else if (arg == "--handle") {
+            opts.handle = true;
+        } else if (arg == "--many") {
+            opts.many = true;
+        } else if (arg == "--lazy") {
+            opts.lazy = true;
+        } else if (arg == "--write") {
+            opts.write = true;
+        } else if (arg == "--compare") {
+            opts.compare = true;
+        } else if (arg == "--reflect") {
+            opts.reflect = true;
+        } else if (arg == "--soa") {
+            opts.soa = true;
+        } else if (arg == "--layout") {
+            opts.layout = true;
+        } else if (arg == "--pack-bools") {
+            opts.pack = true;
+        } else if (arg == "--cold") {
+            usage = i+1 == argc;
+            opts.cold.push_back(usage ? "" : argv[++i]);
+        } else if (arg == "--embed") {
+            opts.embed = true;
+        } else if (arg == "--table") {
+            opts.table = true;
+        } else if (arg == "--stream") {
+            opts.stream = true;
+        } else if (arg == "--cpp") {
+            opts.cpp = true;
+        } else if (arg == "--inline") {
+            opts.fixed = true;
+        } else if (arg == "--cap") {
+            // PATH=N
+            const std::string cap = i+1 < argc ? argv[++i] : "";
+            const size_t eq = cap.rfind('=');
+            const long n = eq == std::string::npos ? 0 : std::atol(cap.c_str() + eq + 1);
+            usage = n <= 0;
+            opts.caps.emplace_back(cap.substr(0, eq), n);
+        } else if (arg == "--enum") {
+            // PATH=A,B,C
+            const std::string spec = i+1 < argc ? argv[++i] : "";
+            const size_t eq = spec.find('=');
+            std::vector<std::string> values;
+            for (size_t pos = eq + 1; eq != std::string::npos && pos <= spec.size(); ) {
+                const size_t end = std::min(spec.find(',', pos), spec.size());
+                values.push_back(spec.substr(pos, end - pos));
+                pos = end + 1;
+            }
+            usage = values.empty() || std::find(values.begin(), values.end(), "") != values.end();
+            opts.enums.emplace_back(spec.substr(0, eq), values);
+        } else if (arg == "--emit-bench") {
+            opts.bench = true;
+        } else if (arg == "--synth") {
+            const int n = i+1 < argc ? std::atoi(argv[++i]) : 0;
+            usage = n <= 0;
+            opts.synth.push_back(n);
+        } else if (arg == "--incremental") {
+            opts.incremental = true;
+        } else if (arg == "--bench") {
+            self_bench = true;
+        } else if (arg.rfind("-j", 0) == 0) {
+            const std::string n = arg.size() > 2 ? arg.substr(2) : (i+1 < argc ? argv[++i] : "");
+            jobs = std::atoi(n.c_str());
+            usage = jobs == 0;
+        } else if (arg.rfind("-", 0) == 0) {
+            usage = true;
+        } else if (collect_inputs(arg, files)) {
+            exit(1);
+        }
+    }
+    if (usage || (files.empty() && !self_bench)) {
+        printf("Usage: %s [--arena] [--direct] [--bin] [--handle] [--many] [--lazy] [--write] [--compare] [--reflect] [--soa] [--layout] [--pack-bools] [--cold PATH]... [--inline] [--cap PATH=N]... [--enum PATH=A,B,...]... [--embed] [--table] [--stream] [--cpp] [--emit-bench] [--synth N]... [--incremental] [-j N] TFILE.toml|DIR|@LIST...\n"
+               "       %s --bench [--arena] [--direct] [--bin] [--handle] [--soa] [--layout] [--pack-bools] [--inline]", argv[0], argv[0]);
+        exit(1);
+    }
+    if (opts.arena && opts.direct) {
+        std::cerr << "--arena and --direct cannot be combined\n";
+        exit(1);
+    }
+    if (opts.lazy && (opts.arena || opts.direct)) {
+        std::cerr << "--lazy cannot be combined with --arena or --direct\n";
+        exit(1);
+    }
+    if (opts.table && (opts.arena || opts.direct || opts.soa || opts.pack || !opts.cold.empty() || opts.lazy)) {
+        std::cerr << "--table cannot be combined with --arena, --direct, --soa, --pack-bools, --cold or --lazy\n";
+        exit(1);
+    }
+    if (opts.stream && opts.soa) {
+        std::cerr << "--stream cannot be combined with --soa\n";
+        exit(1);
+    }
+    if (self_bench) {
+        return bench(opts);
+    }
+
+    // Outputs are named after the file alone, so two inputs must not share one
+    std::map<std::string, std::string> outputs;
+    for (const std::string& file: files) {
+        auto [it, fresh] = outputs.emplace(fname(file), file);
+        if (!fresh) {
+            std::cerr << file << " and " << it->second << " would both generate " << LIB_BASE_NAMEh << it->first << ".c\n";
+            exit(1);
+        }
+        const std::string clash = reserved(file, opts);
+        if (!clash.empty()) {
+            std::cerr << file << " would generate " << clash << ", which t2c reserves; rename the file\n";
+            exit(1);
+        }
+    }
+
+    if (opts.table) {
+        write_runtime();
+    }
+
+    std::atomic<int> failed{0};
+    run_pool(files.size(), jobs, [&] (size_t i) {
+        Writer writer(opts);
+        Reader reader(opts);
+
+        if (reader.parser(files[i])) {
+            failed = 1;
+            return;
+        }
+
+        writer.write(files[i], reader.get_root());
+    });
+
+    return failed;
+}